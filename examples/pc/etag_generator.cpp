@@ -0,0 +1,198 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include <sys/stat.h>
+
+#include "etag_generator.hpp"
+
+namespace {
+const uint64_t prime1 = 11400714785074694791ULL;
+const uint64_t prime2 = 14029467366897019727ULL;
+const uint64_t prime3 = 1609587929392839161ULL;
+const uint64_t prime4 = 9650029242287828579ULL;
+const uint64_t prime5 = 2870177450012600261ULL;
+
+inline uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t read64(const char *p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t read32(const char *p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t mixRound(uint64_t acc, uint64_t input) {
+    acc += input * prime2;
+    return rotl(acc, 31) * prime1;
+}
+
+inline uint64_t mergeRound(uint64_t acc, uint64_t val) {
+    acc ^= mixRound(0, val);
+    return acc * prime1 + prime4;
+}
+
+// XXH64, fed in parts. The four lanes of a 32 byte stripe are independent,
+// so their multiplications overlap in the pipeline.
+class Xxh64 {
+   public:
+    void update(const char *data, size_t size) {
+        total_ += size;
+        if (tailSize_ + size < sizeof(tail_)) {
+            std::memcpy(tail_ + tailSize_, data, size);
+            tailSize_ += size;
+            return;
+        }
+        if (tailSize_ > 0) {
+            size_t fill = sizeof(tail_) - tailSize_;
+            std::memcpy(tail_ + tailSize_, data, fill);
+            stripe(tail_);
+            data += fill;
+            size -= fill;
+            tailSize_ = 0;
+        }
+        const char *end = data + size;
+        for (; end - data >= 32; data += 32) {
+            stripe(data);
+        }
+        tailSize_ = end - data;
+        std::memcpy(tail_, data, tailSize_);
+    }
+
+    uint64_t digest() const {
+        uint64_t h;
+        if (total_ >= 32) {
+            h = rotl(v1_, 1) + rotl(v2_, 7) + rotl(v3_, 12) + rotl(v4_, 18);
+            h = mergeRound(h, v1_);
+            h = mergeRound(h, v2_);
+            h = mergeRound(h, v3_);
+            h = mergeRound(h, v4_);
+        } else {
+            h = prime5;
+        }
+        h += total_;
+
+        const char *p = tail_;
+        const char *end = tail_ + tailSize_;
+        for (; end - p >= 8; p += 8) {
+            h ^= mixRound(0, read64(p));
+            h = rotl(h, 27) * prime1 + prime4;
+        }
+        if (end - p >= 4) {
+            h ^= static_cast<uint64_t>(read32(p)) * prime1;
+            h = rotl(h, 23) * prime2 + prime3;
+            p += 4;
+        }
+        for (; p < end; ++p) {
+            h ^= static_cast<uint64_t>(static_cast<unsigned char>(*p)) * prime5;
+            h = rotl(h, 11) * prime1;
+        }
+
+        h ^= h >> 33;
+        h *= prime2;
+        h ^= h >> 29;
+        h *= prime3;
+        h ^= h >> 32;
+        return h;
+    }
+
+   private:
+    void stripe(const char *p) {
+        v1_ = mixRound(v1_, read64(p));
+        v2_ = mixRound(v2_, read64(p + 8));
+        v3_ = mixRound(v3_, read64(p + 16));
+        v4_ = mixRound(v4_, read64(p + 24));
+    }
+
+    uint64_t v1_ = prime1 + prime2;
+    uint64_t v2_ = prime2;
+    uint64_t v3_ = 0;
+    uint64_t v4_ = 0 - prime1;
+    char tail_[32];
+    size_t tailSize_ = 0;
+    uint64_t total_ = 0;
+};
+
+std::string toHex(uint64_t value) {
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%llx", static_cast<unsigned long long>(value));
+    return buf;
+}
+
+// Inode, size and modification time (ns) of the regular file at path.
+bool statFile(const std::string &path, uint64_t &inode, uint64_t &size, uint64_t &mtime) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    inode = st.st_ino;
+    size = st.st_size;
+    mtime = static_cast<uint64_t>(st.st_mtime) * 1000000000ULL;
+#if defined(__APPLE__)
+    mtime += st.st_mtimespec.tv_nsec;
+#elif defined(__linux__)
+    mtime += st.st_mtim.tv_nsec;
+#endif
+    return true;
+}
+}  // namespace
+
+ETagGenerator::ETagGenerator(bool hashContent) : hashContent_(hashContent) {}
+
+std::string ETagGenerator::get(const std::string &path) {
+    uint64_t inode, size, mtime;
+    if (!statFile(path, inode, size, mtime)) {
+        return "";
+    }
+    if (!hashContent_) {
+        return '"' + toHex(inode) + '-' + toHex(size) + '-' + toHex(mtime) + '"';
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = hashed_.find(path);
+        if (it != hashed_.end() && it->second.inode_ == inode && it->second.size_ == size &&
+            it->second.mtime_ == mtime) {
+            return it->second.eTag_;
+        }
+    }
+
+    // Hashed without holding the lock, as large files take a while
+    std::ifstream is(path, std::ios::in | std::ios::binary);
+    if (!is.is_open()) {
+        return "";
+    }
+    std::vector<char> buf(64 * 1024);
+    Xxh64 hasher;
+    while (is.read(buf.data(), buf.size()) || is.gcount() > 0) {
+        hasher.update(buf.data(), is.gcount());
+    }
+    const std::string eTag = '"' + toHex(hasher.digest()) + '"';
+
+    uint64_t inodeAfter, sizeAfter, mtimeAfter;
+    if (statFile(path, inodeAfter, sizeAfter, mtimeAfter) && inodeAfter == inode &&
+        sizeAfter == size && mtimeAfter == mtime) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        hashed_[path] = {inode, size, mtime, eTag};
+    }
+    // Otherwise changed while hashing, hashed again next time
+    return eTag;
+}
+
+void ETagGenerator::invalidate(const std::string &path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    hashed_.erase(path);
+}
+
+uint64_t ETagGenerator::hash(const char *data, size_t size) {
+    Xxh64 hasher;
+    hasher.update(data, size);
+    return hasher.digest();
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Provides the ETags of files, for any file below the doc root.
+//
+// By default an ETag is built from the inode, size and modification time of
+// the file, i.e. a single stat() and no reading. Optionally the ETag is a hash
+// of the content instead (stable over copies and restores of the files),
+// computed when first asked for and kept until the size or modification time
+// of the file changes.
+class ETagGenerator {
+   public:
+    explicit ETagGenerator(bool hashContent = false);
+
+    ETagGenerator(const ETagGenerator &) = delete;
+    ETagGenerator &operator=(const ETagGenerator &) = delete;
+
+    // The quoted ETag of the regular file at path, empty if there is none.
+    std::string get(const std::string &path);
+
+    // Forget the content hash of path, e.g. when it has been written.
+    void invalidate(const std::string &path);
+
+    // 64 bit hash of data (XXH64 with seed 0). Works on four independent
+    // lanes of 8 bytes, which keeps the multipliers of the CPU busy.
+    static uint64_t hash(const char *data, size_t size);
+
+   private:
+    struct Hashed {
+        uint64_t inode_;
+        uint64_t size_;
+        uint64_t mtime_;
+        std::string eTag_;
+    };
+
+    const bool hashContent_;
+
+    // Guards hashed_, as the generator may be shared by several threads.
+    std::mutex mutex_;
+
+    // Content ETags by path, with the metadata they were computed for.
+    std::unordered_map<std::string, Hashed> hashed_;
+};
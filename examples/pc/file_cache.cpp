@@ -0,0 +1,188 @@
+#include <cerrno>
+#include <filesystem>
+#include <fstream>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "file_cache.hpp"
+
+namespace fs = std::filesystem;
+
+FileCache::FileCache(size_t memoryBudget, size_t maxFileSize)
+    : memoryBudget_(memoryBudget), maxFileSize_(maxFileSize) {
+#if defined(__linux__)
+    inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd_ >= 0 && pipe(stopPipe_) == 0) {
+        watcher_ = std::thread(&FileCache::runWatcher, this);
+    }
+#endif
+}
+
+FileCache::~FileCache() {
+#if defined(__linux__)
+    if (watcher_.joinable()) {
+        char stop = 0;
+        (void)!write(stopPipe_[1], &stop, 1);
+        watcher_.join();
+    }
+    for (int fd : {inotifyFd_, stopPipe_[0], stopPipe_[1]}) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+#endif
+}
+
+std::shared_ptr<const FileCache::Entry> FileCache::find(const std::string &path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(path);
+    if (it == entries_.end()) {
+        return nullptr;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second.lruPos_);
+    return it->second.entry_;
+}
+
+std::shared_ptr<const FileCache::Entry> FileCache::load(const std::string &path,
+                                                        const std::string &eTag) {
+    std::error_code ec;
+    size_t fileSize = fs::file_size(path, ec);
+    if (ec || fileSize > maxFileSize_ || fileSize > memoryBudget_) {
+        return nullptr;
+    }
+
+    size_t generation;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // Watch before reading, so that any later change invalidates
+        watchDirectory(fs::path(path).parent_path().string());
+        generation = generation_;
+    }
+
+    auto entry = std::make_shared<Entry>();
+    entry->content_.resize(fileSize);
+    entry->eTag_ = eTag;
+    std::ifstream is(path, std::ios::in | std::ios::binary);
+    is.read(entry->content_.data(), fileSize);
+    if (static_cast<size_t>(is.gcount()) != fileSize) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (generation != generation_) {
+        // Changed while reading, serve it this time but do not cache it
+        return entry;
+    }
+    auto it = entries_.find(path);
+    if (it != entries_.end()) {
+        erase(it);
+    }
+    while (memoryUsage_ + fileSize > memoryBudget_ && !lru_.empty()) {
+        erase(entries_.find(lru_.back()));
+    }
+    lru_.push_front(path);
+    entries_[path] = {entry, lru_.begin()};
+    memoryUsage_ += fileSize;
+    return entry;
+}
+
+void FileCache::invalidate(const std::string &path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    generation_++;
+    auto it = entries_.find(path);
+    if (it != entries_.end()) {
+        erase(it);
+    }
+}
+
+size_t FileCache::getMemoryUsage() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return memoryUsage_;
+}
+
+size_t FileCache::getNrOfEntries() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+void FileCache::erase(std::unordered_map<std::string, Slot>::iterator it) {
+    memoryUsage_ -= it->second.entry_->content_.size();
+    lru_.erase(it->second.lruPos_);
+    entries_.erase(it);
+}
+
+void FileCache::watchDirectory(const std::string &dir) {
+#if defined(__linux__)
+    if (!watcher_.joinable()) {
+        return;
+    }
+    const std::string watchDir = dir.empty() ? "." : dir;
+    for (const auto &watch : watches_) {
+        if (watch.second == watchDir) {
+            return;
+        }
+    }
+    int wd = inotify_add_watch(inotifyFd_,
+                               watchDir.c_str(),
+                               IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM |
+                                   IN_MOVED_TO | IN_ATTRIB);
+    if (wd >= 0) {
+        watches_[wd] = watchDir;
+    }
+#else
+    (void)dir;
+#endif
+}
+
+void FileCache::runWatcher() {
+#if defined(__linux__)
+    alignas(inotify_event) char buf[4096];
+    pollfd fds[2] = {{inotifyFd_, POLLIN, 0}, {stopPipe_[0], POLLIN, 0}};
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        if (fds[1].revents != 0) {
+            return;
+        }
+        if ((fds[0].revents & POLLIN) == 0) {
+            continue;
+        }
+        ssize_t n = read(inotifyFd_, buf, sizeof(buf));
+        for (char *p = buf; n > 0 && p < buf + n;) {
+            const inotify_event *event = reinterpret_cast<const inotify_event *>(p);
+            p += sizeof(inotify_event) + event->len;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            generation_++;
+            if (event->mask & IN_Q_OVERFLOW) {
+                // Events were lost, start over
+                entries_.clear();
+                lru_.clear();
+                memoryUsage_ = 0;
+                continue;
+            }
+            auto watch = watches_.find(event->wd);
+            if (watch == watches_.end() || event->len == 0) {
+                continue;
+            }
+            // Same form as the paths cached, i.e. <dir>/<name>
+            const std::string dir = watch->second == "." ? "" : watch->second;
+            auto it = entries_.find((fs::path(dir) / event->name).string());
+            if (it == entries_.end() && dir.empty()) {
+                it = entries_.find((fs::path(".") / event->name).string());
+            }
+            if (it != entries_.end()) {
+                erase(it);
+            }
+        }
+    }
+#endif
+}
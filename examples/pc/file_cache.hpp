@@ -0,0 +1,76 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// LRU cache keeping small, frequently requested files in memory, bounded by a
+// memory budget. Entries are shared, so a reply still being written keeps its
+// content alive after the entry has been evicted or invalidated.
+//
+// On Linux, files changed on disk (e.g. by another process) are invalidated
+// by a background thread watching the directories of the cached files with
+// inotify.
+class FileCache {
+   public:
+    struct Entry {
+        std::vector<char> content_;
+        std::string eTag_;
+    };
+
+    FileCache(size_t memoryBudget, size_t maxFileSize);
+    ~FileCache();
+
+    FileCache(const FileCache &) = delete;
+    FileCache &operator=(const FileCache &) = delete;
+
+    // The cached entry of path, nullptr if not cached.
+    std::shared_ptr<const Entry> find(const std::string &path);
+
+    // Read path into the cache, evicting least recently used entries to stay
+    // within the budget. Returns nullptr if the file is too large or could not
+    // be read.
+    std::shared_ptr<const Entry> load(const std::string &path, const std::string &eTag);
+
+    void invalidate(const std::string &path);
+
+    size_t getMemoryUsage() const;
+    size_t getNrOfEntries() const;
+
+   private:
+    struct Slot {
+        std::shared_ptr<const Entry> entry_;
+        std::list<std::string>::iterator lruPos_;
+    };
+
+    void erase(std::unordered_map<std::string, Slot>::iterator it);
+    void watchDirectory(const std::string &dir);
+    void runWatcher();
+
+    const size_t memoryBudget_;
+    const size_t maxFileSize_;
+
+    // Guards the members below, as the cache is used by several threads and
+    // the watcher.
+    mutable std::mutex mutex_;
+
+    // Cached paths, most recently used first.
+    std::list<std::string> lru_;
+    std::unordered_map<std::string, Slot> entries_;
+    size_t memoryUsage_ = 0;
+
+    // Incremented by every invalidation, so that a file changed while being
+    // loaded is not cached.
+    size_t generation_ = 0;
+
+    // inotify descriptor, watched directories by watch descriptor, and the
+    // pipe used to stop the watcher thread.
+    int inotifyFd_ = -1;
+    int stopPipe_[2] = {-1, -1};
+    std::unordered_map<int, std::string> watches_;
+    std::thread watcher_;
+};
@@ -2,77 +2,51 @@
 #include <limits>
 #include <string>
 #include <vector>
-#include <iomanip>
 #include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "beauty/http_result.hpp"
 #include "beauty/header.hpp"
+#include "beauty/mime_types.hpp"
 #include "file_io.hpp"
 
 namespace fs = std::filesystem;
 using namespace beauty;
 
-namespace {
-// A simple polynomial rolling hash function to generate a hash from content.
-// This function updates an existing hash value with new data.
-unsigned long long simple_rolling_hash_update(unsigned long long current_hash,
-                                              const char *content,
-                                              size_t size) {
-    const unsigned long long p = 31;       // A prime number
-    const unsigned long long m = 1e9 + 9;  // A large prime modulus
-    unsigned long long p_pow = 1;
-
-    for (size_t i = 0; i < size; ++i) {
-        current_hash = (current_hash + (content[i] - 'a' + 1) * p_pow) % m;
-        p_pow = (p_pow * p) % m;
-    }
-    return current_hash;
-}
-
-// Function to generate an ETag from a file's content by reading in chunks.
-std::string generate_etag_from_file(const std::string &filepath) {
-    std::ifstream file(filepath, std::ios::binary);
-    if (!file.is_open()) {
-        return "";  // Return an empty string if the file cannot be opened.
-    }
-
-    // Use a fixed-size buffer for reading chunks to save memory.
-    const size_t chunk_size = 1024;
-    std::vector<char> buffer(chunk_size);
-    unsigned long long final_hash = 0;
+FileIO::FileIO(const std::string &docRoot, bool hashContent)
+    : docRoot_(docRoot), eTags_(hashContent) {}
 
-    while (file.read(buffer.data(), chunk_size)) {
-        final_hash = simple_rolling_hash_update(final_hash, buffer.data(), chunk_size);
+FileIO::~FileIO() {
+    if (readPool_) {
+        // Let reads in progress complete
+        readPool_->join();
     }
-
-    // Process the last chunk, which might be smaller than chunk_size
-    size_t last_chunk_size = file.gcount();
-    if (last_chunk_size > 0) {
-        final_hash = simple_rolling_hash_update(final_hash, buffer.data(), last_chunk_size);
-    }
-
-    // Convert the final hash to a hex string for a more compact ETag.
-    std::stringstream ss;
-    ss << std::hex << final_hash;
-
-    // Return the ETag as a quoted string, which is the required format.
-    return "\"" + ss.str() + "\"";
 }
 
-}  // namespace
+void FileIO::enableAsyncReads(size_t nrOfThreads) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    readPool_.reset(new asio::thread_pool(nrOfThreads));
+}
 
-FileIO::FileIO(const std::string &docRoot) : docRoot_(docRoot) {
-    // Read existing files and generate their ETags
-    // For simplicity, this example does not implement directory traversal.
-    for (const auto &entry : fs::directory_iterator(docRoot_)) {
-        if (entry.is_regular_file()) {
-            std::string fullPath = entry.path().string();
-            eTags_[fullPath] = generate_etag_from_file(fullPath);
+void FileIO::enableCache(size_t memoryBudget, size_t maxFileSize, bool warmUp) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cache_.reset(new FileCache(memoryBudget, maxFileSize));
+    if (!warmUp) {
+        return;
+    }
+    std::error_code ec;
+    for (fs::recursive_directory_iterator it(docRoot_, ec), end; !ec && it != end;
+         it.increment(ec)) {
+        if (it->is_regular_file(ec)) {
+            const std::string fullPath = it->path().string();
+            cache_->load(fullPath, eTags_.get(fullPath));
         }
     }
 }
 
 size_t FileIO::openFileForRead(const std::string &id, const Request &req, Reply &reply) {
+    std::lock_guard<std::mutex> lock(mutex_);
     HttpResult res(reply.content_);
 
     // Remove leading slash from filePath_ to make it relative
@@ -82,8 +56,14 @@ size_t FileIO::openFileForRead(const std::string &id, const Request &req, Reply
 
     fs::path fullPath = fs::path(docRoot_) / reply.filePath_;
 
+    // Cached files are served without touching the file system
+    std::shared_ptr<const FileCache::Entry> cached;
+    if (cache_) {
+        cached = cache_->find(fullPath.string());
+    }
+
     // Check if file exists and is a regular file
-    if (!fs::exists(fullPath)) {
+    if (!cached && !fs::exists(fullPath)) {
         res.jsonError(Reply::not_found, "Could not read file: " + reply.filePath_);
         reply.send(res.statusCode_, "application/json");
         return 0;
@@ -97,17 +77,32 @@ size_t FileIO::openFileForRead(const std::string &id, const Request &req, Reply
     }
 
     // Check for If-None-Match header (ETag matching)
+    const std::string eTag = cached ? cached->eTag_ : eTags_.get(fullPath.string());
     const std::string requestETag = req.getHeaderValue("If-None-Match");
 
     if (!requestETag.empty()) {
-        std::string currentETag = eTags_[fullPath.string()];
-        if (!currentETag.empty() && requestETag == currentETag) {
-            reply.addHeader("ETag", currentETag);
+        if (!eTag.empty() && requestETag == eTag) {
+            reply.addHeader("ETag", eTag);
             reply.send(Reply::not_modified);
             return 0;  // No content to read for 304
         }
     }
 
+    if (!cached && cache_) {
+        cached = cache_->load(fullPath.string(), eTag);
+    }
+    if (cached) {
+        if (!cached->eTag_.empty()) {
+            reply.addHeader("ETag", cached->eTag_);
+        }
+        reply.sendPtr(Reply::ok,
+                      mime_types::extensionToType(reply.fileExtension_),
+                      cached->content_.data(),
+                      cached->content_.size(),
+                      cached);
+        return cached->content_.size();
+    }
+
     // Get file size using filesystem
     std::error_code ec;
     size_t fileSize = fs::file_size(fullPath, ec);
@@ -127,26 +122,97 @@ size_t FileIO::openFileForRead(const std::string &id, const Request &req, Reply
         return 0;
     }
 
+    openReadPaths_[id] = fullPath.string();
+
     // Add ETag header for successful reads
-    auto etag = eTags_.find(fullPath.string());
-    if (etag != eTags_.end()) {
-        reply.addHeader("ETag", etag->second);
+    if (!eTag.empty()) {
+        reply.addHeader("ETag", eTag);
     }
 
     return fileSize;
 }
 
 int FileIO::readFile(const std::string &id, const Request &, char *buf, size_t maxSize) {
+    std::ifstream *is;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = openReadFiles_.find(id);
+        if (it == openReadFiles_.end()) {
+            std::cerr << "ERROR: readFile() called with invalid id: " << id << std::endl;
+            return 0;  // No bytes read
+        }
+        is = &it->second;
+    }
+    // Read without holding the lock, so that a slow read does not hold up
+    // other files. The stream stays put, as it is only closed (erased) by
+    // closeReadFile of the same id, which is not called during a read.
+    is->read(buf, maxSize);
+    return is->gcount();
+}
+
+bool FileIO::readFileAsync(const std::string &id,
+                           const Request &request,
+                           char *buf,
+                           size_t maxSize,
+                           std::function<void(int)> done) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!readPool_) {
+        return false;
+    }
+    asio::post(*readPool_, [this, id, &request, buf, maxSize, done]() {
+        done(readFile(id, request, buf, maxSize));
+    });
+    return true;
+}
+
+bool FileIO::getNativeReadFile(const std::string &id, NativeReadFile &file) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = openReadFiles_.find(id);
+    auto path = openReadPaths_.find(id);
+    if (it == openReadFiles_.end() || path == openReadPaths_.end()) {
+        return false;
+    }
+    int fd = ::open(path->second.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    std::error_code ec;
+    size_t fileSize = fs::file_size(path->second, ec);
+    std::streamoff offset = it->second.tellg();
+    if (ec || offset < 0 || static_cast<size_t>(offset) > fileSize) {
+        ::close(fd);
+        return false;
+    }
+    auto previous = openReadFds_.find(id);
+    if (previous != openReadFds_.end()) {
+        ::close(previous->second);
+    }
+    openReadFds_[id] = fd;
+    file.fd_ = fd;
+    file.offset_ = offset;
+    file.length_ = fileSize - offset;
+    return true;
+}
+
+bool FileIO::seekReadFile(const std::string &id, size_t offset) {
+    std::lock_guard<std::mutex> lock(mutex_);
     auto it = openReadFiles_.find(id);
     if (it == openReadFiles_.end()) {
-        std::cerr << "ERROR: readFile() called with invalid id: " << id << std::endl;
-        return 0;  // No bytes read
+        return false;
     }
-    it->second.read(buf, maxSize);
-    return it->second.gcount();
+    it->second.clear();
+    it->second.seekg(offset);
+    return !it->second.fail();
 }
 
 void FileIO::closeReadFile(const std::string &id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    openReadPaths_.erase(id);
+    auto fd = openReadFds_.find(id);
+    if (fd != openReadFds_.end()) {
+        ::close(fd->second);
+        openReadFds_.erase(fd);
+    }
     auto it = openReadFiles_.find(id);
     if (it == openReadFiles_.end()) {
         return;
@@ -156,6 +222,7 @@ void FileIO::closeReadFile(const std::string &id) {
 }
 
 void FileIO::openFileForWrite(const std::string &id, const Request &, Reply &reply) {
+    std::lock_guard<std::mutex> lock(mutex_);
     HttpResult res(reply.content_);
 
     // Remove leading slash from filePath_ to make it relative
@@ -163,6 +230,9 @@ void FileIO::openFileForWrite(const std::string &id, const Request &, Reply &rep
         reply.filePath_ = reply.filePath_.substr(1);
     }
     fs::path fullPath = fs::path(docRoot_) / reply.filePath_;
+    if (cache_) {
+        cache_->invalidate(fullPath.string());
+    }
 
     // Ensure parent directory exists
     fs::path parentDir = fullPath.parent_path();
@@ -184,7 +254,59 @@ void FileIO::openFileForWrite(const std::string &id, const Request &, Reply &rep
         res.jsonError(Reply::internal_server_error,
                       "Could not open file for writing: " + reply.filePath_);
         reply.send(res.statusCode_, "application/json");
+        return;
     }
+    openWritePaths_[id] = fullPath.string();
+}
+
+bool FileIO::getNativeWriteFile(const std::string &id, NativeWriteFile &file) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = openWriteFiles_.find(id);
+    auto path = openWritePaths_.find(id);
+    if (it == openWriteFiles_.end() || path == openWritePaths_.end()) {
+        return false;
+    }
+    // Data written so far must be in the file before the descriptor writes
+    // after it
+    it->second.flush();
+    std::streamoff offset = it->second.tellp();
+    if (!it->second || offset < 0) {
+        return false;
+    }
+    int fd = ::open(path->second.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    auto previous = openWriteFds_.find(id);
+    if (previous != openWriteFds_.end()) {
+        ::close(previous->second);
+    }
+    openWriteFds_[id] = fd;
+    file.fd_ = fd;
+    file.offset_ = offset;
+    return true;
+}
+
+bool FileIO::preallocateWriteFile(const std::string &id, size_t size) {
+#if defined(__linux__)
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto path = openWritePaths_.find(id);
+    if (path == openWritePaths_.end()) {
+        return false;
+    }
+    int fd = ::open(path->second.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    // Keep the size, the upload may be smaller than the rest of the body
+    bool reserved = ::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size)) == 0;
+    ::close(fd);
+    return reserved;
+#else
+    (void)id;
+    (void)size;
+    return false;
+#endif
 }
 
 void FileIO::writeFile(const std::string &id,
@@ -193,6 +315,7 @@ void FileIO::writeFile(const std::string &id,
                        const char *buf,
                        size_t size,
                        bool lastData) {
+    std::lock_guard<std::mutex> lock(mutex_);
     auto it = openWriteFiles_.find(id);
     if (it == openWriteFiles_.end()) {
         std::cerr << "ERROR: writeFile() called with invalid id: " << id << std::endl;
@@ -203,11 +326,21 @@ void FileIO::writeFile(const std::string &id,
     if (lastData) {
         it->second.close();
         openWriteFiles_.erase(it);
+        openWritePaths_.erase(id);
+        auto fd = openWriteFds_.find(id);
+        if (fd != openWriteFds_.end()) {
+            ::close(fd->second);
+            openWriteFds_.erase(fd);
+        }
 
-        // Regenerate ETag for the updated file
+        // The ETag follows from the new size and modification time, only a
+        // content hash is dropped in case these did not change
         fs::path fullPath = fs::path(docRoot_) / reply.filePath_;
-        if (fs::exists(fullPath) && fs::is_regular_file(fullPath)) {
-            eTags_[fullPath.string()] = generate_etag_from_file(fullPath.string());
+        eTags_.invalidate(fullPath.string());
+        if (cache_) {
+            // Make the new content visible right away, without waiting for
+            // the watcher
+            cache_->invalidate(fullPath.string());
         }
 
         reply.send(Reply::status_type::created);
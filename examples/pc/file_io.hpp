@@ -1,13 +1,29 @@
 #pragma once
 
 #include <fstream>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <beauty/i_file_io.hpp>
 
+#include "etag_generator.hpp"
+#include "file_cache.hpp"
+
 class FileIO : public beauty::IFileIO {
    public:
-    FileIO(const std::string &docRoot);
-    virtual ~FileIO() = default;
+    // ETags are built from the file metadata, or with hashContent from a hash
+    // of the content computed on first request.
+    FileIO(const std::string &docRoot, bool hashContent = false);
+    virtual ~FileIO();
+
+    // Keep up to memoryBudget bytes of files no larger than maxFileSize in
+    // memory and serve them from there, optionally loading the files below
+    // docRoot right away.
+    void enableCache(size_t memoryBudget, size_t maxFileSize, bool warmUp = false);
+
+    // Read files on nrOfThreads threads of its own (readFileAsync), so that
+    // slow storage does not stall the connections of the server.
+    void enableAsyncReads(size_t nrOfThreads = 2);
 
     size_t openFileForRead(const std::string &id,
                            const beauty::Request &request,
@@ -16,11 +32,20 @@ class FileIO : public beauty::IFileIO {
                  const beauty::Request &request,
                  char *buf,
                  size_t maxSize) override;
+    bool readFileAsync(const std::string &id,
+                       const beauty::Request &request,
+                       char *buf,
+                       size_t maxSize,
+                       std::function<void(int)> done) override;
 
     void openFileForWrite(const std::string &id,
                           const beauty::Request &request,
                           beauty::Reply &reply) override;
     void closeReadFile(const std::string &id) override;
+    bool seekReadFile(const std::string &id, size_t offset) override;
+    bool getNativeReadFile(const std::string &id, beauty::NativeReadFile &file) override;
+    bool getNativeWriteFile(const std::string &id, beauty::NativeWriteFile &file) override;
+    bool preallocateWriteFile(const std::string &id, size_t size) override;
 
     void writeFile(const std::string &id,
                    const beauty::Request &request,
@@ -32,12 +57,33 @@ class FileIO : public beauty::IFileIO {
    private:
     const std::string docRoot_;
 
+    // Guards the maps below, as a FileIO may be shared by the workers of a
+    // ServerPool.
+    std::mutex mutex_;
+
     // As we need to handle multiple connections that reads/writes different
     // files, we keep maps to handle this.
     // Key is the id of each file, provided by Beauty.
     std::unordered_map<std::string, std::ifstream> openReadFiles_;
     std::unordered_map<std::string, std::ofstream> openWriteFiles_;
 
-    // Map of ETags for files already read, to support If-None-Match
-    std::unordered_map<std::string, std::string> eTags_;
+    // Paths of the files open for read, and the descriptors opened for
+    // sending them with sendfile().
+    std::unordered_map<std::string, std::string> openReadPaths_;
+    std::unordered_map<std::string, int> openReadFds_;
+
+    // Paths of the files open for write, and the descriptors opened for
+    // receiving uploads with splice().
+    std::unordered_map<std::string, std::string> openWritePaths_;
+    std::unordered_map<std::string, int> openWriteFds_;
+
+    // ETags of the files, to support If-None-Match
+    ETagGenerator eTags_;
+
+    // Hot files kept in memory, if enabled.
+    std::unique_ptr<FileCache> cache_;
+
+    // Threads reading files for readFileAsync, if enabled. Last, as reads in
+    // progress use the members above.
+    std::unique_ptr<asio::thread_pool> readPool_;
 };
@@ -10,6 +10,7 @@
 #include "my_router_api.hpp"
 #include "my_data_streaming_endpoint.hpp"
 #include "my_chat_endpoint.hpp"
+#include "zlib_compressor.hpp"
 
 using namespace std::literals::chrono_literals;
 using namespace beauty;
@@ -37,8 +38,14 @@ int main(int argc, char *argv[]) {
 
         // Set up file I/O for static file serving
         FileIO fileIO(argv[3]);
+        // Keep small, hot files (e.g. the web UI) in memory
+        fileIO.enableCache(4 * 1024 * 1024, 256 * 1024, true);
         s.setFileIO(&fileIO);
 
+        // Compress text based replies for clients accepting gzip/deflate
+        ZlibCompressorFactory compressorFactory;
+        s.setCompressorFactory(&compressorFactory);
+
         // Set up a custom Expect: 100-continue handler for authentication,
         // useful for large uploads where you want to reject requests before
         // reading the body.
@@ -136,6 +143,7 @@ int main(int argc, char *argv[]) {
         std::cout << "\n";
         std::cout << "Features Demonstrated:\n";
         std::cout << "  • Static file serving with ETag and Cache-Control\n";
+        std::cout << "  • gzip/deflate compression of text based replies\n";
         std::cout << "  • Multipart file uploads with progress tracking\n";
         std::cout << "  • RESTful API routing with parameter extraction and CORS support\n";
         std::cout << "  • Expect: 100-continue with authentication check\n";
@@ -0,0 +1,61 @@
+#include "zlib_compressor.hpp"
+
+ZlibCompressorFactory::ZlibCompressorFactory(int level, int windowBits, int memLevel)
+    : level_(level), windowBits_(windowBits), memLevel_(memLevel) {}
+
+std::unique_ptr<beauty::ICompressor> ZlibCompressorFactory::create(const std::string &coding) {
+    if (coding != "gzip" && coding != "deflate") {
+        return nullptr;
+    }
+    auto *compressor = new ZlibCompressor(coding == "gzip", level_, windowBits_, memLevel_);
+    std::unique_ptr<beauty::ICompressor> result(compressor);
+    if (!compressor->isValid()) {
+        return nullptr;
+    }
+    return result;
+}
+
+ZlibCompressor::ZlibCompressor(bool gzip, int level, int windowBits, int memLevel) : stream_() {
+    // windowBits + 16 selects the gzip format
+    valid_ = deflateInit2(&stream_,
+                          level,
+                          Z_DEFLATED,
+                          gzip ? windowBits + 16 : windowBits,
+                          memLevel,
+                          Z_DEFAULT_STRATEGY) == Z_OK;
+}
+
+ZlibCompressor::~ZlibCompressor() {
+    if (valid_) {
+        deflateEnd(&stream_);
+    }
+}
+
+bool ZlibCompressor::isValid() const {
+    return valid_;
+}
+
+bool ZlibCompressor::compress(const char *in, size_t size, std::vector<char> &out, bool finish) {
+    if (!valid_) {
+        return false;
+    }
+    stream_.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in));
+    stream_.avail_in = static_cast<uInt>(size);
+    const int flush = finish ? Z_FINISH : Z_SYNC_FLUSH;
+    for (;;) {
+        // Room for all of the input, grown below if not enough
+        const size_t offset = out.size();
+        const size_t avail = deflateBound(&stream_, stream_.avail_in) + 16;
+        out.resize(offset + avail);
+        stream_.next_out = reinterpret_cast<Bytef *>(out.data() + offset);
+        stream_.avail_out = static_cast<uInt>(avail);
+        int ret = deflate(&stream_, flush);
+        out.resize(out.size() - stream_.avail_out);
+        if (ret == Z_STREAM_ERROR) {
+            return false;
+        }
+        if (finish ? ret == Z_STREAM_END : stream_.avail_out > 0) {
+            return true;
+        }
+    }
+}
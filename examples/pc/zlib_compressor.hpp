@@ -0,0 +1,40 @@
+#pragma once
+
+#include <zlib.h>
+#include <beauty/i_compressor.hpp>
+
+// gzip/deflate compression of replies with zlib.
+//
+// The memory of each compressor (i.e. per connection writing a compressed
+// reply) is about (1 << (windowBits + 2)) + (1 << (memLevel + 9)) bytes, 256
+// KiB with zlib's defaults. Lower windowBits and memLevel to bound it on
+// memory constrained targets, at some cost of compression ratio.
+class ZlibCompressorFactory : public beauty::ICompressorFactory {
+   public:
+    ZlibCompressorFactory(int level = Z_DEFAULT_COMPRESSION, int windowBits = 15, int memLevel = 8);
+
+    std::unique_ptr<beauty::ICompressor> create(const std::string &coding) override;
+
+   private:
+    const int level_;
+    const int windowBits_;
+    const int memLevel_;
+};
+
+class ZlibCompressor : public beauty::ICompressor {
+   public:
+    // gzip: gzip format, zlib format ("deflate" coding) otherwise.
+    ZlibCompressor(bool gzip, int level, int windowBits, int memLevel);
+    ~ZlibCompressor();
+
+    ZlibCompressor(const ZlibCompressor &) = delete;
+    ZlibCompressor &operator=(const ZlibCompressor &) = delete;
+
+    bool isValid() const;
+
+    bool compress(const char *in, size_t size, std::vector<char> &out, bool finish) override;
+
+   private:
+    z_stream stream_;
+    bool valid_;
+};
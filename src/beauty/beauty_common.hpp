@@ -14,12 +14,12 @@ using handlerCallback = std::function<void(const Request &req, Reply &rep)>;
 using debugMsgCallback = std::function<void(const std::string &msg)>;
 
 struct Settings {
-    Settings(std::chrono::seconds keepAliveTimeout = std::chrono::seconds(5),
+    Settings(std::chrono::milliseconds keepAliveTimeout = std::chrono::seconds(5),
              size_t keepAliveMax = 100,
              size_t connectionLimit = 0,
-             std::chrono::seconds wsReceiveTimeout = std::chrono::seconds(300),
-             std::chrono::seconds wsPingInterval = std::chrono::seconds(100),
-             std::chrono::seconds wsPongTimeout = std::chrono::seconds(5))
+             std::chrono::milliseconds wsReceiveTimeout = std::chrono::seconds(300),
+             std::chrono::milliseconds wsPingInterval = std::chrono::seconds(100),
+             std::chrono::milliseconds wsPongTimeout = std::chrono::seconds(5))
         : keepAliveTimeout_(keepAliveTimeout),
           keepAliveMax_(keepAliveMax),
           connectionLimit_(connectionLimit),
@@ -27,9 +27,10 @@ struct Settings {
           wsPingInterval_(wsPingInterval),
           wsPongTimeout_(wsPongTimeout) {}
 
-    // Keep-Alive timeout for inactive connections. Sent in Keep-Alive response header.
+    // Keep-Alive timeout for inactive connections. Sent in Keep-Alive response header
+    // (rounded up to whole seconds).
     // 0s = Keep-Alive disabled.
-    std::chrono::seconds keepAliveTimeout_;
+    std::chrono::milliseconds keepAliveTimeout_;
 
     // Max number of request that can be processed on the connection before it is closed.
     // Sent in Keep-Alive response header.
@@ -43,16 +44,101 @@ struct Settings {
 
     // Maximum duration to keep a WebSocket connection open without receiving
     // any data (excluding pong responses) from the client. 0s = no timeout.
-    std::chrono::seconds wsReceiveTimeout_;
+    std::chrono::milliseconds wsReceiveTimeout_;
 
     // Interval for sending ping frames to verify client responsiveness.
     // Should be significantly less than timeout_ (typically timeout_/3).
     // 0s = disable automatic ping (client activity only).
-    std::chrono::seconds wsPingInterval_;
+    std::chrono::milliseconds wsPingInterval_;
 
     // How long to wait for pong response after sending ping.
     // If no pong received within this time, connection is closed.
-    std::chrono::seconds wsPongTimeout_;
+    std::chrono::milliseconds wsPongTimeout_;
+
+    // Granularity of the connection timeouts above. Also the update interval
+    // of the cached clock used to timestamp connection activity. Timeouts
+    // never expire early, and up to two resolutions late.
+    std::chrono::milliseconds timerResolution_ = std::chrono::milliseconds(100);
+
+    // Max number of idle connection buffers kept by the Server's buffer pool.
+    // Connections only borrow buffers while reading or writing, so this bounds
+    // the memory held for idle connections (2 buffers of maxContentSize each
+    // per active connection).
+    size_t bufferPoolSize_ = 32;
+
+    // Let idle connections (between keep-alive requests and between WebSocket
+    // frames) wait for the socket to become readable without holding a receive
+    // buffer. The buffer is borrowed from the pool once data has arrived, which
+    // brings the memory of a parked connection down to the Connection object
+    // itself, at the cost of one extra reactor wake-up per read.
+    bool waitReadableWhenIdle_ = false;
+
+    // Only keep the request line and headers as views (Request::getHeaderView
+    // etc.) instead of also copying each header into Request::headers_.
+    // Request::getHeaderValue still works, but handlers iterating headers_
+    // will find it empty.
+    bool headerViewsOnly_ = false;
+
+    // Send a Date header in replies. Rendered at most once per second, and
+    // never while the system clock is not set (e.g. ESP32 without SNTP).
+    bool sendDateHeader_ = false;
+
+    // Serve precompressed siblings of static files (<file>.br, <file>.gz) to
+    // clients accepting the encoding, for text based content (html, css, js,
+    // json, svg etc.). Costs a failed file open per encoding the client
+    // accepts for files without siblings.
+    bool servePrecompressed_ = false;
+
+    // Replies with a Content-Length below this are sent uncompressed when a
+    // compressor factory is set (Server::setCompressorFactory), as the saving
+    // does not pay for the compression and the extra headers.
+    size_t compressMinSize_ = 1024;
+
+    // Disable Nagle's algorithm (TCP_NODELAY) on accepted connections. Small
+    // replies go out in one write anyway, but the last part of a reply written
+    // in several parts may otherwise wait for the client's delayed ACK.
+    bool tcpNoDelay_ = false;
+
+    // Cork the socket (TCP_CORK, Linux only) while a reply is written in
+    // several parts, so that only full segments are sent until the reply is
+    // complete.
+    bool tcpCork_ = false;
+
+    // Number of maxContentSize parts of a reply written in several parts
+    // (sendBig, sendStreaming, files) that are produced and then written with
+    // a single vectored write. Cuts the writes and completion handlers per
+    // reply by this factor, at the cost of as many send buffers per
+    // connection writing such a reply. Not used for compressed replies and
+    // files read asynchronously.
+    size_t sendWindowParts_ = 1;
+
+    // Largest chunk accepted in request bodies sent with Transfer-Encoding:
+    // chunked, larger ones are answered with 413. Chunked bodies are decoded
+    // as they arrive, so this does not add to the memory per connection.
+    size_t maxChunkSize_ = 1024 * 1024;
+
+    // Write the bodies of PUT and POST requests with Content-Type
+    // application/octet-stream, not taken by a request handler, to the file
+    // at the request path through the FileIO (RequestHandler::isRawUpload).
+    // Off by default, as it lets clients overwrite any file the FileIO can
+    // open for write, e.g. in the document root.
+    bool rawUploads_ = false;
+
+    // Write multipart uploads in blocks of this size with IFileIO::writeFile,
+    // rather than a write per read (0). Received data is collected in a
+    // buffer of this size per uploading connection, so that files are written
+    // in whole blocks at multiples of the block size, the rest when the part
+    // ends. Fewer and aligned writes spare flash and file systems.
+    size_t uploadBlockSize_ = 0;
+
+    // Let the FileIO reserve the space of multipart uploads as they are
+    // opened (IFileIO::preallocateWriteFile), bounded by the Content-Length.
+    bool preallocateUploads_ = false;
+
+    // Set SO_REUSEPORT on the listening socket (where supported), allowing
+    // several acceptors, e.g. one per ServerPool worker, to share a port.
+    // Only used by the advanced Server constructor.
+    bool reusePort_ = false;
 };
 
 }  // namespace beauty
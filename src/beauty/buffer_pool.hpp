@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <unordered_set>
+#include <vector>
+
+namespace beauty {
+
+// Pool of equally sized buffers shared by the connections of a Server.
+//
+// Connections borrow their receive and send buffers only while a read or
+// write is in flight, and return them when idle. Buffers are moved in and out
+// of the connection's own vectors by swapping, so references to those vectors
+// (held by e.g. Request and Reply) stay valid.
+//
+// Not thread-safe, each Server (i.e. io_context) has its own pool.
+class BufferPool {
+   public:
+    BufferPool(const BufferPool &) = delete;
+    BufferPool &operator=(const BufferPool &) = delete;
+
+    struct Stats {
+        // Buffers taken from the pool.
+        size_t hits_ = 0;
+        // Buffers allocated as the pool was empty.
+        size_t misses_ = 0;
+        // Returned buffers freed as the pool was full, or as they had grown
+        // to twice the buffer size or more.
+        size_t discarded_ = 0;
+        // Buffers currently borrowed with acquire.
+        size_t inUse_ = 0;
+        // Buffers currently kept in the pool.
+        size_t pooled_ = 0;
+    };
+
+    // bufferSize: capacity of each buffer.
+    // maxPooled: max number of idle buffers kept in the pool, returned buffers
+    // beyond this are freed.
+    BufferPool(size_t bufferSize, size_t maxPooled);
+    ~BufferPool() = default;
+
+    // Give buf a capacity of at least bufferSize, reusing a pooled buffer if
+    // available. Does nothing if buf already holds a buffer.
+    void acquire(std::vector<char> &buf);
+
+    // Return the storage of buf to the pool, leaving buf empty without
+    // capacity. Does nothing if buf does not hold a buffer. Buffers that have
+    // grown to twice the buffer size or more, e.g. the content of a large
+    // reply, are freed rather than kept.
+    void release(std::vector<char> &buf);
+
+    size_t getBufferSize() const;
+    Stats getStats() const;
+
+   private:
+    const size_t bufferSize_;
+    const size_t maxPooled_;
+    std::vector<std::vector<char>> pool_;
+    // The vectors holding a borrowed buffer, so that only these are counted
+    // as in use.
+    std::unordered_set<const std::vector<char> *> lent_;
+    Stats stats_;
+};
+
+}  // namespace beauty
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stddef.h>
+
+namespace beauty {
+
+// Find the end of a request token without running the parser state machine
+// for each byte. Each function returns the index of the first byte in
+// [data, data + size) that is not part of the token, or size if all are.
+// SSE2/AVX2 is used where the compiler targets it (unless BEAUTY_NO_SIMD is
+// defined), a table driven scalar loop otherwise, e.g. on ESP32.
+
+// Method and header name: HTTP token characters.
+size_t scanToken(const char *data, size_t size);
+
+// Request URI: anything but space and control characters.
+size_t scanUri(const char *data, size_t size);
+
+// Header value: anything but control characters.
+size_t scanFieldValue(const char *data, size_t size);
+
+// The scalar implementations of the above.
+size_t scanTokenScalar(const char *data, size_t size);
+size_t scanUriScalar(const char *data, size_t size);
+size_t scanFieldValueScalar(const char *data, size_t size);
+
+}  // namespace beauty
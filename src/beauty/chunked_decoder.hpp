@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+
+namespace beauty {
+
+// Incremental decoder of request bodies sent with Transfer-Encoding: chunked.
+// The data is decoded in place as it arrives, i.e. the chunk data is moved
+// over the chunk framing, so no buffer besides the receive buffer is needed.
+// Chunk extensions and trailers are skipped.
+class ChunkedDecoder {
+   public:
+    ChunkedDecoder();
+
+    // Reset to initial decoder state.
+    void reset();
+
+    // Chunks larger than this are rejected with chunk_too_large.
+    void setMaxChunkSize(size_t maxChunkSize);
+
+    // Result of decode.
+    enum result_type { done, bad, chunk_too_large, indeterminate };
+
+    // Decode the size bytes at data. The chunk data found is moved to the
+    // front of data and its size returned in bodySize. The enum return value
+    // is done after the last chunk and the trailers, with consumed set to the
+    // bytes of data used (any bytes following belong to the next request),
+    // indeterminate when more data is required.
+    result_type decode(char *data, size_t size, size_t &bodySize, size_t &consumed);
+
+   private:
+    // The current state of the decoder.
+    enum state {
+        chunk_size_start,
+        chunk_size,
+        chunk_extension,
+        chunk_size_newline,
+        chunk_data,
+        chunk_data_cr,
+        chunk_data_newline,
+        trailer_line_start,
+        trailer_line,
+        trailer_newline,
+        last_newline,
+    } state_;
+
+    size_t maxChunkSize_;
+
+    // Bytes of the current chunk not yet decoded, its size so far while the
+    // size line is decoded.
+    size_t chunkSize_ = 0;
+
+    // Bytes of the current size line or of the trailers.
+    size_t lineLength_ = 0;
+};
+
+}  // namespace beauty
@@ -6,6 +6,7 @@
 #include <vector>
 #include <memory>
 
+#include "beauty/buffer_pool.hpp"
 #include "beauty/reply.hpp"
 #include "beauty/request.hpp"
 #include "beauty/request_decoder.hpp"
@@ -16,6 +17,7 @@
 #include "beauty/i_ws_receiver.hpp"
 #include "beauty/ws_types.hpp"
 #include "beauty/ws_encoder.hpp"
+#include "beauty/timing_wheel.hpp"
 
 namespace beauty {
 
@@ -33,11 +35,20 @@ class Connection : public std::enable_shared_from_this<Connection> {
                         ConnectionManager &manager,
                         RequestHandler &handler,
                         unsigned connectionId,
-                        size_t maxContentSize);
-    ~Connection() = default;
+                        size_t maxContentSize,
+                        std::shared_ptr<BufferPool> bufferPool);
+    ~Connection();
 
     // Start the first asynchronous operation for the connection.
-    void start(bool useKeepAlive, std::chrono::seconds keepAliveTimeout, size_t keepAliveMax);
+    void start(bool useKeepAlive,
+               std::chrono::milliseconds keepAliveTimeout,
+               size_t keepAliveMax,
+               bool waitReadableWhenIdle = false,
+               bool headerViewsOnly = false,
+               bool tcpNoDelay = false,
+               bool tcpCork = false,
+               size_t sendWindowParts = 1,
+               size_t maxChunkSize = 1024 * 1024);
 
     // Stop all asynchronous operations associated with the connection.
     void stop();
@@ -52,6 +63,7 @@ class Connection : public std::enable_shared_from_this<Connection> {
     bool isWebSocket() const;
     unsigned getConnectionId() const;
     WsEndpoint *getWsEndpoint() const;
+    TimingWheel<Connection>::Entry &getTimerEntry();
     void sendWsPing();
 
     // WebSocket write state query
@@ -66,14 +78,64 @@ class Connection : public std::enable_shared_from_this<Connection> {
    private:
     // Perform an asynchronous read operation.
     void doRead();
+    // Read the next request or WebSocket frame when nothing is pending, waiting
+    // for the socket to become readable first if configured.
+    void doReadIdle();
+    void doWaitReadable();
     void doReadBody();
     void doReadBodyAfter100Continue();
+    // Read the rest of a body that is neither multipart nor streamed,
+    // collecting it (de-chunked) in recvBuffer_ up to maxContentSize_, then
+    // handle the request.
+    void doCollectBody();
+    // Whether the body is collected by doCollectBody, rather than handled in
+    // parts as for multipart requests and raw uploads too large to collect.
+    bool isCollectedBody() const;
+    // De-chunk the body data in recvBuffer_ from offset on, setting complete
+    // after the last chunk. Returns false after replying with an error if the
+    // chunks are invalid or too large.
+    bool dechunkBody(size_t offset, bool &complete);
+    // Move the rest of a raw upload from the socket to its file with
+    // splice(), if the FileIO provides the file (IFileIO::getNativeWriteFile).
+    // Returns false if the body must be read instead.
+    bool startSpliceBody();
+    void doSpliceBody();
+    void closeSplicePipe();
+
+    // Parse and handle received request data.
+    void handleRequestData();
+    // Handle a request pipelined after the one just answered.
+    void handlePipelinedRequest();
 
     // Perform an asynchronous write operation.
     void doWriteHeaders();
     void doWriteReplyContent();
+    void handleReplyContentWritten();
+    // Read the next part of a file reply into readAheadBuffer_ while the
+    // current part is written, if the FileIO reads asynchronously.
+    void startReadAhead();
+    void handleReadAhead(int nrReadBytes);
+    // Write the part read ahead, and read the one after it.
+    void writeReadAhead();
+    // Add the content of the reply to buffers, first producing more parts of
+    // it into sendWindow_ if it is written in several parts.
+    void fillSendWindow(std::vector<asio::const_buffer> &buffers);
+    // Send the rest of the reply from reply_.nativeFile_ with sendfile().
+    void doSendFile();
     void doWrite100Continue();
 
+    // Append the reply to coalesceBuffer_ instead of writing it, if another
+    // pipelined request is waiting. Returns false if the reply must be written.
+    bool coalesceReply();
+    // Write the coalesced replies, then continue with next.
+    void doWriteCoalesced(void (Connection::*next)());
+
+    // Render the reply headers, including the connection and date headers,
+    // to out.
+    void renderReplyHeaders(std::vector<char> &out);
+    // Add the prebuilt stock reply, and the date header if any, to buffers.
+    void stockReplyToBuffers(std::vector<asio::const_buffer> &buffers);
+
     void handleConnection();
     void handleWriteCompleted();
 
@@ -81,6 +143,9 @@ class Connection : public std::enable_shared_from_this<Connection> {
     void doAckWsUpgrade();
     void doWriteWsFrame(bool continueReading = false, WriteCompleteCallback callback = nullptr);
 
+    // Cork/uncork the socket, if enabled.
+    void setCork(bool cork);
+
     void shutdown();
 
     // Socket for the connection.
@@ -95,15 +160,49 @@ class Connection : public std::enable_shared_from_this<Connection> {
     // The unique id for the connection.
     unsigned connectionId_;
 
+    // The connection id as passed to the WebSocket endpoint.
+    const std::string connectionIdStr_;
+
     // The max buffer size when reading/writing socket.
     size_t maxContentSize_;
 
+    // Pool to borrow the buffers below from while reading/writing.
+    std::shared_ptr<BufferPool> bufferPool_;
+
     // Buffer for incoming data. HTTP requests + WebSocket incoming frames
     std::vector<char> recvBuffer_;
 
     // Buffer for outgoing data. HTTP responses + WebSocket outgoing frames
     std::vector<char> sendBuffer_;
 
+    // The rendered reply headers. Small and kept between replies (except
+    // when waiting readable while idle), so not borrowed from the pool.
+    std::vector<char> headerBuffer_;
+
+    // Received data following the request being handled, i.e. pipelined
+    // requests. Empty unless the client pipelines.
+    std::vector<char> pipelineBuffer_;
+
+    // Replies to pipelined requests not yet written, sent together with the
+    // next reply.
+    std::vector<char> coalesceBuffer_;
+
+    // The next part of a file reply, read while sendBuffer_ is written. The
+    // two are swapped when both are done, see startReadAhead.
+    std::vector<char> readAheadBuffer_;
+    int readAheadBytes_ = 0;
+    bool readAheadPending_ = false;
+    bool readAheadDone_ = false;
+    // The current part has been written before the next one was read.
+    bool waitingForReadAhead_ = false;
+
+    // Parts of a reply preceding the one in sendBuffer_, written with it.
+    std::vector<std::vector<char>> sendWindow_;
+
+    // The file a raw upload is spliced to, and the pipe it passes through.
+    NativeWriteFile spliceFile_;
+    int splicePipe_[2] = {-1, -1};
+
     // The incoming request.
     Request request_;
 
@@ -131,6 +230,9 @@ class Connection : public std::enable_shared_from_this<Connection> {
     // Last received pong timestamp.
     std::chrono::steady_clock::time_point lastPongTime_;
 
+    // Next timeout of the connection, owned by the ConnectionManager.
+    TimingWheel<Connection>::Entry timerEntry_;
+
     // The WebSocket endpoint for this connection (set during upgrade).
     WsEndpoint *wsEndpoint_ = nullptr;
 
@@ -140,8 +242,8 @@ class Connection : public std::enable_shared_from_this<Connection> {
     // The parser for the incoming web socket data.
     WsParser wsParser_;
 
-    // Number of seconds to keep connection open during inactivity.
-    std::chrono::seconds keepAliveTimeout_;
+    // Time to keep connection open during inactivity.
+    std::chrono::milliseconds keepAliveTimeout_;
 
     // Support keep-alive or not.
     bool useKeepAlive_ = false;
@@ -152,14 +254,25 @@ class Connection : public std::enable_shared_from_this<Connection> {
     // Request counter
     size_t nrOfRequest_ = 0;
 
+    // Release the receive buffer while waiting for the next request/frame.
+    bool waitReadableWhenIdle_ = false;
+
     bool closeConnection_ = false;
 
+    // Cork the socket while writing replies in several parts.
+    bool useCork_ = false;
+    bool corked_ = false;
+
+    // Pre-rendered Connection (and Keep-Alive) header lines of the reply.
+    StringView connectionHeaders_;
+
     bool firstBodyReadAfter100Continue_ = true;
 
     bool isWebSocket_ = false;
 
     // WebSocket write state tracking
     bool writeInProgress_ = false;
+    size_t wsWritesInFlight_ = 0;
     WriteCompleteCallback writeCallback_;
 };
 
@@ -1,12 +1,15 @@
 #pragma once
 
 #include <chrono>
+#include <ctime>
 #include <set>
 #include <unordered_map>
 #include <memory>
 
 #include "beauty/connection.hpp"
 #include "beauty/i_ws_sender.hpp"
+#include "beauty/string_view.hpp"
+#include "beauty/timing_wheel.hpp"
 #include "beauty/ws_types.hpp"
 
 namespace beauty {
@@ -33,9 +36,29 @@ class ConnectionManager : public IWsSender {
     // Stop all connections.
     void stopAll();
 
-    // Handle connections periodically.
+    // Handle connections periodically, expires connection timeouts and
+    // updates the cached clock.
     void tick();
 
+    // Reschedule the timeouts of a connection.
+    void updateTimeouts(Connection& c);
+
+    // Register a connection that has been upgraded to WebSocket.
+    void addWsConnection(Connection& c);
+
+    // Cached clock, updated each tick. Cheaper than steady_clock::now() and
+    // accurate enough for activity timestamps.
+    std::chrono::steady_clock::time_point now() const;
+
+    // "Connection: keep-alive" and "Keep-Alive: timeout=.., max=.." header
+    // lines, rendered once from the settings.
+    StringView getKeepAliveHeaders() const;
+
+    // "Date: .." header line, rendered at most once per second. Empty unless
+    // Settings::sendDateHeader_, or if the system clock has not been set, as
+    // a server without a reasonable clock must not send Date (RFC 9110).
+    StringView getDateHeader();
+
     // Handler for debug messages.
     void setDebugMsgHandler(const debugMsgCallback& cb);
 
@@ -60,17 +83,47 @@ class ConnectionManager : public IWsSender {
     std::vector<std::string> getActiveWsConnectionsForEndpoint(
         const IWsReceiver* endpoint) const override;
     bool isWriteInProgress(const std::string& connectionId) const override;
+    WriteResult sendWsText(WsConnectionHandle handle,
+                           const std::string& message,
+                           WriteCompleteCallback callback) override;
+    WriteResult sendWsBinary(WsConnectionHandle handle,
+                             const std::vector<char>& data,
+                             WriteCompleteCallback callback) override;
+    WriteResult sendWsClose(WsConnectionHandle handle,
+                            uint16_t statusCode = 1000,
+                            const std::string& reason = "",
+                            WriteCompleteCallback callback = nullptr) override;
+    std::vector<WsConnectionHandle> getActiveWsHandlesForEndpoint(
+        const IWsReceiver* endpoint) const override;
+    bool isWriteInProgress(WsConnectionHandle handle) const override;
 
    private:
+    void handleTimeouts(Connection& c);
+    Connection* findWsConnection(WsConnectionHandle handle) const;
+
     // The managed connections.
     std::set<std::shared_ptr<Connection>> connections_;
 
+    // The WebSocket connections, indexed by connection id.
+    std::unordered_map<unsigned, Connection*> wsConnections_;
+
     // WebSocket endpoint mapping (path -> endpoint)
     std::unordered_map<std::string, WsEndpoint*> pathToEndpoint_;
 
     // Settings for connections.
     const Settings& settings_;
 
+    // Time of the last tick.
+    std::chrono::steady_clock::time_point now_;
+
+    // Rendered header lines, see getKeepAliveHeaders and getDateHeader.
+    std::string keepAliveHeaders_;
+    std::string dateHeader_;
+    std::time_t dateHeaderTime_ = 0;
+
+    // Next timeout of each connection.
+    TimingWheel<Connection> timers_;
+
     // Callback to handle debug messages.
     debugMsgCallback debugMsgCb_;
 };
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace beauty {
+
+// Compresses the content of one reply, fed in chunks as it is written.
+class ICompressor {
+   public:
+    virtual ~ICompressor() = default;
+
+    // Compress size bytes from in and append the result to out. The result is
+    // sent right away, so all input should be flushed (e.g. zlib's
+    // Z_SYNC_FLUSH). With finish, the end of the compressed stream is appended
+    // as well. Return false on failure.
+    virtual bool compress(const char *in, size_t size, std::vector<char> &out, bool finish) = 0;
+};
+
+// This interface allows platform-specific compression libraries (zlib,
+// miniz etc.) to be used for dynamic replies, see Server::setCompressorFactory.
+// A compressor is created per reply to compress and destroyed when the reply
+// has been written, so at most one per connection is alive. Shared by the
+// workers of a ServerPool, i.e. create may be called from several threads.
+class ICompressorFactory {
+   public:
+    virtual ~ICompressorFactory() = default;
+
+    // Return a compressor for the content coding ("gzip" or "deflate"), or
+    // nullptr if not supported.
+    virtual std::unique_ptr<ICompressor> create(const std::string &coding) = 0;
+};
+
+}  // namespace beauty
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <functional>
 #include <string>
 
 #include "beauty/reply.hpp"
@@ -19,6 +20,36 @@ class IFileIO {
                          size_t maxSize) = 0;
     virtual void closeReadFile(const std::string& id) = 0;
 
+    // Optional: provide a native file descriptor, offset and length of the
+    // file opened by openFileForRead. Files larger than one buffer are then
+    // sent with sendfile() (Linux) instead of being read with readFile. The
+    // file is still closed through closeReadFile. Return false to always use
+    // readFile.
+    virtual bool getNativeReadFile(const std::string&, NativeReadFile&) {
+        return false;
+    }
+
+    // Optional: read as readFile without blocking the caller, e.g. on a thread
+    // pool, and call done with the result from any thread. The next part of a
+    // file larger than one buffer is then read while the current part is
+    // written. At most one read per id is pending, and closeReadFile is not
+    // called for the id until done has been called. Return false (without
+    // calling done) to always use readFile.
+    virtual bool readFileAsync(const std::string&,
+                               const Request&,
+                               char*,
+                               size_t,
+                               std::function<void(int)>) {
+        return false;
+    }
+
+    // Optional: move the read position of the file opened by openFileForRead
+    // to offset, to answer Range requests with the requested parts only.
+    // Return false to always send the whole file.
+    virtual bool seekReadFile(const std::string&, size_t) {
+        return false;
+    }
+
     virtual void openFileForWrite(const std::string& id, const Request& request, Reply& reply) = 0;
     virtual void writeFile(const std::string& id,
                            const Request& request,
@@ -26,6 +57,25 @@ class IFileIO {
                            const char* buf,
                            size_t size,
                            bool lastData) = 0;
+
+    // Optional: provide a native file descriptor of the file opened by
+    // openFileForWrite, and the offset to write the next data at. The rest of
+    // a raw upload with a Content-Length is then moved from the socket to the
+    // file with splice() (Linux), without being copied through Beauty's
+    // buffers, after which writeFile is called once with no data and
+    // lastData set. Return false to always use writeFile.
+    virtual bool getNativeWriteFile(const std::string&, NativeWriteFile&) {
+        return false;
+    }
+
+    // Optional: reserve space for the multipart upload opened by
+    // openFileForWrite, e.g. with fallocate(), so that the file does not get
+    // fragmented as it grows. Only called with Settings::preallocateUploads_.
+    // size is the rest of the request body, which bounds the file: the size
+    // of the file must not change. Return false if not supported.
+    virtual bool preallocateWriteFile(const std::string&, size_t) {
+        return false;
+    }
 };
 
 }  // namespace beauty
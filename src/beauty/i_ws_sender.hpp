@@ -61,6 +61,21 @@ class IWsSender {
     // connectionId: The connection ID to check
     // returns: true if write is in progress, false otherwise (or if connection not found)
     virtual bool isWriteInProgress(const std::string& connectionId) const = 0;
+
+    // Numeric handle variants of the methods above, see WsConnectionHandle.
+    virtual WriteResult sendWsText(WsConnectionHandle handle,
+                                   const std::string& message,
+                                   WriteCompleteCallback callback) = 0;
+    virtual WriteResult sendWsBinary(WsConnectionHandle handle,
+                                     const std::vector<char>& data,
+                                     WriteCompleteCallback callback) = 0;
+    virtual WriteResult sendWsClose(WsConnectionHandle handle,
+                                    uint16_t statusCode = 1000,
+                                    const std::string& reason = "",
+                                    WriteCompleteCallback callback = nullptr) = 0;
+    virtual std::vector<WsConnectionHandle> getActiveWsHandlesForEndpoint(
+        const IWsReceiver* endpoint) const = 0;
+    virtual bool isWriteInProgress(WsConnectionHandle handle) const = 0;
 };
 
 }  // namespace beauty
\ No newline at end of file
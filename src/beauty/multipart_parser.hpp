@@ -1,11 +1,11 @@
 #pragma once
 
-#include <deque>
 #include <string>
 #include <vector>
 
 #include "beauty/header.hpp"
 #include "beauty/request.hpp"
+#include "beauty/string_view.hpp"
 
 namespace beauty {
 
@@ -14,19 +14,25 @@ struct Request;
 // Parser for incoming requests.
 class MultiPartParser {
    public:
-    MultiPartParser(std::vector<char> &lastBuffer);
+    MultiPartParser();
 
     // Reset to initial parser state.
     void reset();
 
     // Result of parse.
-    enum result_type { done, bad, indeterminate };
+    enum result_type { done, bad, indeterminate, parts_full };
 
+    // Max number of parts found by one call of parse.
+    static const size_t maxParts = 8;
+
+    // A file part found in the parsed content: its start (foundStart_, with
+    // the filename), a slice of its data and/or its end (foundEnd_). The data
+    // is in the parsed content, or in the parser for bytes held back as they
+    // might have been the start of a boundary.
     struct ContentPart {
-        std::string filename_;
-        std::vector<char>::iterator start_;
-        std::vector<char>::iterator end_;
-        bool headerOnly_ = false;
+        StringView filename_;
+        const char *start_ = nullptr;
+        const char *end_ = nullptr;
         bool foundStart_ = false;
         bool foundEnd_ = false;
     };
@@ -36,20 +42,33 @@ class MultiPartParser {
 
     static bool isMultipartRequest(const Request &req);
 
-    // Parse multipart content. The enum return value is done when all parts
-    // has been parsed, bad if the data is invalid, indeterminate when more
-    // data is required.
-    // The caller must inspect readyParts to see if any parts has been
-    // completed.
-    result_type parse(std::vector<char> &content, std::deque<ContentPart> &parts);
-
-    void flush(std::vector<char> &content, std::deque<ContentPart> &parts);
+    // Parse the size bytes of multipart content at data, setting consumed to
+    // the bytes parsed. The enum return value is done when all parts has been
+    // parsed, bad if the data is invalid, indeterminate when more data is
+    // required, parts_full when maxParts parts have been found before the
+    // end of the data, which is then to be parsed by another call.
+    // The caller must inspect the parts found (getPart), valid until the
+    // next call. Nothing is allocated per call.
+    result_type parse(const char *data, size_t size, size_t &consumed);
 
-    const std::deque<ContentPart> &peakLastPart() const;
+    size_t getNoParts() const;
+    const ContentPart &getPart(size_t i) const;
 
    private:
     // Handle the next character of input.
-    result_type consume(std::vector<char>::iterator inputPtr, std::deque<ContentPart> &parts);
+    result_type consume(const char *inputPtr);
+
+    // Add a part for the data [start, end).
+    ContentPart &addPart(const char *start, const char *end);
+
+    // Continue the data of the part of the previous call, with a boundary
+    // possibly started at its end.
+    void continuePartData(const char *data, size_t size, size_t &pos);
+
+    // Skip part data up to the next boundary, without running consume() for
+    // each byte (Boyer-Moore-Horspool). A possible start of a boundary at
+    // the end of data is held back.
+    void skipPartData(const char *data, size_t size, size_t &pos);
 
     // The current state of the parser.
     enum state {
@@ -64,19 +83,29 @@ class MultiPartParser {
         header_value,
         expecting_newline_2,
         expecting_newline_3,
-        part_data_start,
         part_data_cont,
-        expecting_hyphen_3,
-        boundary_next,
         boundary_close,
     } state_;
 
-    std::vector<Header> headers_;
-    std::vector<char> &lastBuffer_;
-    std::deque<ContentPart> lastParts_;
+    // The part header being parsed, and the filename of the part.
+    Header header_;
+    std::string filename_;
+
+    // The parts found by the last call, and their filenames. Reused, so that
+    // their capacity is kept.
+    ContentPart parts_[maxParts];
+    std::string filenames_[maxParts];
+    size_t noParts_ = 0;
 
-    size_t boundaryCount_;
+    // Bytes of delimiter_ at the end of the previous content, i.e. of a
+    // boundary that may continue in the next.
+    size_t boundaryCount_ = 0;
     std::string boundaryStr_;
+
+    // CRLF "--" followed by boundaryStr_, searched for in part data, and the
+    // Horspool shifts for each byte at the end of the search window.
+    std::string delimiter_;
+    unsigned char skip_[256];
 };
 
 }  // namespace beauty
@@ -5,10 +5,13 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include <memory>
 
 #include "beauty/request.hpp"
 #include "beauty/header.hpp"
+#include "beauty/i_compressor.hpp"
 #include "beauty/multipart_parser.hpp"
+#include "beauty/string_view.hpp"
 
 namespace beauty {
 
@@ -16,6 +19,45 @@ namespace beauty {
 // buffer, 0 or negative for end of stream
 typedef std::function<int(const std::string& id, char* buf, size_t maxSize)> StreamCallback;
 
+// As StreamCallback, also given the offset in the content of the data to
+// write to buf. Lets sendBig replies serve Range requests.
+typedef std::function<int(const std::string& id, size_t offset, char* buf, size_t maxSize)>
+    OffsetStreamCallback;
+
+// Sending files with sendfile() is supported on Linux only. Define
+// BEAUTY_NO_SENDFILE to always read files through IFileIO::readFile.
+#if defined(__linux__) && !defined(BEAUTY_NO_SENDFILE)
+#define BEAUTY_HAS_SENDFILE
+#endif
+
+// Likewise, raw uploads are moved from the socket to files with splice() on
+// Linux only. Define BEAUTY_NO_SPLICE to always write them through
+// IFileIO::writeFile.
+#if defined(__linux__) && !defined(BEAUTY_NO_SPLICE)
+#define BEAUTY_HAS_SPLICE
+#endif
+
+// A file the reply content can be sent from directly by the kernel, see
+// IFileIO::getNativeReadFile.
+struct NativeReadFile {
+    int fd_ = -1;
+    size_t offset_ = 0;
+    size_t length_ = 0;
+};
+
+// A file the body of an upload can be written to directly by the kernel, at
+// offset_ on, see IFileIO::getNativeWriteFile.
+struct NativeWriteFile {
+    int fd_ = -1;
+    size_t offset_ = 0;
+};
+
+// A range of bytes of the content, first and last offset included.
+struct ByteRange {
+    size_t first_;
+    size_t last_;
+};
+
 class RequestHandler;
 
 class Reply {
@@ -35,6 +77,7 @@ class Reply {
         created = 201,
         accepted = 202,
         no_content = 204,
+        partial_content = 206,
         multiple_choices = 300,
         moved_permanently = 301,
         moved_temporarily = 302,
@@ -49,6 +92,7 @@ class Reply {
         length_required = 411,
         precondition_failed = 412,
         payload_too_large = 413,
+        range_not_satisfiable = 416,
         expectation_failed = 417,
         internal_server_error = 500,
         not_implemented = 501,
@@ -70,10 +114,22 @@ class Reply {
     void send(status_type status);
     void send(status_type status, const std::string& contentType);
     void sendPtr(status_type status, const std::string& contentType, const char* data, size_t size);
+    // As sendPtr, keeping owner (of data) alive until the reply has been sent.
+    void sendPtr(status_type status,
+                 const std::string& contentType,
+                 const char* data,
+                 size_t size,
+                 std::shared_ptr<const void> owner);
     void sendBig(status_type status,
                  const std::string& contentType,
                  size_t totalSize,
                  StreamCallback callback);
+    // As sendBig, with the offset of the data to provide. Range requests are
+    // then answered with the requested parts only (206 Partial Content).
+    void sendBig(status_type status,
+                 const std::string& contentType,
+                 size_t totalSize,
+                 OffsetStreamCallback callback);
     void sendStreaming(status_type status, const std::string& contentType, StreamCallback callback);
     void addHeader(const std::string& name, const std::string& val);
     bool hasHeaders() const;
@@ -125,24 +181,48 @@ class Reply {
         returnToClient_ = false;
         contentPtr_ = nullptr;
         contentSize_ = 0;
+        contentOwner_.reset();
         replyPartial_ = false;
         finalPart_ = false;
         noBodyBytesReceived_ = 0;
         isMultiPart_ = false;
+        isRawUpload_ = false;
         lastOpenFileForWriteId_ = "";
         multiPartParser_.reset();  // Reset multipart parser state between requests
         streamCallback_ = nullptr;
         totalStreamSize_ = 0;
         streamedBytes_ = 0;
         useChunkedEncoding_ = false;
+        stockReply_ = StringView();
+        stockHeaderSize_ = 0;
+        nativeFile_ = NativeReadFile();
+        compressor_.reset();
+        std::vector<char>().swap(compressBuffer_);
+        std::vector<char>().swap(uploadBuffer_);
+        offsetCallback_ = nullptr;
+        streamOffset_ = 0;
+        ranges_.clear();
+        rangeIndex_ = 0;
+        rangeOffset_ = 0;
+        rangePartStarted_ = false;
+        rangeData_ = nullptr;
+        rangeBoundary_.clear();
+        rangeContentType_.clear();
+        rangeTotalSize_ = 0;
     }
 
-    // Helper to provide standard server replies.
+    // Helper to provide standard server replies. Error replies are prebuilt
+    // and set stockReply_ instead of headers and content.
     void stockReply(const Request& req, status_type status);
 
+    bool isStockReply() const {
+        return !stockReply_.empty();
+    }
+
     // Check if the status code is in the 200 range.
     bool isStatusOk() const {
-        return status_ == ok || status_ == created || status_ == accepted || status_ == no_content;
+        return status_ == ok || status_ == created || status_ == accepted ||
+               status_ == no_content || status_ == partial_content;
     }
 
     // The status code of the reply.
@@ -161,6 +241,9 @@ class Reply {
     // Size of the content data pointed to by contentPtr_.
     size_t contentSize_;
 
+    // Keeps the data pointed to by contentPtr_ alive, if set.
+    std::shared_ptr<const void> contentOwner_;
+
     // Keep track when replying with successive write buffers.
     bool replyPartial_ = false;
     bool finalPart_ = false;
@@ -171,6 +254,9 @@ class Reply {
     // Keep track if the body is a multi-part upload.
     bool isMultiPart_ = false;
 
+    // Keep track if the body is a raw upload, see RequestHandler::isRawUpload.
+    bool isRawUpload_ = false;
+
     // Keep track of the last opened file in multi-part transfers.
     std::string lastOpenFileForWriteId_;
 
@@ -183,14 +269,59 @@ class Reply {
     size_t streamedBytes_ = 0;
     bool useChunkedEncoding_ = false;
 
+    // The callback of sendBig with offsets, called through streamCallback_
+    // unless serving ranges, and the offset of the next data.
+    OffsetStreamCallback offsetCallback_;
+    size_t streamOffset_ = 0;
+
+    // Byte ranges of a 206 Partial Content reply, sent as a
+    // multipart/byteranges body if several. The current range, the next
+    // offset to send of it and if its part header has been sent.
+    std::vector<ByteRange> ranges_;
+    size_t rangeIndex_ = 0;
+    size_t rangeOffset_ = 0;
+    bool rangePartStarted_ = false;
+    // The content to send ranges of if in memory, read from the open file or
+    // offsetCallback_ otherwise.
+    const char* rangeData_ = nullptr;
+    // Boundary and part headers of multipart/byteranges bodies.
+    std::string rangeBoundary_;
+    std::string rangeContentType_;
+    size_t rangeTotalSize_ = 0;
+
+    // Prebuilt stock reply, including the Connection: close header, the empty
+    // line and the body (unless HEAD). Sent as is instead of status_,
+    // headers_ and content_ when not empty.
+    StringView stockReply_;
+    // Size of the status line and headers in stockReply_.
+    size_t stockHeaderSize_ = 0;
+
+    // File to send the content from after the headers, when fd_ is valid.
+    // The remaining part is tracked in offset_ and length_.
+    NativeReadFile nativeFile_;
+
+    // Compressor of content written in several parts, and the compressed
+    // content (framed as chunks then) that contentPtr_ points to. Released
+    // with the reply, bounding the compression memory to one compressor per
+    // connection writing a compressed reply.
+    std::unique_ptr<ICompressor> compressor_;
+    std::vector<char> compressBuffer_;
+
+    // Data of the multipart upload not yet written, see
+    // Settings::uploadBlockSize_. Released with the reply.
+    std::vector<char> uploadBuffer_;
+
     // Helper methods for chunked transfer encoding
     void wrapContentInChunkFormat();
     std::string toHexString(size_t value);
 
-    // Convert the reply into a vector of buffers. The buffers do not own the
-    // underlying memory blocks, therefore the reply object must remain valid
-    // and not be changed until the write operation has completed.
-    std::vector<asio::const_buffer> headerToBuffers();
+    // Append the status line and headers to out, without the empty line
+    // ending the headers.
+    void renderHeaders(std::vector<char>& out) const;
+
+    // Convert the reply content into a vector of buffers. The buffers do not
+    // own the underlying memory blocks, therefore the reply object must remain
+    // valid and not be changed until the write operation has completed.
     std::vector<asio::const_buffer> contentToBuffers();
 };
 
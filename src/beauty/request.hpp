@@ -7,6 +7,7 @@
 #include <limits>
 
 #include "beauty/header.hpp"
+#include "beauty/string_view.hpp"
 
 namespace beauty {
 
@@ -33,16 +34,171 @@ struct Request {
     // Parsed form params in the request
     std::vector<std::pair<std::string, std::string>> formParams_;
 
+    // Well known headers, indexed while parsing. See getHeaderView.
+    enum known_header {
+        accept,
+        accept_encoding,
+        access_control_request_headers,
+        access_control_request_method,
+        authorization,
+        connection,
+        content_length,
+        content_type,
+        cookie,
+        expect,
+        host,
+        if_modified_since,
+        if_none_match,
+        if_range,
+        origin,
+        range,
+        sec_websocket_key,
+        sec_websocket_protocol,
+        sec_websocket_version,
+        transfer_encoding,
+        upgrade,
+        nr_of_known_headers
+    };
+
     // convenience functions
     // case insensitive
     std::string getHeaderValue(const std::string &name) const {
-        auto it = std::find_if(headers_.begin(), headers_.end(), [&](const Header &h) {
-            return iequals(h.name_, name);
-        });
-        if (it != headers_.end()) {
-            return it->value_;
+        return getHeaderView(name).str();
+    }
+
+    // Non-owning views of the request line and headers as received. Also
+    // available when headers_ is not filled (Settings::headerViewsOnly_).
+    // Valid until the request is reset, i.e. while handling the request.
+    StringView getMethodView() const {
+        return toView(methodRef_);
+    }
+
+    StringView getUriView() const {
+        return toView(uriRef_);
+    }
+
+    size_t getNoHeaders() const {
+        return headerRefs_.size();
+    }
+
+    StringView getHeaderNameView(size_t i) const {
+        return toView(headerRefs_[i].name_);
+    }
+
+    StringView getHeaderValueView(size_t i) const {
+        return toView(headerRefs_[i].value_);
+    }
+
+    // case insensitive, returns an empty view if not found
+    StringView getHeaderView(StringView name) const {
+        known_header known = toKnownHeader(name);
+        if (known != nr_of_known_headers) {
+            return getHeaderView(known);
+        }
+        return findHeader(name);
+    }
+
+    // O(1) lookup of a well known header, returns an empty view if not found
+    StringView getHeaderView(known_header known) const {
+        if (knownHeaders_[known] != 0) {
+            return toView(headerRefs_[knownHeaders_[known] - 1].value_);
+        }
+        if (headerRefs_.empty()) {
+            // Not parsed, headers_ filled by e.g. a test
+            return findHeader(knownHeaderName(known));
+        }
+        return StringView();
+    }
+
+    static StringView knownHeaderName(known_header known) {
+        static const StringView names[nr_of_known_headers] = {"Accept",
+                                                         "Accept-Encoding",
+                                                         "Access-Control-Request-Headers",
+                                                         "Access-Control-Request-Method",
+                                                         "Authorization",
+                                                         "Connection",
+                                                         "Content-Length",
+                                                         "Content-Type",
+                                                         "Cookie",
+                                                         "Expect",
+                                                         "Host",
+                                                         "If-Modified-Since",
+                                                         "If-None-Match",
+                                                         "If-Range",
+                                                         "Origin",
+                                                         "Range",
+                                                         "Sec-WebSocket-Key",
+                                                         "Sec-WebSocket-Protocol",
+                                                         "Sec-WebSocket-Version",
+                                                         "Transfer-Encoding",
+                                                         "Upgrade"};
+        return names[known];
+    }
+
+    // case insensitive, nr_of_known_headers if not a well known header.
+    // Called for each parsed header, so the candidate is picked by length
+    // (and first character) and at most one name is compared.
+    static known_header toKnownHeader(StringView name) {
+        known_header candidate = nr_of_known_headers;
+        const char first = name.empty() ? '\0' : static_cast<char>(name[0] | 0x20);
+        switch (name.size()) {
+            case 4:
+                candidate = host;
+                break;
+            case 5:
+                candidate = range;
+                break;
+            case 6:
+                candidate = first == 'a'   ? accept
+                            : first == 'c' ? cookie
+                            : first == 'e' ? expect
+                                           : origin;
+                break;
+            case 7:
+                candidate = upgrade;
+                break;
+            case 8:
+                candidate = if_range;
+                break;
+            case 10:
+                candidate = connection;
+                break;
+            case 12:
+                candidate = content_type;
+                break;
+            case 13:
+                candidate = first == 'a' ? authorization : if_none_match;
+                break;
+            case 14:
+                candidate = content_length;
+                break;
+            case 15:
+                candidate = accept_encoding;
+                break;
+            case 17:
+                candidate = first == 'i'   ? if_modified_since
+                            : first == 's' ? sec_websocket_key
+                                           : transfer_encoding;
+                break;
+            case 21:
+                candidate = sec_websocket_version;
+                break;
+            case 22:
+                candidate = sec_websocket_protocol;
+                break;
+            case 29:
+                candidate = access_control_request_method;
+                break;
+            case 30:
+                candidate = access_control_request_headers;
+                break;
+            default:
+                break;
         }
-        return "";
+        if (candidate != nr_of_known_headers && knownHeaderName(candidate).iequals(name)) {
+            return candidate;
+        }
+        return nr_of_known_headers;
     }
 
     struct Param {
@@ -75,10 +231,48 @@ struct Request {
     }
 
    private:
+    // Location of a string in headerData_.
+    struct Ref {
+        size_t offset_ = 0;
+        size_t size_ = 0;
+    };
+
+    struct HeaderRef {
+        Ref name_;
+        Ref value_;
+    };
+
+    StringView findHeader(StringView name) const {
+        for (const auto &h : headerRefs_) {
+            if (toView(h.name_).iequals(name)) {
+                return toView(h.value_);
+            }
+        }
+        for (const auto &h : headers_) {
+            if (name.iequals(h.name_)) {
+                return h.value_;
+            }
+        }
+        return StringView();
+    }
+
+    StringView toView(const Ref &ref) const {
+        if (ref.size_ == 0) {
+            return StringView();
+        }
+        return StringView(&headerData_[ref.offset_], ref.size_);
+    }
+
     void reset() {
         method_.clear();
         uri_.clear();
         headers_.clear();
+        // Keep capacity, no allocations needed for the next request.
+        headerData_.clear();
+        headerRefs_.clear();
+        methodRef_ = Ref();
+        uriRef_ = Ref();
+        std::fill(knownHeaders_, knownHeaders_ + nr_of_known_headers, 0);
         requestPath_.clear();
         body_.clear();
         contentLength_ = std::numeric_limits<size_t>::max();
@@ -101,20 +295,20 @@ struct Request {
         return {false, ""};
     }
 
-    static bool ichar_equals(char a, char b) {
-        return std::tolower(static_cast<unsigned char>(a)) ==
-               std::tolower(static_cast<unsigned char>(b));
-    }
-
-    bool iequals(const std::string &a, const std::string &b) const {
-        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), ichar_equals);
-    }
-
     size_t noInitialBodyBytesReceived_ = 0;
     size_t contentLength_ = std::numeric_limits<size_t>::max();  // means not specified
     bool isChunked_ = false;
     bool expectContinue_ = false;
     bool upgradeToWebSocket_ = false;
+
+    // The request line and headers as received, referred to by the views.
+    std::vector<char> headerData_;
+    std::vector<HeaderRef> headerRefs_;
+    Ref methodRef_;
+    Ref uriRef_;
+    // Index + 1 in headerRefs_ of the first of each well known header, 0 if
+    // not received.
+    size_t knownHeaders_[nr_of_known_headers] = {};
 };
 
 }  // namespace beauty
@@ -26,7 +26,7 @@ class RequestDecoder {
             switch (c) {
                 case '%':
                     if (i[1] && i[2]) {
-                        char hs[]{i[1], i[2]};
+                        char hs[]{i[1], i[2], '\0'};
                         escaped += static_cast<char>(std::strtol(hs, nullptr, 16));
                         i += 2;
                     }
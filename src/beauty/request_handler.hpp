@@ -1,6 +1,9 @@
 #pragma once
 
+#include <deque>
+
 #include "beauty/beauty_common.hpp"
+#include "beauty/fast_random.hpp"
 #include "beauty/multipart_parser.hpp"
 #include "beauty/i_file_io.hpp"
 #include "beauty/reply.hpp"
@@ -17,13 +20,14 @@ class RequestHandler {
     RequestHandler(const RequestHandler &) = delete;
     RequestHandler &operator=(const RequestHandler &) = delete;
 
-    RequestHandler(size_t maxContentSize);
+    RequestHandler(size_t maxContentSize, const Settings &settings);
     ~RequestHandler() = default;
 
     // Handlers to be optionally implemented.
     void setFileIO(IFileIO *fileIO);
     void addRequestHandler(const handlerCallback &cb);
     void setExpectContinueHandler(const handlerCallback &cb);
+    void setCompressorFactory(ICompressorFactory *factory);
 
     void shouldContinueAfterHeaders(const Request &req, Reply &rep);
 
@@ -33,28 +37,107 @@ class RequestHandler {
                        Reply &rep);
     void handleStreamingRead(unsigned connectionId, Reply &rep);
     void handleFileIORead(unsigned connectionId, const Request &req, Reply &rep);
+    // Start reading the next part of a file reply into buf, while the current
+    // part is written, if the FileIO supports it (IFileIO::readFileAsync).
+    // done is called from any thread. Returns false if not started.
+    bool readFileAhead(unsigned connectionId,
+                       const Request &req,
+                       const Reply &rep,
+                       std::vector<char> &buf,
+                       std::function<void(int)> done);
+    // As handleFileIORead, with the part read by readFileAhead. The written
+    // content is swapped into buf.
+    void handleFileIOReadAhead(unsigned connectionId,
+                               Reply &rep,
+                               std::vector<char> &buf,
+                               int nrReadBytes);
     void handleFileIOWrite(unsigned connectionId,
                            const Request &req,
                            std::vector<char> &content,
                            Reply &rep);
+    // True for uploads of raw data (Content-Type: application/octet-stream)
+    // with PUT or POST, of known length or chunked, when enabled
+    // (Settings::rawUploads_) and a FileIO is set. Unless taken by a request
+    // handler, they are written to the file at the request path with
+    // IFileIO::writeFile as received, so they may be larger than
+    // maxContentSize.
+    bool isRawUpload(const Request &req) const;
+    // The native file the raw upload of rep is written to, see
+    // IFileIO::getNativeWriteFile.
+    bool getNativeWriteFile(const Reply &rep, NativeWriteFile &file);
+    // Write the data of a multipart upload held back for a whole block, when
+    // the body ends before the upload does. The file is left open, as before
+    // when each read was written as received.
+    void flushUpload(const Request &req, Reply &rep);
+    // Let the FileIO close the file of a raw upload cut short by a connection
+    // error, with a last IFileIO::writeFile call without data.
+    void closeRawUpload(const Request &req, Reply &rep);
     void closeFile(unsigned connectionId);
+    // Compress the content of rep if a compressor factory is set, the content
+    // is compressible and the client accepts it. Called before the headers
+    // are written.
+    void compressReply(unsigned connectionId, const Request &req, Reply &rep);
 
    private:
     void openAndReadFile(unsigned connectionId, const Request &req, Reply &rep);
+    // Open the file, or a precompressed sibling accepted by the client.
+    size_t openFileForRead(unsigned connectionId, const Request &req, Reply &rep);
     size_t readFromFile(unsigned connectionId, const Request &req, Reply &rep);
-    void writeFileParts(unsigned connectionId,
-                        const Request &req,
-                        Reply &rep,
-                        std::deque<MultiPartParser::ContentPart> &parts);
+    // Finish a part read from the file, closing the file after the last.
+    void handleFileData(unsigned connectionId, Reply &rep, size_t nrReadBytes);
+    bool useNativeFile(unsigned connectionId, size_t contentSize, Reply &rep);
+    // Answer a Range request for the size bytes of content (in memory, in the
+    // open file or from a sendBig offset callback) with the satisfiable
+    // ranges, or 416 if none. Returns false to send all of the content
+    // instead, e.g. if If-Range does not match or the file is not seekable.
+    bool serveRanges(unsigned connectionId, const Request &req, Reply &rep, size_t size);
+    // Set the status and headers of a range reply, see serveRanges.
+    bool prepareRanges(const Request &req, Reply &rep, size_t size);
+    // Fill content_ with the next part of a range reply.
+    void readRanges(unsigned connectionId, const Request &req, Reply &rep);
+    // Compress the next part of a compressed reply to a chunk, followed by the
+    // last chunk when finish.
+    void compressContent(Reply &rep, const char *data, size_t size, bool finish);
+    // Write the received part of a raw upload, the last when all of the
+    // body has been received.
+    void writeRawBody(const Request &req, std::vector<char> &content, Reply &rep);
+    // Write the parts found by the last parse of the multipart parser, of
+    // the body data from bodyPos.
+    void writeFileParts(unsigned connectionId, const Request &req, Reply &rep, size_t bodyPos);
+    // Write data of the open multipart upload, in blocks of uploadBlockSize_
+    // if set.
+    void writeUploadData(
+        const Request &req, Reply &rep, const char *data, size_t size, bool lastData);
 
     static void defaultExpectContinueHandler(const Request &, Reply &rep);
 
     // The max buffer size when writing socket.
     const size_t maxContentSize_;
 
+    // Look for precompressed siblings of static files.
+    const bool servePrecompressed_;
+
+    // Replies with a smaller Content-Length are not compressed.
+    const size_t compressMinSize_;
+
+    // Write raw uploads to files, see isRawUpload.
+    const bool rawUploads_;
+
+    // Multipart uploads are written in blocks of this size, 0 = as received.
+    const size_t uploadBlockSize_;
+
+    // Let the FileIO reserve the space of multipart uploads.
+    const bool preallocateUploads_;
+
     // Provided FileIO to be implemented by each specific projects.
     IFileIO *fileIO_ = nullptr;
 
+    // Provided compression of dynamic replies, nullptr = none.
+    ICompressorFactory *compressorFactory_ = nullptr;
+
+    // Source of multipart/byteranges boundaries.
+    FastRandom random_;
+
     // Added request handler callbacks
     std::deque<handlerCallback> requestHandlers_;
 
@@ -4,6 +4,8 @@
 #include <string>
 #include <limits>
 
+#include "beauty/chunked_decoder.hpp"
+
 namespace beauty {
 
 struct Request;
@@ -17,6 +19,13 @@ class RequestParser {
     // Reset to initial parser state.
     void reset();
 
+    // Only record views of the headers, see Request::getHeaderView, without
+    // filling Request::headers_.
+    void setHeaderViewsOnly(bool headerViewsOnly);
+
+    // Reject request bodies with larger chunks (Transfer-Encoding: chunked).
+    void setMaxChunkSize(size_t maxChunkSize);
+
     // Result of parse.
     enum result_type {
         good_complete,
@@ -27,18 +36,53 @@ class RequestParser {
         bad,
         version_not_supported,
         missing_content_length,
+        payload_too_large,
         indeterminate
     };
 
     // Parse some data. The enum return value is good when a complete request
     // has been parsed, bad if the data is invalid, good_part when more
-    // data is required.
+    // body data is required and indeterminate when the headers are not yet
+    // complete. A chunked body is decoded to the front of content, the result
+    // is payload_too_large if a chunk exceeds the max chunk size.
     result_type parse(Request &req, std::vector<char> &content);
 
+    // Decode more of a chunked body, received in content from offset on, in
+    // place. The enum return value is good_complete after the last chunk,
+    // good_part when more data is required, bad or payload_too_large as for
+    // parse. Bytes following the body are left as unconsumed.
+    result_type parseChunked(std::vector<char> &content, size_t offset);
+
+    // Number of bytes following a good_complete request in the content given
+    // to the last parse, i.e. pipelined requests.
+    size_t getUnconsumedSize() const;
+
+    // Copy the unconsumed bytes to dest. Must be called before the parsed
+    // content is modified.
+    void takeUnconsumed(std::vector<char> &dest);
+
    private:
     // Handle the next character of input.
     result_type consume(Request &req, std::vector<char> &content, char input);
 
+    // Skip the bytes which only extend the current token (or body), without
+    // a state transition for each. Obsolete line folding and other rare
+    // cases are handled by consume.
+    void skipTokenBytes(Request &req, std::vector<char> &content, size_t size);
+
+    // Move up to n body bytes at the current input to the end of content.
+    // Returns the number of bytes moved.
+    size_t moveBody(Request &req, std::vector<char> &content, size_t n);
+
+    // Decode the chunked body data in content from the current input on.
+    result_type decodeChunkedBody(Request &req, std::vector<char> &content, size_t size);
+    static result_type toResult(ChunkedDecoder::result_type result);
+
+    // Offset in the request header data of the current input.
+    size_t offset(const Request &req) const;
+    // Copy the consumed request line and header bytes to the request.
+    void copyHeaderData(Request &req);
+
     void storeHeaderValueIfNeeded(Request &req);
     result_type checkRequestAfterAllHeaders(Request &req);
 
@@ -66,9 +110,26 @@ class RequestParser {
         expecting_newline_2,
         expecting_newline_3,
         post,
+        chunked,
     } state_;
 
     std::size_t contentLength_ = std::numeric_limits<size_t>::max();
+
+    // Bytes left in the content after a complete request.
+    const char *unconsumedData_ = nullptr;
+    std::size_t unconsumedSize_ = 0;
+
+    // The content being parsed, the current position in it and how far it
+    // has been copied to the request header data.
+    const char *data_ = nullptr;
+    std::size_t pos_ = 0;
+    std::size_t copied_ = 0;
+
+    // Decoder of chunked request bodies.
+    ChunkedDecoder chunkedDecoder_;
+
+    bool upgradeWebSocketHeader_ = false;
+    bool headerViewsOnly_ = false;
 };
 
 }  // namespace beauty
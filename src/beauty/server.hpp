@@ -8,6 +8,7 @@
 #include <string>
 
 #include "beauty/beauty_common.hpp"
+#include "beauty/buffer_pool.hpp"
 #include "beauty/connection.hpp"
 #include "beauty/connection_manager.hpp"
 #include "beauty/i_file_io.hpp"
@@ -38,14 +39,26 @@ class Server {
 
     uint16_t getBindedPort() const;
 
+    // Hit/miss statistics of the connection buffer pool.
+    BufferPool::Stats getBufferPoolStats() const;
+
     // Handlers to be optionally implemented.
     void setFileIO(IFileIO *fileIO);
     void addRequestHandler(const handlerCallback &cb);
     void setExpectContinueHandler(const handlerCallback &cb);
     void setDebugMsgHandler(const debugMsgCallback &cb);
     void setWsEndpoints(std::set<std::shared_ptr<WsEndpoint>> endpoints);
+    // Compress dynamic replies (handler content, sendBig, sendStreaming and
+    // files) for clients accepting gzip or deflate.
+    void setCompressorFactory(ICompressorFactory *factory);
+
+    // Stop accepting and close all connections. Must be called from the thread
+    // running the io_context, use asio::post() otherwise.
+    void stop();
 
    private:
+    friend class ServerPool;
+
     void doAccept();
     void doAwaitStop();
     void doTick();
@@ -58,12 +71,23 @@ class Server {
     // Unique Id for each connection.
     unsigned connectionId_ = 0;
 
+    // Increment between connection ids, > 1 when ids are shared with other
+    // servers in a ServerPool.
+    unsigned connectionIdStride_ = 1;
+
     // Timer to handle connection status.
     asio::steady_timer timer_;
 
+    // Interval of the timer, i.e. the timeout granularity.
+    const std::chrono::milliseconds tickInterval_;
+
     // The max buffer size when reading/writing socket.
     const size_t maxContentSize_;
 
+    // Buffers borrowed by the connections, shared with them as they may
+    // outlive the server.
+    std::shared_ptr<BufferPool> bufferPool_;
+
     // Callback to handle post file access, e.g. a custom not found handler.
     handlerCallback fileNotFoundCb_;
 
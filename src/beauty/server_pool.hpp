@@ -0,0 +1,94 @@
+#pragma once
+// included first
+#include "beauty/environment.hpp"
+
+#include <asio.hpp>
+#include <functional>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "beauty/beauty_common.hpp"
+#include "beauty/i_file_io.hpp"
+#include "beauty/server.hpp"
+#include "beauty/ws_endpoint.hpp"
+
+namespace beauty {
+
+// Creates the WebSocket endpoints for one worker. Called once per worker as a
+// WsEndpoint can only be bound to a single worker.
+using wsEndpointsFactory = std::function<std::set<std::shared_ptr<WsEndpoint>>(size_t worker)>;
+
+// Runs a number of workers, each with its own io_context, thread and Server
+// (acceptor, ConnectionManager and tick timer). All acceptors are bound to the
+// same address and port using SO_REUSEPORT, letting the kernel distribute new
+// connections between the workers. A connection stays on the worker that
+// accepted it for its whole life.
+//
+// Thread-safety rules:
+// - Request handler callbacks, the expect continue handler and the debug
+//   message handler are shared by all workers and may be called concurrently.
+//   They must be thread-safe (or stateless).
+// - The IFileIO instance is shared by all workers and may be called
+//   concurrently, for different file ids. File ids are unique across workers.
+// - WsEndpoints are created per worker (see wsEndpointsFactory) and are only
+//   called from that worker's thread. Their send methods and
+//   getActiveConnections() only reach connections of the same worker and must
+//   be called from that thread, use asio::post() with getIoContext(worker)
+//   otherwise.
+//
+// Note: On platforms without SO_REUSEPORT, only a single worker is created.
+class ServerPool {
+   public:
+    ServerPool(const ServerPool &) = delete;
+    ServerPool &operator=(const ServerPool &) = delete;
+
+    explicit ServerPool(const std::string &address,
+                        const std::string &port,
+                        size_t nrOfWorkers,
+                        const Settings &settings,
+                        size_t maxContentSize = 1024);
+    ~ServerPool();
+
+    uint16_t getBindedPort() const;
+    size_t getNrOfWorkers() const;
+    asio::io_context &getIoContext(size_t worker);
+    Server &getServer(size_t worker);
+
+    // Handlers to be optionally implemented, applied to all workers.
+    void setFileIO(IFileIO *fileIO);
+    void addRequestHandler(const handlerCallback &cb);
+    void setExpectContinueHandler(const handlerCallback &cb);
+    void setDebugMsgHandler(const debugMsgCallback &cb);
+    void setWsEndpoints(const wsEndpointsFactory &factory);
+    void setCompressorFactory(ICompressorFactory *factory);
+
+    // Start one thread per worker and return.
+    void start();
+
+    // Start one thread per worker and block until all workers have stopped,
+    // e.g. by a signal or a call to stop().
+    void run();
+
+    // Stop all workers, may be called from any thread.
+    void stop();
+
+    // Wait for all worker threads to finish.
+    void join();
+
+   private:
+    struct Worker {
+        asio::io_context ioContext_;
+        std::unique_ptr<Server> server_;
+        std::thread thread_;
+    };
+
+    // Settings must outlive the servers referring to them.
+    Settings settings_;
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+};
+
+}  // namespace beauty
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <string>
+
+namespace beauty {
+
+// Non-owning view of a character sequence (std::string_view is not available
+// in C++11). The viewed data must outlive the view.
+class StringView {
+   public:
+    static const size_t npos = static_cast<size_t>(-1);
+
+    StringView() = default;
+    StringView(const char *data, size_t size) : data_(data), size_(size) {}
+    StringView(const char *str) : data_(str), size_(std::strlen(str)) {}
+    StringView(const std::string &str) : data_(str.data()), size_(str.size()) {}
+
+    const char *data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    const char *begin() const {
+        return data_;
+    }
+
+    const char *end() const {
+        return data_ + size_;
+    }
+
+    char operator[](size_t i) const {
+        return data_[i];
+    }
+
+    std::string str() const {
+        return std::string(data_, size_);
+    }
+
+    bool operator==(const StringView &other) const {
+        return size_ == other.size_ && std::equal(begin(), end(), other.begin());
+    }
+
+    bool operator!=(const StringView &other) const {
+        return !(*this == other);
+    }
+
+    // Position of the first occurrence of str at or after pos, npos if none.
+    size_t find(const StringView &str, size_t pos = 0) const {
+        if (pos > size_) {
+            return npos;
+        }
+        const char *it = std::search(begin() + pos, end(), str.begin(), str.end());
+        return it == end() && !str.empty() ? npos : static_cast<size_t>(it - data_);
+    }
+
+    // case insensitive
+    bool iequals(const StringView &other) const {
+        return size_ == other.size_ && std::equal(begin(), end(), other.begin(), ichar_equals);
+    }
+
+   private:
+    static bool ichar_equals(char a, char b) {
+        return std::tolower(static_cast<unsigned char>(a)) ==
+               std::tolower(static_cast<unsigned char>(b));
+    }
+
+    const char *data_ = "";
+    size_t size_ = 0;
+};
+
+}  // namespace beauty
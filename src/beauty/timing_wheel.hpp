@@ -0,0 +1,202 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+namespace beauty {
+
+// Hierarchical timing wheel used to track connection deadlines.
+//
+// Time is divided into ticks of a fixed resolution. Entries are kept in
+// intrusive lists, so scheduling and cancelling is O(1), and advancing the
+// wheel only touches entries that expire (or cascade down from a coarser
+// level) during the advanced ticks.
+//
+// Deadlines further away than the range of the wheel (resolution * 64^4) are
+// clamped, i.e. fire early. Owners are expected to verify their deadline when
+// the entry expires and reschedule if needed.
+template <typename T>
+class TimingWheel {
+   public:
+    using clock = std::chrono::steady_clock;
+
+    class Entry {
+       public:
+        explicit Entry(T *owner = nullptr) : owner_(owner) {}
+        ~Entry() {
+            unlink();
+        }
+        Entry(const Entry &) = delete;
+        Entry &operator=(const Entry &) = delete;
+
+        bool isScheduled() const {
+            return next_ != nullptr;
+        }
+        T *getOwner() const {
+            return owner_;
+        }
+
+       private:
+        friend class TimingWheel;
+
+        void unlink() {
+            if (next_ != nullptr) {
+                prev_->next_ = next_;
+                next_->prev_ = prev_;
+                prev_ = nullptr;
+                next_ = nullptr;
+            }
+        }
+
+        T *owner_;
+        Entry *prev_ = nullptr;
+        Entry *next_ = nullptr;
+        uint64_t expiry_ = 0;
+    };
+
+    using expiredCallback = std::function<void(T &owner)>;
+
+    TimingWheel(std::chrono::milliseconds resolution, clock::time_point start)
+        : resolution_(resolution.count() > 0 ? resolution : std::chrono::milliseconds(1)),
+          start_(start) {
+        for (auto &level : slots_) {
+            for (auto &slot : level) {
+                slot.prev_ = &slot;
+                slot.next_ = &slot;
+            }
+        }
+    }
+    TimingWheel(const TimingWheel &) = delete;
+    TimingWheel &operator=(const TimingWheel &) = delete;
+
+    ~TimingWheel() {
+        for (auto &level : slots_) {
+            for (auto &slot : level) {
+                while (slot.next_ != &slot) {
+                    slot.next_->unlink();
+                }
+            }
+        }
+    }
+
+    std::chrono::milliseconds getResolution() const {
+        return resolution_;
+    }
+
+    // Schedule (or reschedule) an entry to expire at deadline.
+    void schedule(Entry &entry, clock::time_point deadline) {
+        entry.unlink();
+        // Round up so an entry never expires before its deadline.
+        uint64_t expiry = toTick(deadline, true);
+        // The slot of the current tick has already been processed.
+        insert(entry, expiry > now_ ? expiry : now_ + 1);
+    }
+
+    void cancel(Entry &entry) {
+        entry.unlink();
+    }
+
+    // Advance the wheel up to now, calling onExpired for each expired entry.
+    // The entry is unscheduled before the callback is called, so it may be
+    // rescheduled or its owner destroyed from within the callback.
+    void advance(clock::time_point now, const expiredCallback &onExpired) {
+        uint64_t target = toTick(now, false);
+        while (now_ < target) {
+            now_++;
+            // Cascade entries from coarser levels, highest level first.
+            for (size_t level = Levels - 1; level > 0; --level) {
+                if ((now_ & ((uint64_t(1) << (level * SlotBits)) - 1)) == 0) {
+                    cascade(slots_[level][slotIndex(now_, level)]);
+                }
+            }
+
+            Entry expired;
+            splice(slots_[0][slotIndex(now_, 0)], expired);
+            while (expired.next_ != &expired) {
+                Entry *e = expired.next_;
+                e->unlink();
+                if (e->expiry_ <= now_) {
+                    onExpired(*e->owner_);
+                } else {
+                    // Clamped deadline, put it back in the wheel.
+                    insert(*e, e->expiry_);
+                }
+            }
+        }
+    }
+
+   private:
+    static const size_t SlotBits = 6;
+    static const size_t Slots = 1 << SlotBits;
+    static const size_t Levels = 4;
+
+    static size_t slotIndex(uint64_t tick, size_t level) {
+        return static_cast<size_t>((tick >> (level * SlotBits)) & (Slots - 1));
+    }
+
+    uint64_t toTick(clock::time_point tp, bool roundUp) const {
+        if (tp <= start_) {
+            return 0;
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(tp - start_);
+        auto count = elapsed.count() + (roundUp ? resolution_.count() - 1 : 0);
+        return static_cast<uint64_t>(count / resolution_.count());
+    }
+
+    void insert(Entry &entry, uint64_t expiry) {
+        const uint64_t maxDelta = (uint64_t(1) << (Levels * SlotBits)) - 1;
+        uint64_t delta = expiry - now_;
+        if (delta > maxDelta) {
+            delta = maxDelta;
+        }
+        entry.expiry_ = expiry;
+
+        size_t level = 0;
+        while (level < Levels - 1 && delta >= (uint64_t(1) << ((level + 1) * SlotBits))) {
+            level++;
+        }
+        Entry &slot = slots_[level][slotIndex(now_ + delta, level)];
+        entry.prev_ = slot.prev_;
+        entry.next_ = &slot;
+        slot.prev_->next_ = &entry;
+        slot.prev_ = &entry;
+    }
+
+    void cascade(Entry &slot) {
+        Entry pending;
+        splice(slot, pending);
+        while (pending.next_ != &pending) {
+            Entry *e = pending.next_;
+            e->unlink();
+            insert(*e, e->expiry_ > now_ ? e->expiry_ : now_);
+        }
+    }
+
+    // Move all entries of from to the (empty) list to.
+    static void splice(Entry &from, Entry &to) {
+        if (from.next_ == &from) {
+            to.prev_ = &to;
+            to.next_ = &to;
+            return;
+        }
+        to.next_ = from.next_;
+        to.prev_ = from.prev_;
+        to.next_->prev_ = &to;
+        to.prev_->next_ = &to;
+        from.next_ = &from;
+        from.prev_ = &from;
+    }
+
+    const std::chrono::milliseconds resolution_;
+    const clock::time_point start_;
+
+    // Current tick, all slots up to and including it have been processed.
+    uint64_t now_ = 0;
+
+    // Sentinels of the circular entry lists.
+    std::array<std::array<Entry, Slots>, Levels> slots_;
+};
+
+}  // namespace beauty
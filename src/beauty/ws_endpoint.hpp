@@ -100,6 +100,39 @@ class WsEndpoint : public IWsReceiver {
         return wsSender_ ? !wsSender_->isWriteInProgress(connectionId) : false;
     }
 
+    // Numeric handle variants of the methods above. Prefer these on hot paths,
+    // e.g. when broadcasting, as they avoid string formatting and parsing.
+    WriteResult sendText(WsConnectionHandle handle,
+                         const std::string& message,
+                         WriteCompleteCallback callback = nullptr) {
+        return wsSender_ ? wsSender_->sendWsText(handle, message, callback)
+                         : WriteResult::CONNECTION_CLOSED;
+    }
+
+    WriteResult sendBinary(WsConnectionHandle handle,
+                           const std::vector<char>& data,
+                           WriteCompleteCallback callback = nullptr) {
+        return wsSender_ ? wsSender_->sendWsBinary(handle, data, callback)
+                         : WriteResult::CONNECTION_CLOSED;
+    }
+
+    WriteResult sendClose(WsConnectionHandle handle,
+                          uint16_t statusCode,
+                          const std::string& reason,
+                          WriteCompleteCallback callback = nullptr) {
+        return wsSender_ ? wsSender_->sendWsClose(handle, statusCode, reason, callback)
+                         : WriteResult::CONNECTION_CLOSED;
+    }
+
+    std::vector<WsConnectionHandle> getActiveHandles() const {
+        return wsSender_ ? wsSender_->getActiveWsHandlesForEndpoint(this)
+                         : std::vector<WsConnectionHandle>();
+    }
+
+    bool canSendTo(WsConnectionHandle handle) const {
+        return wsSender_ ? !wsSender_->isWriteInProgress(handle) : false;
+    }
+
     // IWsReceiver interface - to be implemented by derived classes
     virtual void onWsOpen(const std::string& connectionId) override = 0;
     virtual void onWsMessage(const std::string& connectionId,
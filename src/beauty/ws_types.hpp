@@ -1,6 +1,8 @@
 #pragma once
 
 #include <functional>
+#include <limits>
+#include <string>
 #include <system_error>
 
 namespace beauty {
@@ -18,4 +20,60 @@ enum class WriteResult {
 // bytes_written: Number of bytes written
 using WriteCompleteCallback = std::function<void(const std::error_code&, std::size_t)>;
 
-}  // namespace beauty
\ No newline at end of file
+// Numeric handle of a WebSocket connection
+//
+// Refers to the same connection as the string connection id passed to
+// IWsReceiver, but avoids formatting and comparing strings when sending,
+// e.g. when broadcasting to many connections.
+struct WsConnectionHandle {
+    WsConnectionHandle() = default;
+    explicit WsConnectionHandle(unsigned id) : id_(id) {}
+
+    // Convert a string connection id to a handle. Returns false, leaving
+    // handle unchanged, if connectionId is not a decimal connection id.
+    static bool fromString(const std::string& connectionId, WsConnectionHandle& handle) {
+        if (connectionId.empty()) {
+            return false;
+        }
+        unsigned long long id = 0;
+        for (char c : connectionId) {
+            if (c < '0' || c > '9') {
+                return false;
+            }
+            id = id * 10 + (c - '0');
+            if (id > std::numeric_limits<unsigned>::max()) {
+                return false;
+            }
+        }
+        handle.id_ = static_cast<unsigned>(id);
+        return true;
+    }
+
+    // Convert the handle to a string connection id
+    std::string toString() const {
+        return std::to_string(id_);
+    }
+
+    bool operator==(const WsConnectionHandle& other) const {
+        return id_ == other.id_;
+    }
+    bool operator!=(const WsConnectionHandle& other) const {
+        return id_ != other.id_;
+    }
+    bool operator<(const WsConnectionHandle& other) const {
+        return id_ < other.id_;
+    }
+
+    unsigned id_ = 0;
+};
+
+}  // namespace beauty
+
+namespace std {
+template <>
+struct hash<beauty::WsConnectionHandle> {
+    size_t operator()(const beauty::WsConnectionHandle& h) const {
+        return hash<unsigned>()(h.id_);
+    }
+};
+}  // namespace std
\ No newline at end of file
@@ -0,0 +1,56 @@
+#include "beauty/buffer_pool.hpp"
+
+namespace beauty {
+
+BufferPool::BufferPool(size_t bufferSize, size_t maxPooled)
+    : bufferSize_(bufferSize), maxPooled_(maxPooled) {
+    pool_.reserve(maxPooled_);
+}
+
+void BufferPool::acquire(std::vector<char> &buf) {
+    if (buf.capacity() >= bufferSize_) {
+        return;
+    }
+    if (!pool_.empty()) {
+        buf.swap(pool_.back());
+        pool_.pop_back();
+        stats_.hits_++;
+    } else {
+        buf.reserve(bufferSize_);
+        stats_.misses_++;
+    }
+    buf.clear();
+    if (lent_.insert(&buf).second) {
+        stats_.inUse_++;
+    }
+}
+
+void BufferPool::release(std::vector<char> &buf) {
+    // Also when buf no longer holds the buffer, e.g. swapped out
+    if (lent_.erase(&buf) > 0) {
+        stats_.inUse_--;
+    }
+    if (buf.capacity() < bufferSize_) {
+        return;
+    }
+    if (pool_.size() < maxPooled_ && buf.capacity() < 2 * bufferSize_) {
+        buf.clear();
+        pool_.emplace_back();
+        pool_.back().swap(buf);
+    } else {
+        std::vector<char>().swap(buf);
+        stats_.discarded_++;
+    }
+}
+
+size_t BufferPool::getBufferSize() const {
+    return bufferSize_;
+}
+
+BufferPool::Stats BufferPool::getStats() const {
+    Stats stats = stats_;
+    stats.pooled_ = pool_.size();
+    return stats;
+}
+
+}  // namespace beauty
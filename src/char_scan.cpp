@@ -0,0 +1,219 @@
+#include "beauty/char_scan.hpp"
+
+#include <stdint.h>
+
+#include <algorithm>
+
+#if !defined(BEAUTY_NO_SIMD) && defined(__AVX2__)
+#define BEAUTY_SCAN_AVX2
+#include <immintrin.h>
+#elif !defined(BEAUTY_NO_SIMD) && defined(__SSE2__)
+#define BEAUTY_SCAN_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace beauty {
+
+namespace {
+
+enum : uint8_t { token_char = 1, uri_char = 2, value_char = 4 };
+
+// Character classes, see parse_common.hpp:
+//   token_char: isChar && !isCtl && !isTsspecial
+//   uri_char:   !isCtl && != ' '
+//   value_char: !isCtl
+const uint8_t charClass[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    4, 7, 6, 7, 7, 7, 7, 7, 6, 6, 7, 7, 6, 7, 7, 6,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 6, 6, 6, 6, 6, 6,
+    6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 6, 6, 6, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 6, 7, 6, 7, 0,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+};
+
+size_t scanScalar(const char *data, size_t size, uint8_t cls) {
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        if (!(charClass[p[i]] & cls)) {
+            return i;
+        }
+        if (!(charClass[p[i + 1]] & cls)) {
+            return i + 1;
+        }
+        if (!(charClass[p[i + 2]] & cls)) {
+            return i + 2;
+        }
+        if (!(charClass[p[i + 3]] & cls)) {
+            return i + 3;
+        }
+    }
+    for (; i < size; ++i) {
+        if (!(charClass[p[i]] & cls)) {
+            return i;
+        }
+    }
+    return size;
+}
+
+#if defined(BEAUTY_SCAN_AVX2)
+
+const size_t blockSize = 32;
+typedef __m256i Block;
+
+inline Block load(const char *p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+}
+
+inline Block splat(char c) {
+    return _mm256_set1_epi8(c);
+}
+
+// Unsigned x >= lo for each byte.
+inline Block atLeast(Block x, Block lo) {
+    return _mm256_cmpeq_epi8(_mm256_max_epu8(x, lo), x);
+}
+
+inline Block equal(Block x, Block c) {
+    return _mm256_cmpeq_epi8(x, c);
+}
+
+inline uint32_t bits(Block b) {
+    return static_cast<uint32_t>(_mm256_movemask_epi8(b));
+}
+
+#elif defined(BEAUTY_SCAN_SSE2)
+
+const size_t blockSize = 16;
+typedef __m128i Block;
+
+inline Block load(const char *p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+
+inline Block splat(char c) {
+    return _mm_set1_epi8(c);
+}
+
+// Unsigned x >= lo for each byte.
+inline Block atLeast(Block x, Block lo) {
+    return _mm_cmpeq_epi8(_mm_max_epu8(x, lo), x);
+}
+
+inline Block equal(Block x, Block c) {
+    return _mm_cmpeq_epi8(x, c);
+}
+
+inline uint32_t bits(Block b) {
+    return static_cast<uint32_t>(_mm_movemask_epi8(b)) & 0xffff;
+}
+
+#endif
+
+#if defined(BEAUTY_SCAN_AVX2) || defined(BEAUTY_SCAN_SSE2)
+
+inline size_t firstBit(uint32_t bits) {
+    return static_cast<size_t>(__builtin_ctz(bits));
+}
+
+// Look for a byte below lo, DEL, stop or (if asciiOnly) above DEL a block at
+// a time. Returns true with pos set to the first one found, otherwise pos is
+// set to the start of the remaining bytes, fewer than a block.
+bool scanBlocks(const char *data, size_t size, char lo, char stop, bool asciiOnly, size_t &pos) {
+    const Block loV = splat(lo);
+    const Block delV = splat(127);
+    const Block stopV = splat(stop);
+    for (pos = 0; pos + blockSize <= size; pos += blockSize) {
+        Block x = load(data + pos);
+        uint32_t stops = ~bits(atLeast(x, loV)) | bits(equal(x, delV)) | bits(equal(x, stopV));
+        if (asciiOnly) {
+            stops |= bits(x);
+        }
+        if (blockSize == 16) {
+            stops &= 0xffff;
+        }
+        if (stops) {
+            pos += firstBit(stops);
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif
+
+}  // namespace
+
+size_t scanTokenScalar(const char *data, size_t size) {
+    return scanScalar(data, size, token_char);
+}
+
+size_t scanUriScalar(const char *data, size_t size) {
+    return scanScalar(data, size, uri_char);
+}
+
+size_t scanFieldValueScalar(const char *data, size_t size) {
+    return scanScalar(data, size, value_char);
+}
+
+#if defined(BEAUTY_SCAN_AVX2) || defined(BEAUTY_SCAN_SSE2)
+
+size_t scanToken(const char *data, size_t size) {
+    // Methods and header names are short, blocks don't pay off.
+    return scanTokenScalar(data, size);
+}
+
+size_t scanUri(const char *data, size_t size) {
+    // Most tokens end within the first block, which the table finds faster.
+    size_t pos = scanUriScalar(data, std::min(size, blockSize));
+    if (pos < blockSize) {
+        return pos;
+    }
+    size_t blocksPos = 0;
+    if (scanBlocks(data + pos, size - pos, '!', 127, false, blocksPos)) {
+        return pos + blocksPos;
+    }
+    pos += blocksPos;
+    return pos + scanUriScalar(data + pos, size - pos);
+}
+
+size_t scanFieldValue(const char *data, size_t size) {
+    size_t pos = scanFieldValueScalar(data, std::min(size, blockSize));
+    if (pos < blockSize) {
+        return pos;
+    }
+    size_t blocksPos = 0;
+    if (scanBlocks(data + pos, size - pos, ' ', 127, false, blocksPos)) {
+        return pos + blocksPos;
+    }
+    pos += blocksPos;
+    return pos + scanFieldValueScalar(data + pos, size - pos);
+}
+
+#else
+
+size_t scanToken(const char *data, size_t size) {
+    return scanTokenScalar(data, size);
+}
+
+size_t scanUri(const char *data, size_t size) {
+    return scanUriScalar(data, size);
+}
+
+size_t scanFieldValue(const char *data, size_t size) {
+    return scanFieldValueScalar(data, size);
+}
+
+#endif
+
+}  // namespace beauty
@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "beauty/chunked_decoder.hpp"
+#include "beauty/parse_common.hpp"
+
+namespace beauty {
+
+namespace {
+// Max bytes of a chunk size line (with extensions) and of the trailers.
+const size_t maxSizeLineLength = 1024;
+const size_t maxTrailerLength = 8192;
+
+// Value of a hex digit, or -1 if not one.
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+}  // namespace
+
+ChunkedDecoder::ChunkedDecoder()
+    : state_(chunk_size_start), maxChunkSize_(std::numeric_limits<size_t>::max()) {}
+
+void ChunkedDecoder::reset() {
+    state_ = chunk_size_start;
+    chunkSize_ = 0;
+    lineLength_ = 0;
+}
+
+void ChunkedDecoder::setMaxChunkSize(size_t maxChunkSize) {
+    maxChunkSize_ = maxChunkSize;
+}
+
+ChunkedDecoder::result_type ChunkedDecoder::decode(char *data,
+                                                   size_t size,
+                                                   size_t &bodySize,
+                                                   size_t &consumed) {
+    bodySize = 0;
+    size_t pos = 0;
+    while (pos < size) {
+        if (state_ == chunk_data) {
+            // Chunk data is moved over the framing preceding it.
+            size_t n = std::min(chunkSize_, size - pos);
+            std::memmove(data + bodySize, data + pos, n);
+            bodySize += n;
+            pos += n;
+            chunkSize_ -= n;
+            if (chunkSize_ == 0) {
+                state_ = chunk_data_cr;
+            }
+            continue;
+        }
+
+        char input = data[pos++];
+        switch (state_) {
+            case chunk_size_start:
+            case chunk_size: {
+                int digit = hexValue(input);
+                if (digit >= 0) {
+                    if (static_cast<size_t>(digit) > maxChunkSize_ ||
+                        chunkSize_ > (maxChunkSize_ - digit) / 16) {
+                        return chunk_too_large;
+                    }
+                    chunkSize_ = chunkSize_ * 16 + digit;
+                    state_ = chunk_size;
+                } else if (state_ == chunk_size_start) {
+                    return bad;
+                } else if (input == '\r') {
+                    state_ = chunk_size_newline;
+                } else if (input == ';' || input == ' ' || input == '\t') {
+                    state_ = chunk_extension;
+                } else {
+                    return bad;
+                }
+                break;
+            }
+            case chunk_extension:
+                if (input == '\r') {
+                    state_ = chunk_size_newline;
+                } else if (isCtl(input) && input != '\t') {
+                    return bad;
+                }
+                break;
+            case chunk_size_newline:
+                if (input != '\n') {
+                    return bad;
+                }
+                lineLength_ = 0;
+                state_ = chunkSize_ == 0 ? trailer_line_start : chunk_data;
+                continue;
+            case chunk_data_cr:
+                if (input != '\r') {
+                    return bad;
+                }
+                state_ = chunk_data_newline;
+                continue;
+            case chunk_data_newline:
+                if (input != '\n') {
+                    return bad;
+                }
+                lineLength_ = 0;
+                state_ = chunk_size_start;
+                continue;
+            case trailer_line_start:
+                if (input == '\r') {
+                    state_ = last_newline;
+                    continue;
+                }
+                state_ = trailer_line;
+                break;
+            case trailer_line:
+                if (input == '\r') {
+                    state_ = trailer_newline;
+                } else if (isCtl(input) && input != '\t') {
+                    return bad;
+                }
+                break;
+            case trailer_newline:
+                if (input != '\n') {
+                    return bad;
+                }
+                state_ = trailer_line_start;
+                break;
+            case last_newline:
+                if (input != '\n') {
+                    return bad;
+                }
+                consumed = pos;
+                return done;
+            default:
+                return bad;
+        }
+
+        // Size lines and trailers are bounded, as they are not kept anyway.
+        ++lineLength_;
+        if (lineLength_ > (state_ < chunk_size_newline ? maxSizeLineLength : maxTrailerLength)) {
+            return bad;
+        }
+    }
+
+    consumed = size;
+    return indeterminate;
+}
+
+}  // namespace beauty
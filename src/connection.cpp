@@ -6,36 +6,98 @@
 #include "beauty/connection.hpp"
 #include "beauty/ws_endpoint.hpp"
 
+#if defined(BEAUTY_HAS_SENDFILE)
+#include <sys/sendfile.h>
+#endif
+
+#if defined(BEAUTY_HAS_SPLICE)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 namespace beauty {
 
+namespace {
+const char connectionCloseHeader[] = "Connection: close\r\n";
+
+#if defined(BEAUTY_HAS_SENDFILE)
+// Max bytes sent with sendfile() before letting other connections run.
+const size_t maxSendFileBytesPerTurn = 256 * 1024;
+#endif
+
+#if defined(BEAUTY_HAS_SPLICE)
+// Max bytes moved with splice() before letting other connections run.
+const size_t maxSpliceBytesPerTurn = 256 * 1024;
+#endif
+
+#if defined(TCP_CORK)
+typedef asio::detail::socket_option::boolean<IPPROTO_TCP, TCP_CORK> tcp_cork;
+#endif
+}  // namespace
+
 Connection::Connection(asio::ip::tcp::socket socket,
                        ConnectionManager& manager,
                        RequestHandler& handler,
                        unsigned connectionId,
-                       size_t maxContentSize)
+                       size_t maxContentSize,
+                       std::shared_ptr<BufferPool> bufferPool)
     : socket_(std::move(socket)),
       connectionManager_(manager),
       requestHandler_(handler),
       connectionId_(connectionId),
+      connectionIdStr_(std::to_string(connectionId)),
       maxContentSize_(maxContentSize),
-      recvBuffer_(maxContentSize),
-      sendBuffer_(maxContentSize),
+      bufferPool_(std::move(bufferPool)),
       request_(recvBuffer_),
       reply_(sendBuffer_),
       wsEncoder_(sendBuffer_),
+      timerEntry_(this),
       wsMessage_(recvBuffer_),
       wsParser_(wsMessage_),
       writeInProgress_(false) {}
 
+Connection::~Connection() {
+    bufferPool_->release(recvBuffer_);
+    bufferPool_->release(sendBuffer_);
+    bufferPool_->release(pipelineBuffer_);
+    bufferPool_->release(coalesceBuffer_);
+    bufferPool_->release(readAheadBuffer_);
+    for (auto &buf : sendWindow_) {
+        bufferPool_->release(buf);
+    }
+    closeSplicePipe();
+}
+
 void Connection::start(bool useKeepAlive,
-                       std::chrono::seconds keepAliveTimeout,
-                       size_t keepAliveMax) {
-    lastActivityTime_ = std::chrono::steady_clock::now();
+                       std::chrono::milliseconds keepAliveTimeout,
+                       size_t keepAliveMax,
+                       bool waitReadableWhenIdle,
+                       bool headerViewsOnly,
+                       bool tcpNoDelay,
+                       bool tcpCork,
+                       size_t sendWindowParts,
+                       size_t maxChunkSize) {
+    lastActivityTime_ = connectionManager_.now();
     lastReceivedTime_ = lastActivityTime_;
     useKeepAlive_ = useKeepAlive;
     keepAliveTimeout_ = keepAliveTimeout;
     keepAliveMax_ = keepAliveMax;
-    doRead();
+    waitReadableWhenIdle_ = waitReadableWhenIdle;
+    sendWindow_.resize(sendWindowParts > 1 ? sendWindowParts - 1 : 0);
+    requestParser_.setHeaderViewsOnly(headerViewsOnly);
+    requestParser_.setMaxChunkSize(maxChunkSize);
+    if (tcpNoDelay) {
+        std::error_code ignored_ec;
+        socket_.set_option(asio::ip::tcp::no_delay(true), ignored_ec);
+    }
+#if defined(TCP_CORK)
+    useCork_ = tcpCork;
+#else
+    if (tcpCork) {
+        connectionManager_.debugMsg("TCP_CORK is not supported on this platform");
+    }
+#endif
+    doReadIdle();
 }
 
 void Connection::stop() {
@@ -78,6 +140,10 @@ WsEndpoint* Connection::getWsEndpoint() const {
     return wsEndpoint_;
 }
 
+TimingWheel<Connection>::Entry& Connection::getTimerEntry() {
+    return timerEntry_;
+}
+
 bool Connection::isWriteInProgress() const {
     return writeInProgress_;
 }
@@ -86,8 +152,9 @@ void Connection::sendWsPing() {
     if (!isWebSocket_) {
         return;
     }
+    bufferPool_->acquire(sendBuffer_);
     wsEncoder_.encodePingFrame();
-    lastPingTime_ = std::chrono::steady_clock::now();
+    lastPingTime_ = connectionManager_.now();
     doWriteWsFrame(false, nullptr);
 }
 
@@ -99,6 +166,7 @@ WriteResult Connection::sendWsText(const std::string& message, WriteCompleteCall
         return WriteResult::WRITE_IN_PROGRESS;
     }
 
+    bufferPool_->acquire(sendBuffer_);
     wsEncoder_.encodeTextFrame(message);
     doWriteWsFrame(false, callback);
     return WriteResult::SUCCESS;
@@ -113,6 +181,7 @@ WriteResult Connection::sendWsBinary(const std::vector<char>& data,
         return WriteResult::WRITE_IN_PROGRESS;
     }
 
+    bufferPool_->acquire(sendBuffer_);
     wsEncoder_.encodeBinaryFrame(data);
     doWriteWsFrame(false, callback);
     return WriteResult::SUCCESS;
@@ -128,21 +197,57 @@ WriteResult Connection::sendWsClose(uint16_t statusCode,
         return WriteResult::WRITE_IN_PROGRESS;
     }
 
+    bufferPool_->acquire(sendBuffer_);
     wsEncoder_.encodeCloseFrame(statusCode, reason);
     doWriteWsFrame(false, callback);
     return WriteResult::SUCCESS;
 }
 
+void Connection::doReadIdle() {
+    if (waitReadableWhenIdle_) {
+        doWaitReadable();
+    } else {
+        doRead();
+    }
+}
+
+void Connection::doWaitReadable() {
+    // Any previously received data has been consumed at this point, so the
+    // buffer can be returned while the peer is silent.
+    bufferPool_->release(recvBuffer_);
+    std::vector<char>().swap(headerBuffer_);
+    auto self(shared_from_this());
+    socket_.async_wait(asio::ip::tcp::socket::wait_read, [this, self](std::error_code ec) {
+        if (!ec) {
+            // Also taken on peer close, the read below then reports the error.
+            doRead();
+        } else if (ec != asio::error::operation_aborted) {
+            connectionManager_.debugMsg("doWaitReadable: " + ec.message() + ':' +
+                                        std::to_string(ec.value()));
+            if (isWebSocket_ && wsEndpoint_) {
+                wsEndpoint_->onWsError(connectionIdStr_, "Read error: " + ec.message());
+            }
+            connectionManager_.stop(shared_from_this());
+        }
+    });
+}
+
 void Connection::doRead() {
+    if (!coalesceBuffer_.empty()) {
+        // Answer earlier pipelined requests before waiting for more data
+        doWriteCoalesced(&Connection::doRead);
+        return;
+    }
     auto self(shared_from_this());
     // Asio uses recvBuffer_.size() to limit amount of read data so must restore
     // size before reading. Note: operation is "cheap" as maxContentSize is
     // already reserved.
+    bufferPool_->acquire(recvBuffer_);
     recvBuffer_.resize(maxContentSize_);
     socket_.async_read_some(
         asio::buffer(recvBuffer_), [this, self](std::error_code ec, std::size_t bytesTransferred) {
             if (!ec) {
-                lastActivityTime_ = std::chrono::steady_clock::now();
+                lastActivityTime_ = connectionManager_.now();
                 recvBuffer_.resize(bytesTransferred);
                 if (isWebSocket_) {
                     wsMessage_.reset();
@@ -150,149 +255,45 @@ void Connection::doRead() {
                     if (result == WsParser::indeterminate || result == WsParser::data_frame) {
                         lastReceivedTime_ = lastActivityTime_;
                         if (wsEndpoint_) {
-                            wsEndpoint_->onWsMessage(std::to_string(connectionId_), wsMessage_);
+                            wsEndpoint_->onWsMessage(connectionIdStr_, wsMessage_);
                         }
-                        doRead();
+                        doReadIdle();
                     } else if (result == WsParser::close_frame) {
                         // Client closed the connection
                         if (wsEndpoint_) {
-                            wsEndpoint_->onWsClose(std::to_string(connectionId_));
+                            wsEndpoint_->onWsClose(connectionIdStr_);
                         }
                         connectionManager_.stop(shared_from_this());
                     } else if (result == WsParser::ping_frame) {
                         // Respond with pong
                         lastReceivedTime_ = lastActivityTime_;
+                        bufferPool_->acquire(sendBuffer_);
                         wsEncoder_.encodePongFrame(wsMessage_.content_);
                         doWriteWsFrame(true, nullptr);  // Continue reading after pong is sent
                     } else if (result == WsParser::pong_frame) {
                         lastPongTime_ = lastActivityTime_;
-                        doRead();
+                        doReadIdle();
                     } else if (result == WsParser::fragmentation_error) {
                         // Fragmented messages are not supported
                         if (wsEndpoint_) {
-                            wsEndpoint_->onWsError(std::to_string(connectionId_),
+                            wsEndpoint_->onWsError(connectionIdStr_,
                                                    "Fragmented messages are not supported");
                         }
                         // Send close frame and stop connection
+                        bufferPool_->acquire(sendBuffer_);
                         wsEncoder_.encodeCloseFrame(1003, "Fragmented messages not supported");
                         doWriteWsFrame(false, nullptr);
                         connectionManager_.stop(shared_from_this());
                     }
                 } else {
-                    RequestParser::result_type result = requestParser_.parse(request_, recvBuffer_);
-
-                    if (result == RequestParser::good_complete) {
-                        if (requestDecoder_.decodeRequest(request_, recvBuffer_)) {
-                            requestHandler_.handleRequest(
-                                connectionId_, request_, recvBuffer_, reply_);
-                            doWriteHeaders();
-                        } else {
-                            reply_.stockReply(request_, Reply::bad_request);
-                            doWriteHeaders();
-                        }
-                    } else if (result == RequestParser::good_headers_expect_continue) {
-                        if (requestDecoder_.decodeRequest(request_, recvBuffer_)) {
-                            if (request_.contentLength_ > maxContentSize_) {
-                                bool isMultipart = MultiPartParser::isMultipartRequest(request_);
-
-                                if (!isMultipart) {
-                                    // By design Beauty only supports large body data
-                                    // uploads using multipart/form-data. It will not
-                                    // allocate buffer > maxContentSize_ for non-multipart data
-                                    reply_.stockReply(request_, Reply::payload_too_large);
-                                    doWriteHeaders();
-                                    return;
-                                }
-                            }
-
-                            // Check if the application wants to continue with this request
-                            requestHandler_.shouldContinueAfterHeaders(request_, reply_);
-                            if (reply_.isStatusOk()) {
-                                doWrite100Continue();
-                            } else {
-                                // Application rejected the request, send its reply
-                                reply_.addHeader("Connection", "close");
-                                doWriteHeaders();
-                            }
-                        } else {
-                            reply_.stockReply(request_, Reply::bad_request);
-                            doWriteHeaders();
-                        }
-                    } else if (result == RequestParser::expect_continue_with_body) {
-                        // Parser detected 100-continue protocol violation: client sent Expect
-                        // header with body data without waiting for 100 Continue response
-                        reply_.stockReply(request_, Reply::expectation_failed);
-                        doWriteHeaders();
-                    } else if (result == RequestParser::good_part) {
-                        // Determine if this is multipart without processing the request yet
-                        // (since we have incomplete body data)
-                        bool isMultipart = MultiPartParser::isMultipartRequest(request_);
-                        if (!isMultipart) {
-                            if (request_.contentLength_ > maxContentSize_) {
-                                // By design Beauty only supports large body data
-                                // uploads using multipart/form-data. It will not
-                                // allocate buffer > maxContentSize_ for non-multipart data
-                                reply_.stockReply(request_, Reply::payload_too_large);
-                                doWriteHeaders();
-                                return;
-                            } else if (request_.contentLength_ > 0) {
-                                // If we haven't received all body bytes yet, but expect some,
-                                // we need to wait for more data
-                                doRead();
-                                return;
-                            }
-                        }
-
-                        if (requestDecoder_.decodeRequest(request_, recvBuffer_)) {
-                            reply_.noBodyBytesReceived_ = request_.getNoInitialBodyBytesReceived();
-
-                            // Call handleRequest normally - it will set up multipart state and
-                            // process initial chunk
-                            requestHandler_.handleRequest(
-                                connectionId_, request_, recvBuffer_, reply_);
-                            // Provide an early response to client if an error occurred
-                            if (!reply_.isStatusOk()) {
-                                reply_.addHeader("Connection", "close");
-                                doWriteHeaders();
-                                return;
-                            }
-
-                            doReadBody();
-                        } else {
-                            reply_.stockReply(request_, Reply::bad_request);
-                            doWriteHeaders();
-                        }
-                    } else if (result == RequestParser::upgrade_to_websocket) {
-                        requestDecoder_.decodeRequest(request_, recvBuffer_);
-                        // Look up WebSocket endpoint based on requested path
-                        wsEndpoint_ =
-                            connectionManager_.getWsEndpointForPath(request_.requestPath_);
-                        if (wsEndpoint_ == nullptr) {
-                            // No WebSocket endpoint available for this path
-                            reply_.stockReply(request_, Reply::bad_request);
-                            doWriteHeaders();
-                            return;
-                        }
-                        handleUpgradeToWebSocket();
-                    } else if (result == RequestParser::missing_content_length) {
-                        reply_.stockReply(request_, Reply::length_required);
-                        doWriteHeaders();
-                    } else if (result == RequestParser::version_not_supported) {
-                        reply_.stockReply(request_, Reply::status_type::version_not_supported);
-                        doWriteHeaders();
-                    } else if (result == RequestParser::bad) {
-                        reply_.stockReply(request_, Reply::bad_request);
-                        doWriteHeaders();
-                    } else {
-                        doRead();
-                    }
+                    handleRequestData();
                 }
             } else if (ec != asio::error::operation_aborted) {
                 connectionManager_.debugMsg("doRead: " + ec.message() + ':' +
                                             std::to_string(ec.value()));
                 // Notify WebSocket endpoint of error if this is a WebSocket connection
                 if (isWebSocket_ && wsEndpoint_) {
-                    wsEndpoint_->onWsError(std::to_string(connectionId_),
+                    wsEndpoint_->onWsError(connectionIdStr_,
                                            "Read error: " + ec.message());
                 }
                 connectionManager_.stop(shared_from_this());
@@ -300,23 +301,159 @@ void Connection::doRead() {
         });
 }
 
+void Connection::handleRequestData() {
+    // The reply is built in the send buffer while handling the request
+    bufferPool_->acquire(sendBuffer_);
+    RequestParser::result_type result = requestParser_.parse(request_, recvBuffer_);
+
+    if (result == RequestParser::good_complete) {
+        if (requestParser_.getUnconsumedSize() > 0) {
+            // Keep pipelined requests until this one has been answered
+            bufferPool_->acquire(pipelineBuffer_);
+            requestParser_.takeUnconsumed(pipelineBuffer_);
+        }
+        if (requestDecoder_.decodeRequest(request_, recvBuffer_)) {
+            reply_.noBodyBytesReceived_ = request_.getNoInitialBodyBytesReceived();
+            requestHandler_.handleRequest(connectionId_, request_, recvBuffer_, reply_);
+            doWriteHeaders();
+        } else {
+            reply_.stockReply(request_, Reply::bad_request);
+            doWriteHeaders();
+        }
+    } else if (result == RequestParser::good_headers_expect_continue) {
+        if (requestDecoder_.decodeRequest(request_, recvBuffer_)) {
+            if (!request_.isChunked_ && request_.contentLength_ > maxContentSize_) {
+                bool isMultipart = MultiPartParser::isMultipartRequest(request_);
+
+                if (!isMultipart && !requestHandler_.isRawUpload(request_)) {
+                    // By design Beauty only supports large body data
+                    // uploads using multipart/form-data. It will not
+                    // allocate buffer > maxContentSize_ for non-multipart data
+                    reply_.stockReply(request_, Reply::payload_too_large);
+                    doWriteHeaders();
+                    return;
+                }
+            }
+
+            // Check if the application wants to continue with this request
+            requestHandler_.shouldContinueAfterHeaders(request_, reply_);
+            if (reply_.isStatusOk()) {
+                doWrite100Continue();
+            } else {
+                // Application rejected the request, send its reply
+                reply_.addHeader("Connection", "close");
+                doWriteHeaders();
+            }
+        } else {
+            reply_.stockReply(request_, Reply::bad_request);
+            doWriteHeaders();
+        }
+    } else if (result == RequestParser::expect_continue_with_body) {
+        // Parser detected 100-continue protocol violation: client sent Expect
+        // header with body data without waiting for 100 Continue response
+        reply_.stockReply(request_, Reply::expectation_failed);
+        doWriteHeaders();
+    } else if (result == RequestParser::good_part) {
+        // Determine how to read the body without processing the request yet
+        // (since we have incomplete body data)
+        if (isCollectedBody()) {
+            if (request_.isChunked_) {
+                // Collected de-chunked, within the same limit as below
+                doCollectBody();
+                return;
+            } else if (request_.contentLength_ > maxContentSize_) {
+                // By design Beauty only supports large body data
+                // uploads using multipart/form-data. It will not
+                // allocate buffer > maxContentSize_ for non-multipart data
+                reply_.stockReply(request_, Reply::payload_too_large);
+                doWriteHeaders();
+                return;
+            } else if (request_.contentLength_ > 0) {
+                // If we haven't received all body bytes yet, but expect some,
+                // we need to wait for more data
+                doCollectBody();
+                return;
+            }
+        }
+
+        if (requestDecoder_.decodeRequest(request_, recvBuffer_)) {
+            reply_.noBodyBytesReceived_ = request_.getNoInitialBodyBytesReceived();
+
+            // Call handleRequest normally - it will set up multipart state and
+            // process initial chunk
+            requestHandler_.handleRequest(connectionId_, request_, recvBuffer_, reply_);
+            // Provide an early response to client if an error occurred
+            if (!reply_.isStatusOk()) {
+                reply_.addHeader("Connection", "close");
+                doWriteHeaders();
+                return;
+            }
+
+            if (!startSpliceBody()) {
+                doReadBody();
+            }
+        } else {
+            reply_.stockReply(request_, Reply::bad_request);
+            doWriteHeaders();
+        }
+    } else if (result == RequestParser::upgrade_to_websocket) {
+        requestDecoder_.decodeRequest(request_, recvBuffer_);
+        // Look up WebSocket endpoint based on requested path
+        wsEndpoint_ = connectionManager_.getWsEndpointForPath(request_.requestPath_);
+        if (wsEndpoint_ == nullptr) {
+            // No WebSocket endpoint available for this path
+            reply_.stockReply(request_, Reply::bad_request);
+            doWriteHeaders();
+            return;
+        }
+        handleUpgradeToWebSocket();
+    } else if (result == RequestParser::missing_content_length) {
+        reply_.stockReply(request_, Reply::length_required);
+        doWriteHeaders();
+    } else if (result == RequestParser::payload_too_large) {
+        reply_.stockReply(request_, Reply::payload_too_large);
+        doWriteHeaders();
+    } else if (result == RequestParser::version_not_supported) {
+        reply_.stockReply(request_, Reply::status_type::version_not_supported);
+        doWriteHeaders();
+    } else if (result == RequestParser::bad) {
+        reply_.stockReply(request_, Reply::bad_request);
+        doWriteHeaders();
+    } else {
+        doRead();
+    }
+}
+
 void Connection::doReadBody() {
+    if (!coalesceBuffer_.empty()) {
+        doWriteCoalesced(&Connection::doReadBody);
+        return;
+    }
     recvBuffer_.resize(maxContentSize_);
     auto self(shared_from_this());
     socket_.async_read_some(
         asio::buffer(recvBuffer_), [this, self](std::error_code ec, std::size_t bytesTransferred) {
             if (!ec) {
-                lastActivityTime_ = std::chrono::steady_clock::now();
+                lastActivityTime_ = connectionManager_.now();
                 lastReceivedTime_ = lastActivityTime_;
                 recvBuffer_.resize(bytesTransferred);
-                reply_.noBodyBytesReceived_ += bytesTransferred;
+                bool complete = false;
+                if (request_.isChunked_ && !dechunkBody(0, complete)) {
+                    return;
+                }
+                reply_.noBodyBytesReceived_ += recvBuffer_.size();
+                if (complete) {
+                    // The size of a chunked body is known with its last chunk
+                    request_.contentLength_ = reply_.noBodyBytesReceived_;
+                }
+                complete = reply_.noBodyBytesReceived_ >= request_.contentLength_;
 
                 // Process more body data using handleFileIOWrite as this is the only
                 // supported mode to handle additional body data after initial
                 // request processing.
                 requestHandler_.handleFileIOWrite(connectionId_, request_, recvBuffer_, reply_);
 
-                if (reply_.noBodyBytesReceived_ < request_.contentLength_) {
+                if (!complete) {
                     // Provide an early response to client if an error occurred
                     if (!reply_.isStatusOk()) {
                         reply_.addHeader("Connection", "close");
@@ -329,6 +466,9 @@ void Connection::doReadBody() {
                     doWriteHeaders();
                 }
             } else if (ec != asio::error::operation_aborted) {
+                // Keep what has been received of an upload
+                requestHandler_.flushUpload(request_, reply_);
+                requestHandler_.closeRawUpload(request_, reply_);
                 connectionManager_.debugMsg("doReadBody: " + ec.message() + ':' +
                                             std::to_string(ec.value()));
                 connectionManager_.stop(shared_from_this());
@@ -336,103 +476,515 @@ void Connection::doReadBody() {
         });
 }
 
-void Connection::doWriteHeaders() {
-    handleConnection();
+void Connection::doCollectBody() {
+    if (!coalesceBuffer_.empty()) {
+        doWriteCoalesced(&Connection::doCollectBody);
+        return;
+    }
+    // Read after the body received so far, which must fit in maxContentSize_.
+    size_t bodySize = recvBuffer_.size();
+    if (bodySize >= maxContentSize_) {
+        reply_.stockReply(request_, Reply::payload_too_large);
+        doWriteHeaders();
+        return;
+    }
+    recvBuffer_.resize(maxContentSize_);
     auto self(shared_from_this());
-    asio::async_write(
-        socket_, reply_.headerToBuffers(), [this, self](std::error_code ec, std::size_t) {
+    socket_.async_read_some(
+        asio::buffer(&recvBuffer_[bodySize], maxContentSize_ - bodySize),
+        [this, self, bodySize](std::error_code ec, std::size_t bytesTransferred) {
             if (!ec) {
-                lastActivityTime_ = std::chrono::steady_clock::now();
+                lastActivityTime_ = connectionManager_.now();
+                lastReceivedTime_ = lastActivityTime_;
+                recvBuffer_.resize(bodySize + bytesTransferred);
+                bool complete = false;
+                if (request_.isChunked_) {
+                    if (!dechunkBody(bodySize, complete)) {
+                        return;
+                    }
+                } else {
+                    complete = recvBuffer_.size() >= request_.contentLength_;
+                    if (recvBuffer_.size() > request_.contentLength_) {
+                        // Keep pipelined requests until this one has been answered
+                        bufferPool_->acquire(pipelineBuffer_);
+                        pipelineBuffer_.assign(recvBuffer_.begin() + request_.contentLength_,
+                                               recvBuffer_.end());
+                        recvBuffer_.resize(request_.contentLength_);
+                    }
+                }
+                if (!complete) {
+                    doCollectBody();
+                    return;
+                }
+                request_.contentLength_ = recvBuffer_.size();
 
-                if (!reply_.content_.empty() || reply_.contentPtr_ != nullptr ||
-                    reply_.streamCallback_ != nullptr) {
-                    doWriteReplyContent();
+                // The request has already been decoded if the body followed a
+                // 100 Continue.
+                if (firstBodyReadAfter100Continue_ &&
+                    !requestDecoder_.decodeRequest(request_, recvBuffer_)) {
+                    reply_.stockReply(request_, Reply::bad_request);
                 } else {
-                    handleWriteCompleted();
+                    requestHandler_.handleRequest(connectionId_, request_, recvBuffer_, reply_);
                 }
-            } else {
-                connectionManager_.debugMsg("doWriteHeaders: " + ec.message() + ':' +
+                doWriteHeaders();
+            } else if (ec != asio::error::operation_aborted) {
+                connectionManager_.debugMsg("doCollectBody: " + ec.message() + ':' +
                                             std::to_string(ec.value()));
-                shutdown();
+                connectionManager_.stop(shared_from_this());
             }
         });
 }
 
+bool Connection::isCollectedBody() const {
+    // Raw uploads are only streamed when they cannot be collected, so that
+    // request handlers get whole bodies otherwise
+    return !MultiPartParser::isMultipartRequest(request_) &&
+           !((request_.isChunked_ || request_.contentLength_ > maxContentSize_) &&
+             requestHandler_.isRawUpload(request_));
+}
+
+bool Connection::dechunkBody(size_t offset, bool &complete) {
+    RequestParser::result_type result = requestParser_.parseChunked(recvBuffer_, offset);
+    if (result == RequestParser::bad || result == RequestParser::payload_too_large) {
+        reply_.stockReply(request_,
+                          result == RequestParser::bad ? Reply::bad_request
+                                                       : Reply::payload_too_large);
+        doWriteHeaders();
+        return false;
+    }
+
+    complete = result == RequestParser::good_complete;
+    if (complete && requestParser_.getUnconsumedSize() > 0) {
+        // Keep pipelined requests until this one has been answered
+        bufferPool_->acquire(pipelineBuffer_);
+        requestParser_.takeUnconsumed(pipelineBuffer_);
+    }
+    return true;
+}
+
+bool Connection::startSpliceBody() {
+#if defined(BEAUTY_HAS_SPLICE)
+    if (!reply_.isRawUpload_ || request_.isChunked_ || !coalesceBuffer_.empty() ||
+        !requestHandler_.getNativeWriteFile(reply_, spliceFile_)) {
+        return false;
+    }
+    if (::pipe2(splicePipe_, O_CLOEXEC) != 0) {
+        splicePipe_[0] = -1;
+        splicePipe_[1] = -1;
+        return false;
+    }
+    // Not needed until the next request
+    bufferPool_->release(recvBuffer_);
+    doSpliceBody();
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Connection::doSpliceBody() {
+#if defined(BEAUTY_HAS_SPLICE)
+    std::error_code error;
+    socket_.native_non_blocking(true, error);
+
+    // Bound the bytes moved per turn, to let other connections make progress
+    // when the client sends as fast as the file is written
+    size_t budget = maxSpliceBytesPerTurn;
+    size_t left = request_.contentLength_ - reply_.noBodyBytesReceived_;
+    while (!error && left > 0 && budget > 0) {
+        ssize_t n = ::splice(socket_.native_handle(),
+                             nullptr,
+                             splicePipe_[1],
+                             nullptr,
+                             std::min(left, budget),
+                             SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            // Empty the pipe into the file before reading more
+            size_t inPipe = n;
+            while (!error && inPipe > 0) {
+                off_t offset = static_cast<off_t>(spliceFile_.offset_);
+                ssize_t m = ::splice(
+                    splicePipe_[0], nullptr, spliceFile_.fd_, &offset, inPipe, SPLICE_F_MOVE);
+                if (m > 0) {
+                    spliceFile_.offset_ += m;
+                    inPipe -= m;
+                } else if (m == 0 || errno != EINTR) {
+                    error = std::error_code(m == 0 ? EIO : errno,
+                                            asio::error::get_system_category());
+                }
+            }
+            reply_.noBodyBytesReceived_ += n;
+            left -= n;
+            budget -= std::min(budget, static_cast<size_t>(n));
+            lastActivityTime_ = connectionManager_.now();
+            lastReceivedTime_ = lastActivityTime_;
+        } else if (n == 0) {
+            // The client closed the connection before sending all of the body
+            error = asio::error::eof;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            auto self(shared_from_this());
+            socket_.async_wait(asio::ip::tcp::socket::wait_read, [this, self](std::error_code ec) {
+                if (!ec) {
+                    doSpliceBody();
+                } else if (ec != asio::error::operation_aborted) {
+                    connectionManager_.debugMsg("doSpliceBody: " + ec.message() + ':' +
+                                                std::to_string(ec.value()));
+                    closeSplicePipe();
+                    requestHandler_.closeRawUpload(request_, reply_);
+                    connectionManager_.stop(shared_from_this());
+                }
+            });
+            return;
+        } else if (errno != EINTR) {
+            error = std::error_code(errno, asio::error::get_system_category());
+        }
+    }
+
+    if (error) {
+        connectionManager_.debugMsg("doSpliceBody: " + error.message() + ':' +
+                                    std::to_string(error.value()));
+        closeSplicePipe();
+        requestHandler_.closeRawUpload(request_, reply_);
+        connectionManager_.stop(shared_from_this());
+    } else if (left > 0) {
+        auto self(shared_from_this());
+        asio::post(socket_.get_executor(), [this, self]() { doSpliceBody(); });
+    } else {
+        closeSplicePipe();
+        // Let the FileIO complete the file, and the reply
+        requestHandler_.handleFileIOWrite(connectionId_, request_, recvBuffer_, reply_);
+        doWriteHeaders();
+    }
+#endif
+}
+
+void Connection::closeSplicePipe() {
+#if defined(BEAUTY_HAS_SPLICE)
+    for (int &fd : splicePipe_) {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+#endif
+    spliceFile_ = NativeWriteFile();
+}
+
+void Connection::doWriteHeaders() {
+    requestHandler_.compressReply(connectionId_, request_, reply_);
+    handleConnection();
+    if (coalesceReply()) {
+        // Post to not recurse through a long run of pipelined requests
+        auto self(shared_from_this());
+        asio::post(socket_.get_executor(), [this, self]() { handleWriteCompleted(); });
+        return;
+    }
+    // Earlier coalesced replies, the headers and the first content chunk go
+    // out in the same write
+    std::vector<asio::const_buffer> buffers;
+    if (!coalesceBuffer_.empty()) {
+        buffers.push_back(asio::buffer(coalesceBuffer_));
+    }
+    if (reply_.replyPartial_) {
+        // Hold back partial segments until the final part has been written
+        setCork(true);
+    }
+    bool hasContent = false;
+    if (reply_.isStockReply()) {
+        stockReplyToBuffers(buffers);
+    } else {
+        hasContent = !reply_.content_.empty() || reply_.contentPtr_ != nullptr ||
+                     reply_.streamCallback_ != nullptr;
+        headerBuffer_.clear();
+        renderReplyHeaders(headerBuffer_);
+        // Streamed replies produce their first chunk now, to go with the headers
+        requestHandler_.handleStreamingRead(connectionId_, reply_);
+
+        buffers.push_back(asio::buffer(headerBuffer_));
+        if (reply_.replyPartial_ && !reply_.finalPart_) {
+            startReadAhead();
+        }
+        if (hasContent) {
+            fillSendWindow(buffers);
+        }
+    }
+    auto self(shared_from_this());
+    asio::async_write(socket_, buffers, [this, self, hasContent](std::error_code ec, std::size_t) {
+        bufferPool_->release(coalesceBuffer_);
+        if (!ec) {
+            lastActivityTime_ = connectionManager_.now();
+
+            if (reply_.nativeFile_.fd_ >= 0) {
+                doSendFile();
+            } else if (hasContent) {
+                handleReplyContentWritten();
+            } else {
+                handleWriteCompleted();
+            }
+        } else {
+            connectionManager_.debugMsg("doWriteHeaders: " + ec.message() + ':' +
+                                        std::to_string(ec.value()));
+            shutdown();
+        }
+    });
+}
+
 void Connection::doWriteReplyContent() {
     auto self(shared_from_this());
 
     // Handle streaming callback before writing
     requestHandler_.handleStreamingRead(connectionId_, reply_);
+    std::vector<asio::const_buffer> buffers;
+    fillSendWindow(buffers);
 
-    asio::async_write(
-        socket_, reply_.contentToBuffers(), [this, self](std::error_code ec, std::size_t) {
-            if (!ec) {
-                lastActivityTime_ = std::chrono::steady_clock::now();
-
-                if (reply_.replyPartial_) {
-                    if (reply_.finalPart_) {
-                        handleWriteCompleted();
-                    } else {
-                        if (!reply_.streamCallback_) {
-                            // FileIO streaming
-                            requestHandler_.handleFileIORead(connectionId_, request_, reply_);
-                        }
-                        doWriteReplyContent();
-                    }
-                } else {
-                    handleWriteCompleted();
-                }
-            } else {
-                connectionManager_.debugMsg("doWriteReplyContent: " + ec.message() + ':' +
-                                            std::to_string(ec.value()));
-                shutdown();
+    asio::async_write(socket_, buffers, [this, self](std::error_code ec, std::size_t) {
+        if (!ec) {
+            lastActivityTime_ = connectionManager_.now();
+            handleReplyContentWritten();
+        } else {
+            connectionManager_.debugMsg("doWriteReplyContent: " + ec.message() + ':' +
+                                        std::to_string(ec.value()));
+            shutdown();
+        }
+    });
+}
+
+void Connection::handleReplyContentWritten() {
+    if (reply_.replyPartial_) {
+        if (reply_.finalPart_) {
+            handleWriteCompleted();
+        } else if (readAheadPending_) {
+            // Continued when the read is done
+            waitingForReadAhead_ = true;
+        } else if (readAheadDone_) {
+            writeReadAhead();
+        } else {
+            if (!reply_.streamCallback_) {
+                // FileIO streaming
+                requestHandler_.handleFileIORead(connectionId_, request_, reply_);
             }
+            doWriteReplyContent();
+        }
+    } else {
+        handleWriteCompleted();
+    }
+}
+
+void Connection::fillSendWindow(std::vector<asio::const_buffer> &buffers) {
+    // Parts are produced in sendBuffer_ (the reply content), so each one
+    // moves into the window before the next is produced. Compressed content
+    // is produced in a buffer of the reply, and asynchronous reads already
+    // overlap with the writes.
+    for (auto &part : sendWindow_) {
+        if (!reply_.replyPartial_ || reply_.finalPart_ || reply_.contentPtr_ != nullptr ||
+            reply_.compressor_ || reply_.nativeFile_.fd_ >= 0 || readAheadPending_ ||
+            readAheadDone_) {
+            break;
+        }
+        part.swap(sendBuffer_);
+        bufferPool_->acquire(sendBuffer_);
+        buffers.push_back(asio::buffer(part));
+        if (reply_.streamCallback_) {
+            requestHandler_.handleStreamingRead(connectionId_, reply_);
+        } else {
+            requestHandler_.handleFileIORead(connectionId_, request_, reply_);
+        }
+    }
+    auto content = reply_.contentToBuffers();
+    buffers.insert(buffers.end(), content.begin(), content.end());
+}
+
+void Connection::startReadAhead() {
+    bufferPool_->acquire(readAheadBuffer_);
+    auto self(shared_from_this());
+    readAheadPending_ = requestHandler_.readFileAhead(
+        connectionId_, request_, reply_, readAheadBuffer_, [this, self](int nrReadBytes) {
+            asio::post(socket_.get_executor(),
+                       [this, self, nrReadBytes]() { handleReadAhead(nrReadBytes); });
         });
+    if (!readAheadPending_) {
+        bufferPool_->release(readAheadBuffer_);
+    }
+}
+
+void Connection::handleReadAhead(int nrReadBytes) {
+    readAheadPending_ = false;
+    if (!socket_.is_open()) {
+        // Stopped while reading, the file was left open for the read
+        requestHandler_.closeFile(connectionId_);
+        return;
+    }
+    readAheadBytes_ = nrReadBytes;
+    readAheadDone_ = true;
+    if (waitingForReadAhead_) {
+        waitingForReadAhead_ = false;
+        writeReadAhead();
+    }
+}
+
+void Connection::writeReadAhead() {
+    readAheadDone_ = false;
+    requestHandler_.handleFileIOReadAhead(connectionId_, reply_, readAheadBuffer_, readAheadBytes_);
+    if (!reply_.finalPart_) {
+        startReadAhead();
+    } else {
+        bufferPool_->release(readAheadBuffer_);
+    }
+    doWriteReplyContent();
+}
+
+void Connection::doSendFile() {
+#if defined(BEAUTY_HAS_SENDFILE)
+    NativeReadFile &file = reply_.nativeFile_;
+    std::error_code error;
+    socket_.native_non_blocking(true, error);
+
+    // Bound the bytes sent per turn, to let other connections make progress
+    // when the client reads as fast as the file is sent
+    size_t budget = maxSendFileBytesPerTurn;
+    while (!error && file.length_ > 0 && budget > 0) {
+        off_t offset = static_cast<off_t>(file.offset_);
+        ssize_t n = ::sendfile(
+            socket_.native_handle(), file.fd_, &offset, std::min(file.length_, budget));
+        if (n > 0) {
+            file.offset_ += n;
+            file.length_ -= n;
+            budget -= std::min(budget, static_cast<size_t>(n));
+            lastActivityTime_ = connectionManager_.now();
+        } else if (n == 0) {
+            // The file is shorter than announced
+            error = asio::error::eof;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            auto self(shared_from_this());
+            socket_.async_wait(asio::ip::tcp::socket::wait_write,
+                               [this, self](std::error_code ec) {
+                                   if (!ec) {
+                                       doSendFile();
+                                   } else {
+                                       connectionManager_.debugMsg("doSendFile: " + ec.message() +
+                                                                   ':' +
+                                                                   std::to_string(ec.value()));
+                                       shutdown();
+                                   }
+                               });
+            return;
+        } else if (errno != EINTR) {
+            error = std::error_code(errno, asio::error::get_system_category());
+        }
+    }
+
+    if (error) {
+        connectionManager_.debugMsg("doSendFile: " + error.message() + ':' +
+                                    std::to_string(error.value()));
+        shutdown();
+    } else if (file.length_ > 0) {
+        auto self(shared_from_this());
+        asio::post(socket_.get_executor(), [this, self]() { doSendFile(); });
+    } else {
+        requestHandler_.closeFile(connectionId_);
+        handleWriteCompleted();
+    }
+#else
+    handleWriteCompleted();
+#endif
+}
+
+void Connection::renderReplyHeaders(std::vector<char>& out) {
+    reply_.renderHeaders(out);
+    out.insert(out.end(), connectionHeaders_.begin(), connectionHeaders_.end());
+    StringView date = connectionManager_.getDateHeader();
+    out.insert(out.end(), date.begin(), date.end());
+    out.push_back('\r');
+    out.push_back('\n');
+}
+
+void Connection::stockReplyToBuffers(std::vector<asio::const_buffer>& buffers) {
+    StringView stock = reply_.stockReply_;
+    StringView date = connectionManager_.getDateHeader();
+    if (date.empty()) {
+        buffers.push_back(asio::buffer(stock.data(), stock.size()));
+        return;
+    }
+    // The date changes while writing, so a copy goes between the prebuilt
+    // headers and the empty line
+    headerBuffer_.assign(date.begin(), date.end());
+    size_t headerSize = reply_.stockHeaderSize_;
+    buffers.push_back(asio::buffer(stock.data(), headerSize));
+    buffers.push_back(asio::buffer(headerBuffer_));
+    buffers.push_back(asio::buffer(stock.data() + headerSize, stock.size() - headerSize));
 }
 
 void Connection::handleConnection() {
     nrOfRequest_++;
 
+    // Stock replies are prebuilt with Connection: close
+    if (reply_.isStockReply()) {
+        connectionHeaders_ = StringView();
+        closeConnection_ = true;
+        return;
+    }
+
     // Check if server wants to close the connection
     auto it = std::find_if(reply_.headers_.begin(), reply_.headers_.end(), [](const Header& h) {
         return strcasecmp(h.name_.c_str(), "Connection") == 0 &&
                strcasecmp(h.value_.c_str(), "close") == 0;
     });
     if (it != reply_.headers_.end()) {
+        connectionHeaders_ = StringView();
         closeConnection_ = true;
         return;
     }
 
+    // The header lines below are pre-rendered, see renderReplyHeaders
+
     // Check if client wants to close the connection
     if (request_.keepAlive_ == false) {
-        reply_.addHeader("Connection", "close");
+        connectionHeaders_ = connectionCloseHeader;
         closeConnection_ = true;
         return;
     }
 
     // Check if we should use keep-alive
     if (useKeepAlive_) {
-        reply_.addHeader("Connection", "keep-alive");
-        reply_.addHeader("Keep-Alive",
-                         "timeout=" + std::to_string(keepAliveTimeout_.count()) +
-                             ", max=" + std::to_string(keepAliveMax_));
+        connectionHeaders_ = connectionManager_.getKeepAliveHeaders();
         return;
     }
 
     // Default in HTTP/1.1 is keep-alive, but if server does not want to use
     // it, we must close the connection here
-    reply_.addHeader("Connection", "close");
+    connectionHeaders_ = connectionCloseHeader;
     closeConnection_ = true;
 }
 
+void Connection::setCork(bool cork) {
+#if defined(TCP_CORK)
+    if (useCork_ && corked_ != cork) {
+        std::error_code ignored_ec;
+        socket_.set_option(tcp_cork(cork), ignored_ec);
+        corked_ = cork;
+    }
+#else
+    (void)cork;
+#endif
+}
+
 void Connection::handleWriteCompleted() {
+    setCork(false);
     requestParser_.reset();
     request_.reset();
     reply_.reset();
+    bufferPool_->release(sendBuffer_);
+    for (auto &buf : sendWindow_) {
+        bufferPool_->release(buf);
+    }
     firstBodyReadAfter100Continue_ = true;  // Reset for next request
 
     if (!closeConnection_) {
-        doRead();
+        if (!pipelineBuffer_.empty()) {
+            handlePipelinedRequest();
+        } else {
+            doReadIdle();
+        }
     } else {
         // Initiate graceful connection closure
         std::error_code ignored_ec;
@@ -441,7 +993,62 @@ void Connection::handleWriteCompleted() {
     }
 }
 
+void Connection::handlePipelinedRequest() {
+    // Continue with the data following the answered request as if just read
+    bufferPool_->release(recvBuffer_);
+    recvBuffer_.swap(pipelineBuffer_);
+    handleRequestData();
+}
+
+bool Connection::coalesceReply() {
+    // Only complete replies followed by another request are held back, and
+    // never more than what fits in one buffer.
+    if (pipelineBuffer_.empty() || closeConnection_ || reply_.replyPartial_ ||
+        reply_.streamCallback_ != nullptr) {
+        return false;
+    }
+    bufferPool_->acquire(coalesceBuffer_);
+    size_t offset = coalesceBuffer_.size();
+    renderReplyHeaders(coalesceBuffer_);
+    auto content = reply_.contentToBuffers();
+    size_t contentOffset = coalesceBuffer_.size();
+    size_t contentSize = asio::buffer_size(content);
+    if (contentOffset + contentSize > maxContentSize_) {
+        coalesceBuffer_.resize(offset);
+        if (coalesceBuffer_.empty()) {
+            bufferPool_->release(coalesceBuffer_);
+        }
+        return false;
+    }
+
+    coalesceBuffer_.resize(contentOffset + contentSize);
+    asio::buffer_copy(asio::buffer(coalesceBuffer_.data() + contentOffset, contentSize), content);
+    return true;
+}
+
+void Connection::doWriteCoalesced(void (Connection::*next)()) {
+    auto self(shared_from_this());
+    asio::async_write(
+        socket_,
+        asio::buffer(coalesceBuffer_),
+        [this, self, next](std::error_code ec, std::size_t) {
+            bufferPool_->release(coalesceBuffer_);
+            if (!ec) {
+                lastActivityTime_ = connectionManager_.now();
+                (this->*next)();
+            } else {
+                connectionManager_.debugMsg("doWriteCoalesced: " + ec.message() + ':' +
+                                            std::to_string(ec.value()));
+                shutdown();
+            }
+        });
+}
+
 void Connection::doWrite100Continue() {
+    if (!coalesceBuffer_.empty()) {
+        doWriteCoalesced(&Connection::doWrite100Continue);
+        return;
+    }
     auto self(shared_from_this());
 
     // Create 100 Continue response as shared_ptr to ensure it outlives the async_write.
@@ -470,10 +1077,19 @@ void Connection::doReadBodyAfter100Continue() {
     socket_.async_read_some(
         asio::buffer(recvBuffer_), [this, self](std::error_code ec, std::size_t bytesTransferred) {
             if (!ec) {
-                lastActivityTime_ = std::chrono::steady_clock::now();
+                lastActivityTime_ = connectionManager_.now();
                 lastReceivedTime_ = lastActivityTime_;
                 recvBuffer_.resize(bytesTransferred);
-                reply_.noBodyBytesReceived_ += bytesTransferred;
+                bool complete = false;
+                if (request_.isChunked_ && !dechunkBody(0, complete)) {
+                    return;
+                }
+                reply_.noBodyBytesReceived_ += recvBuffer_.size();
+                if (complete) {
+                    // The size of a chunked body is known with its last chunk
+                    request_.contentLength_ = reply_.noBodyBytesReceived_;
+                }
+                complete = reply_.noBodyBytesReceived_ >= request_.contentLength_;
 
                 if (firstBodyReadAfter100Continue_) {
                     firstBodyReadAfter100Continue_ = false;
@@ -486,19 +1102,30 @@ void Connection::doReadBodyAfter100Continue() {
                     reply_.contentPtr_ = nullptr;
                     reply_.contentSize_ = 0;
 
+                    if (!complete && isCollectedBody()) {
+                        // Collect the rest of the body first
+                        doCollectBody();
+                        return;
+                    }
+
                     // handleRequest needs to be called first time to handle
                     // either "single part" or multi-part body processing
                     requestHandler_.handleRequest(connectionId_, request_, recvBuffer_, reply_);
                     if (!reply_.isMultiPart_) {
                         if (!reply_.isStatusOk()) {
                             reply_.addHeader("Connection", "close");
+                            doWriteHeaders();
+                        } else if (complete || !reply_.isRawUpload_) {
+                            doWriteHeaders();
+                        } else if (!startSpliceBody()) {
+                            // The data read so far has been written by handleRequest
+                            doReadBodyAfter100Continue();
                         }
-                        doWriteHeaders();
                         return;
                     }
                 }
 
-                if (reply_.noBodyBytesReceived_ < request_.contentLength_) {
+                if (!complete) {
                     // Body is incomplete, continue reading
                     // Always use handleFileIOWrite for body processing (multipart state already
                     // set up)
@@ -514,6 +1141,9 @@ void Connection::doReadBodyAfter100Continue() {
                     doWriteHeaders();
                 }
             } else if (ec != asio::error::operation_aborted) {
+                // Keep what has been received of an upload
+                requestHandler_.flushUpload(request_, reply_);
+                requestHandler_.closeRawUpload(request_, reply_);
                 connectionManager_.debugMsg("doReadBodyAfter100Continue: " + ec.message() + ':' +
                                             std::to_string(ec.value()));
                 connectionManager_.stop(shared_from_this());
@@ -524,7 +1154,7 @@ void Connection::doReadBodyAfter100Continue() {
 void Connection::handleUpgradeToWebSocket() {
     reply_.addHeader("Connection", "Upgrade");
     reply_.addHeader("Upgrade", "websocket");
-    std::string key = request_.getHeaderValue("Sec-WebSocket-Key");
+    std::string key = request_.getHeaderView(Request::sec_websocket_key).str();
     if (key.empty()) {
         reply_.stockReply(request_, Reply::bad_request);
         reply_.addHeader("Connection", "close");
@@ -540,25 +1170,35 @@ void Connection::handleUpgradeToWebSocket() {
 }
 
 void Connection::doAckWsUpgrade() {
+    if (!coalesceBuffer_.empty()) {
+        doWriteCoalesced(&Connection::doAckWsUpgrade);
+        return;
+    }
+    headerBuffer_.clear();
+    reply_.renderHeaders(headerBuffer_);
+    headerBuffer_.push_back('\r');
+    headerBuffer_.push_back('\n');
     auto self(shared_from_this());
     asio::async_write(
-        socket_, reply_.headerToBuffers(), [this, self](std::error_code ec, std::size_t) {
+        socket_, asio::buffer(headerBuffer_), [this, self](std::error_code ec, std::size_t) {
             if (!ec) {
                 requestParser_.reset();
                 request_.reset();
                 reply_.reset();
+                bufferPool_->release(sendBuffer_);
                 isWebSocket_ = true;
+                connectionManager_.addWsConnection(*this);
                 connectionManager_.debugMsg("WebSocket upgraded on path: " + request_.requestPath_);
                 if (wsEndpoint_) {
-                    wsEndpoint_->onWsOpen(std::to_string(connectionId_));
+                    wsEndpoint_->onWsOpen(connectionIdStr_);
                 }
-                doRead();
+                doReadIdle();
             } else {
                 connectionManager_.debugMsg("doAckWsUpgrade: " + ec.message() + ':' +
                                             std::to_string(ec.value()));
                 // Notify WebSocket endpoint of upgrade failure
                 if (wsEndpoint_) {
-                    wsEndpoint_->onWsError(std::to_string(connectionId_),
+                    wsEndpoint_->onWsError(connectionIdStr_,
                                            "WebSocket upgrade failed: " + ec.message());
                 }
                 shutdown();
@@ -569,6 +1209,7 @@ void Connection::doAckWsUpgrade() {
 void Connection::doWriteWsFrame(bool continueReading, WriteCompleteCallback callback) {
     writeInProgress_ = true;
     writeCallback_ = callback;
+    wsWritesInFlight_++;
 
     auto self(shared_from_this());
     std::vector<asio::const_buffer> buffers;
@@ -577,18 +1218,21 @@ void Connection::doWriteWsFrame(bool continueReading, WriteCompleteCallback call
                       buffers,
                       [this, self, continueReading](std::error_code ec, std::size_t bytesWritten) {
                           writeInProgress_ = false;
+                          if (--wsWritesInFlight_ == 0) {
+                              bufferPool_->release(sendBuffer_);
+                          }
 
                           if (!ec) {
-                              lastActivityTime_ = std::chrono::steady_clock::now();
+                              lastActivityTime_ = connectionManager_.now();
                               if (continueReading) {
-                                  doRead();  // Continue reading after write completes
+                                  doReadIdle();  // Continue reading after write completes
                               }
                           } else {
                               connectionManager_.debugMsg("doWriteWsFrame: " + ec.message() + ':' +
                                                           std::to_string(ec.value()));
                               // Notify WebSocket endpoint of write error
                               if (wsEndpoint_) {
-                                  wsEndpoint_->onWsError(std::to_string(connectionId_),
+                                  wsEndpoint_->onWsError(connectionIdStr_,
                                                          "Write error: " + ec.message());
                               }
                               shutdown();
@@ -607,7 +1251,10 @@ void Connection::shutdown() {
     std::error_code ignored_ec;
     socket_.shutdown(asio::ip::tcp::socket::shutdown_both, ignored_ec);
     connectionManager_.stop(shared_from_this());
-    requestHandler_.closeFile(connectionId_);
+    if (!readAheadPending_) {
+        // Otherwise closed when the read is done
+        requestHandler_.closeFile(connectionId_);
+    }
 }
 
 }  // namespace beauty
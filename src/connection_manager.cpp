@@ -1,6 +1,8 @@
 #include "beauty/connection_manager.hpp"
 #include "beauty/ws_endpoint.hpp"
+#include <algorithm>
 #include <chrono>
+#include <cstdio>
 
 namespace {
 void defaultDebugMsgHandler(const std::string&) {}
@@ -9,80 +11,179 @@ void defaultDebugMsgHandler(const std::string&) {}
 namespace beauty {
 
 ConnectionManager::ConnectionManager(const Settings& settings)
-    : settings_(settings), debugMsgCb_(defaultDebugMsgHandler) {}
+    : settings_(settings),
+      now_(std::chrono::steady_clock::now()),
+      timers_(settings.timerResolution_, now_),
+      debugMsgCb_(defaultDebugMsgHandler) {
+    // Keep-Alive timeout is given in whole seconds, round up
+    keepAliveHeaders_ = "Connection: keep-alive\r\nKeep-Alive: timeout=" +
+                        std::to_string((settings_.keepAliveTimeout_.count() + 999) / 1000) +
+                        ", max=" + std::to_string(settings_.keepAliveMax_) + "\r\n";
+}
 
 void ConnectionManager::start(std::shared_ptr<Connection> c) {
     connections_.insert(c);
     bool useKeepAlive = false;
-    if (settings_.keepAliveTimeout_ != std::chrono::seconds(0) &&
+    if (settings_.keepAliveTimeout_ != std::chrono::milliseconds(0) &&
         (settings_.connectionLimit_ == 0 ||  // 0 = unlimited
          (settings_.connectionLimit_ > 0 && connections_.size() <= settings_.connectionLimit_))) {
         useKeepAlive = true;
     }
-    c->start(useKeepAlive, settings_.keepAliveTimeout_, settings_.keepAliveMax_);
+    c->start(useKeepAlive,
+             settings_.keepAliveTimeout_,
+             settings_.keepAliveMax_,
+             settings_.waitReadableWhenIdle_,
+             settings_.headerViewsOnly_,
+             settings_.tcpNoDelay_,
+             settings_.tcpCork_,
+             settings_.sendWindowParts_,
+             settings_.maxChunkSize_);
+    updateTimeouts(*c);
 }
 
 void ConnectionManager::stop(std::shared_ptr<Connection> c) {
+    timers_.cancel(c->getTimerEntry());
+    if (c->isWebSocket()) {
+        wsConnections_.erase(c->getConnectionId());
+    }
     connections_.erase(c);
     c->stop();
 }
 
 void ConnectionManager::stopAll() {
     for (auto c : connections_) {
+        timers_.cancel(c->getTimerEntry());
         c->stop();
     }
     connections_.clear();
+    wsConnections_.clear();
 }
 
 void ConnectionManager::tick() {
-    auto now = std::chrono::steady_clock::now();
-    auto it = connections_.begin();
-    while (it != connections_.end()) {
-        if ((*it)->isWebSocket()) {
-            // Check WebSocket timeouts
-            if (settings_.wsReceiveTimeout_ != std::chrono::seconds(0) &&
-                ((*it)->getLastReceivedTime() + settings_.wsReceiveTimeout_ < now)) {
-                debugMsgCb_("Removing WebSocket connection due to receive timeout");
-                (*it)->stop();
-                it = connections_.erase(it);
-                continue;
-            }
-            if (settings_.wsPingInterval_ != std::chrono::seconds(0) &&
-                ((*it)->getLastPingTime() + settings_.wsPingInterval_ < now)) {
-                // Time to send ping
-                (*it)->sendWsPing();
-            }
-            if (settings_.wsPongTimeout_ != std::chrono::seconds(0) &&
-                ((*it)->getLastPingTime() + settings_.wsPongTimeout_ < now) &&
-                ((*it)->getLastPongTime() < (*it)->getLastPingTime())) {
-                debugMsgCb_("Removing WebSocket connection due to pong timeout");
-                (*it)->stop();
-                it = connections_.erase(it);
-                continue;
-            }
-            it++;
-            continue;
-        } else if ((*it)->useKeepAlive()) {
-            bool erase = false;
-            if (((*it)->getLastActivityTime() + settings_.keepAliveTimeout_ < now)) {
-                debugMsgCb_("Removing HTTP connection due to inactivity");
-                erase = true;
-            }
-            if ((*it)->getNrOfRequests() >= settings_.keepAliveMax_) {
-                debugMsgCb_("Removing HTTP connection due max request limit");
-                erase = true;
-            }
-
-            if (erase) {
-                (*it)->stop();
-                it = connections_.erase(it);
-            } else {
-                it++;
-            }
+    now_ = std::chrono::steady_clock::now();
+    timers_.advance(now_, [this](Connection& c) { handleTimeouts(c); });
+}
+
+std::chrono::steady_clock::time_point ConnectionManager::now() const {
+    return now_;
+}
+
+StringView ConnectionManager::getKeepAliveHeaders() const {
+    return keepAliveHeaders_;
+}
+
+StringView ConnectionManager::getDateHeader() {
+    if (!settings_.sendDateHeader_) {
+        return StringView();
+    }
+    std::time_t t = std::time(nullptr);
+    if (t != dateHeaderTime_) {
+        dateHeaderTime_ = t;
+        dateHeader_.clear();
+        // 2000-01-01, anything earlier means the clock is not set
+        const std::time_t clockSet = 946684800;
+        struct tm tm;
+        if (t >= clockSet && gmtime_r(&t, &tm) != nullptr) {
+            // Not strftime, the names must not depend on the locale
+            static const char *days[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+            static const char *months[] = {
+                "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+            char buf[64];
+            snprintf(buf,
+                     sizeof(buf),
+                     "Date: %s, %02d %s %04d %02d:%02d:%02d GMT\r\n",
+                     days[tm.tm_wday],
+                     tm.tm_mday,
+                     months[tm.tm_mon],
+                     tm.tm_year + 1900,
+                     tm.tm_hour,
+                     tm.tm_min,
+                     tm.tm_sec);
+            dateHeader_ = buf;
+        }
+    }
+    return dateHeader_;
+}
+
+void ConnectionManager::updateTimeouts(Connection& c) {
+    // Activity is timestamped with now_, up to one resolution in the past, so
+    // timeouts are extended by one resolution to never expire early
+    const auto resolution = settings_.timerResolution_;
+    auto deadline = std::chrono::steady_clock::time_point::max();
+    if (c.isWebSocket()) {
+        if (settings_.wsReceiveTimeout_ != std::chrono::milliseconds(0)) {
+            deadline = std::min(
+                deadline, c.getLastReceivedTime() + settings_.wsReceiveTimeout_ + resolution);
+        }
+        if (settings_.wsPingInterval_ != std::chrono::milliseconds(0)) {
+            deadline = std::min(deadline, c.getLastPingTime() + settings_.wsPingInterval_);
+        }
+        if (settings_.wsPongTimeout_ != std::chrono::milliseconds(0) &&
+            c.getLastPongTime() < c.getLastPingTime()) {
+            deadline =
+                std::min(deadline, c.getLastPingTime() + settings_.wsPongTimeout_ + resolution);
+        }
+    } else if (c.useKeepAlive()) {
+        if (c.getNrOfRequests() >= settings_.keepAliveMax_) {
+            deadline = now_;
         } else {
-            it++;
+            deadline = c.getLastActivityTime() + settings_.keepAliveTimeout_ + resolution;
+        }
+    }
+
+    if (deadline != std::chrono::steady_clock::time_point::max()) {
+        timers_.schedule(c.getTimerEntry(), deadline);
+    } else {
+        timers_.cancel(c.getTimerEntry());
+    }
+}
+
+void ConnectionManager::addWsConnection(Connection& c) {
+    wsConnections_[c.getConnectionId()] = &c;
+    updateTimeouts(c);
+}
+
+void ConnectionManager::handleTimeouts(Connection& conn) {
+    // See updateTimeouts
+    const auto resolution = settings_.timerResolution_;
+    std::shared_ptr<Connection> c = conn.shared_from_this();
+    if (c->isWebSocket()) {
+        // Check WebSocket timeouts
+        if (settings_.wsReceiveTimeout_ != std::chrono::milliseconds(0) &&
+            (c->getLastReceivedTime() + settings_.wsReceiveTimeout_ + resolution < now_)) {
+            debugMsgCb_("Removing WebSocket connection due to receive timeout");
+            stop(c);
+            return;
+        }
+        if (settings_.wsPingInterval_ != std::chrono::milliseconds(0) &&
+            (c->getLastPingTime() + settings_.wsPingInterval_ < now_)) {
+            // Time to send ping
+            c->sendWsPing();
+        }
+        if (settings_.wsPongTimeout_ != std::chrono::milliseconds(0) &&
+            (c->getLastPingTime() + settings_.wsPongTimeout_ + resolution < now_) &&
+            (c->getLastPongTime() < c->getLastPingTime())) {
+            debugMsgCb_("Removing WebSocket connection due to pong timeout");
+            stop(c);
+            return;
+        }
+    } else if (c->useKeepAlive()) {
+        bool erase = false;
+        if ((c->getLastActivityTime() + settings_.keepAliveTimeout_ + resolution < now_)) {
+            debugMsgCb_("Removing HTTP connection due to inactivity");
+            erase = true;
+        }
+        if (c->getNrOfRequests() >= settings_.keepAliveMax_) {
+            debugMsgCb_("Removing HTTP connection due max request limit");
+            erase = true;
+        }
+
+        if (erase) {
+            stop(c);
+            return;
         }
     }
+    updateTimeouts(*c);
 }
 
 void ConnectionManager::setDebugMsgHandler(const debugMsgCallback& cb) {
@@ -96,44 +197,84 @@ void ConnectionManager::debugMsg(const std::string& msg) {
 WriteResult ConnectionManager::sendWsText(const std::string& connectionId,
                                           const std::string& message,
                                           WriteCompleteCallback callback) {
-    for (auto& conn : connections_) {
-        if (conn->isWebSocket() && std::to_string(conn->getConnectionId()) == connectionId) {
-            return conn->sendWsText(message, callback);
-        }
+    WsConnectionHandle handle;
+    if (!WsConnectionHandle::fromString(connectionId, handle)) {
+        return WriteResult::CONNECTION_CLOSED;  // Not a connection id
     }
-    return WriteResult::CONNECTION_CLOSED;  // Connection not found or not a WebSocket
+    return sendWsText(handle, message, callback);
 }
 
 WriteResult ConnectionManager::sendWsBinary(const std::string& connectionId,
                                             const std::vector<char>& data,
                                             WriteCompleteCallback callback) {
-    for (auto& conn : connections_) {
-        if (conn->isWebSocket() && std::to_string(conn->getConnectionId()) == connectionId) {
-            return conn->sendWsBinary(data, callback);
-        }
+    WsConnectionHandle handle;
+    if (!WsConnectionHandle::fromString(connectionId, handle)) {
+        return WriteResult::CONNECTION_CLOSED;  // Not a connection id
     }
-    return WriteResult::CONNECTION_CLOSED;  // Connection not found or not a WebSocket
+    return sendWsBinary(handle, data, callback);
 }
 
 WriteResult ConnectionManager::sendWsClose(const std::string& connectionId,
                                            uint16_t statusCode,
                                            const std::string& reason,
                                            WriteCompleteCallback callback) {
-    for (auto& conn : connections_) {
-        if (conn->isWebSocket() && std::to_string(conn->getConnectionId()) == connectionId) {
-            return conn->sendWsClose(statusCode, reason, callback);
-        }
+    WsConnectionHandle handle;
+    if (!WsConnectionHandle::fromString(connectionId, handle)) {
+        return WriteResult::CONNECTION_CLOSED;  // Not a connection id
     }
-    return WriteResult::CONNECTION_CLOSED;  // Connection not found or not a WebSocket
+    return sendWsClose(handle, statusCode, reason, callback);
 }
 
 bool ConnectionManager::isWriteInProgress(const std::string& connectionId) const {
-    for (const auto& conn : connections_) {
-        if (conn->isWebSocket() && std::to_string(conn->getConnectionId()) == connectionId) {
-            return conn->isWriteInProgress();
-        }
+    WsConnectionHandle handle;
+    if (!WsConnectionHandle::fromString(connectionId, handle)) {
+        return false;  // Not a connection id
+    }
+    return isWriteInProgress(handle);
+}
+
+WriteResult ConnectionManager::sendWsText(WsConnectionHandle handle,
+                                          const std::string& message,
+                                          WriteCompleteCallback callback) {
+    Connection* conn = findWsConnection(handle);
+    if (conn == nullptr) {
+        return WriteResult::CONNECTION_CLOSED;  // Connection not found or not a WebSocket
+    }
+    return conn->sendWsText(message, callback);
+}
+
+WriteResult ConnectionManager::sendWsBinary(WsConnectionHandle handle,
+                                            const std::vector<char>& data,
+                                            WriteCompleteCallback callback) {
+    Connection* conn = findWsConnection(handle);
+    if (conn == nullptr) {
+        return WriteResult::CONNECTION_CLOSED;  // Connection not found or not a WebSocket
+    }
+    return conn->sendWsBinary(data, callback);
+}
+
+WriteResult ConnectionManager::sendWsClose(WsConnectionHandle handle,
+                                           uint16_t statusCode,
+                                           const std::string& reason,
+                                           WriteCompleteCallback callback) {
+    Connection* conn = findWsConnection(handle);
+    if (conn == nullptr) {
+        return WriteResult::CONNECTION_CLOSED;  // Connection not found or not a WebSocket
+    }
+    return conn->sendWsClose(statusCode, reason, callback);
+}
+
+bool ConnectionManager::isWriteInProgress(WsConnectionHandle handle) const {
+    Connection* conn = findWsConnection(handle);
+    if (conn == nullptr) {
+        return false;  // Connection not found or not a WebSocket
     }
-    return false;  // Connection not found or not a WebSocket
+    return conn->isWriteInProgress();
+}
+
+Connection* ConnectionManager::findWsConnection(WsConnectionHandle handle) const {
+    auto it = wsConnections_.find(handle.id_);
+    return (it != wsConnections_.end()) ? it->second : nullptr;
 }
 
 void ConnectionManager::setWsEndpoints(std::set<std::shared_ptr<WsEndpoint>> endpoints) {
@@ -154,12 +295,23 @@ WsEndpoint* ConnectionManager::getWsEndpointForPath(const std::string& path) con
 std::vector<std::string> ConnectionManager::getActiveWsConnectionsForEndpoint(
     const IWsReceiver* endpoint) const {
     std::vector<std::string> wsConnections;
-    for (const auto& conn : connections_) {
-        if (conn->isWebSocket() && conn->getWsEndpoint() == endpoint) {
-            wsConnections.push_back(std::to_string(conn->getConnectionId()));
+    for (const auto& conn : wsConnections_) {
+        if (conn.second->getWsEndpoint() == endpoint) {
+            wsConnections.push_back(std::to_string(conn.first));
         }
     }
     return wsConnections;
 }
 
+std::vector<WsConnectionHandle> ConnectionManager::getActiveWsHandlesForEndpoint(
+    const IWsReceiver* endpoint) const {
+    std::vector<WsConnectionHandle> handles;
+    for (const auto& conn : wsConnections_) {
+        if (conn.second->getWsEndpoint() == endpoint) {
+            handles.push_back(WsConnectionHandle(conn.first));
+        }
+    }
+    return handles;
+}
+
 }  // namespace beauty
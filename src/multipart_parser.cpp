@@ -1,24 +1,28 @@
 #include <string.h>
 #include <algorithm>
+#include <iterator>
 
 #include "beauty/parse_common.hpp"
 #include "beauty/multipart_parser.hpp"
 
 namespace beauty {
 
-MultiPartParser::MultiPartParser(std::vector<char> &lastBuffer)
-    : state_(expecting_hyphen_1), lastBuffer_(lastBuffer) {}
+MultiPartParser::MultiPartParser() : state_(expecting_hyphen_1) {}
 
 void MultiPartParser::reset() {
     state_ = expecting_hyphen_1;
+    header_.name_.clear();
+    header_.value_.clear();
+    filename_.clear();
+    noParts_ = 0;
+    boundaryCount_ = 0;
     boundaryStr_.clear();
-    lastBuffer_.clear();
-    lastParts_.clear();
+    delimiter_.clear();
 }
 
 bool MultiPartParser::parseHeader(const Request &req) {
     reset();
-    std::string contentTypeVal = req.getHeaderValue("Content-Type");
+    std::string contentTypeVal = req.getHeaderView(Request::content_type).str();
     auto it = contentTypeVal.find("multipart");
     if (it == std::string::npos) {
         return false;
@@ -37,103 +41,137 @@ bool MultiPartParser::parseHeader(const Request &req) {
     } else {
         return false;
     }
+
+    delimiter_ = "\r\n--" + boundaryStr_;
+    const size_t m = delimiter_.size();
+    std::fill(std::begin(skip_),
+              std::end(skip_),
+              static_cast<unsigned char>(std::min<size_t>(m, 255)));
+    for (size_t i = 0; i + 1 < m; ++i) {
+        skip_[static_cast<unsigned char>(delimiter_[i])] =
+            static_cast<unsigned char>(std::min<size_t>(m - 1 - i, 255));
+    }
     return true;
 }
 
 bool MultiPartParser::isMultipartRequest(const Request &req) {
-    std::string contentTypeVal = req.getHeaderValue("Content-Type");
-    auto it = contentTypeVal.find("multipart");
-    if (it == std::string::npos) {
-        return false;
-    }
-    return true;
+    return req.getHeaderView(Request::content_type).find("multipart") != StringView::npos;
 }
 
-MultiPartParser::result_type MultiPartParser::parse(std::vector<char> &content,
-                                                    std::deque<ContentPart> &parts) {
-    result_type result = result_type::indeterminate;
+MultiPartParser::result_type MultiPartParser::parse(const char *data,
+                                                    size_t size,
+                                                    size_t &consumed) {
+    result_type result = indeterminate;
+    noParts_ = 0;
+    size_t pos = 0;
 
-    if (content.empty()) {
-        return indeterminate;
+    if (state_ == part_data_cont && size > 0) {
+        continuePartData(data, size, pos);
     }
-
-    parts.clear();
-    auto begin = content.begin();
-    auto end = content.end();
-    while (begin != end) {
-        result = consume(begin++, parts);
+    while (pos < size) {
+        if (state_ == part_data_cont) {
+            // Only the boundary matters in part data
+            skipPartData(data, size, pos);
+            continue;
+        }
+        if (state_ == expecting_newline_3 && noParts_ == maxParts) {
+            // The part starting here is found by the next call
+            result = parts_full;
+            break;
+        }
+        result = consume(data + pos++);
         if (result != indeterminate) {
             break;
         }
     }
 
-    if (result == bad) {
-        return result;
-    }
+    consumed = pos;
+    return result;
+}
 
-    // if no filename_/start_/end_ was found in consume() it will not create
-    // a part, so must then assume we're in the middle of content somewhere and
-    // create a part
-    if (result == indeterminate && parts.empty()) {
-        parts.push_back(ContentPart());
-    }
+size_t MultiPartParser::getNoParts() const {
+    return noParts_;
+}
 
-    // return the previous content (that have been adjusted below)
-    parts.swap(lastParts_);
-    content.swap(lastBuffer_);
+const MultiPartParser::ContentPart &MultiPartParser::getPart(size_t i) const {
+    return parts_[i];
+}
 
-    // make adjustments to the stored lastParts_ so they are correct when
-    // swapped out in the next call
-    bool containEndForPartToLeave = false;
-    for (auto &lastPart : lastParts_) {
-        // if start_ not found, assume buffer start
-        if (!lastPart.foundStart_) {
-            lastPart.start_ = lastBuffer_.begin();
-        }
+MultiPartParser::ContentPart &MultiPartParser::addPart(const char *start, const char *end) {
+    ContentPart &part = parts_[noParts_++];
+    part = ContentPart();
+    part.start_ = start;
+    part.end_ = end;
+    return part;
+}
 
-        // if end_ not found assume buffer end
-        if (!lastPart.foundEnd_) {
-            lastPart.end_ = lastBuffer_.end();
-        } else {
-            // lastPart.end_ is assigned +1 char after boundary so:
-            // subtract "crlf--boundarySize" to get position after
-            // last data byte
-            lastPart.end_ = lastPart.end_ - (boundaryStr_.size() + 4);
-            if (lastPart.end_ < lastPart.start_) {
-                // end was in the last part of the returned "parts".
-                // "Luckily" (actually the whole reason why we're having
-                // a lastPart/Buffer memory) we can adjust it here!
-                ContentPart &partToLeave = parts.back();
-                partToLeave.end_ = partToLeave.end_ - (lastPart.start_ - lastPart.end_);
-                partToLeave.foundEnd_ = true;
+void MultiPartParser::continuePartData(const char *data, size_t size, size_t &pos) {
+    const char *pattern = delimiter_.data();
+    const size_t m = delimiter_.size();
 
-                // this part needs removing as it was created
-                // by consume() but only contained end_ for previous part
-                containEndForPartToLeave = true;
+    // A boundary started at the end of the previous content. If not
+    // continued here, another may start within its bytes seen so far. The
+    // bytes before it were part data, as held back they are those of
+    // delimiter_.
+    for (size_t shift = 0; shift < boundaryCount_; ++shift) {
+        size_t matched = boundaryCount_ - shift;
+        if (memcmp(pattern + shift, pattern, matched) != 0) {
+            continue;
+        }
+        size_t n = std::min(m - matched, size);
+        if (memcmp(data, pattern + matched, n) == 0) {
+            pos = n;
+            if (matched + n == m) {
+                addPart(pattern, pattern + shift).foundEnd_ = true;
+                boundaryCount_ = 0;
+                state_ = boundary_close;
+            } else {
+                if (shift > 0) {
+                    addPart(pattern, pattern + shift);
+                }
+                boundaryCount_ = matched + n;
             }
+            return;
         }
     }
-
-    if (containEndForPartToLeave) {
-        lastParts_.pop_front();
+    if (boundaryCount_ > 0) {
+        addPart(pattern, pattern + boundaryCount_);
+        boundaryCount_ = 0;
     }
-
-    return result;
+    addPart(data, data);
 }
 
-void MultiPartParser::flush(std::vector<char> &content, std::deque<ContentPart> &parts) {
-    parts.swap(lastParts_);
-    content.swap(lastBuffer_);
-    lastParts_.clear();
-    lastBuffer_.clear();
-}
+void MultiPartParser::skipPartData(const char *data, size_t size, size_t &pos) {
+    ContentPart &part = parts_[noParts_ - 1];
+    const char *pattern = delimiter_.data();
+    const size_t m = delimiter_.size();
+    const size_t start = pos;
 
-const std::deque<MultiPartParser::ContentPart> &MultiPartParser::peakLastPart() const {
-    return lastParts_;
+    while (pos + m <= size) {
+        unsigned char last = data[pos + m - 1];
+        if (last == static_cast<unsigned char>(pattern[m - 1]) &&
+            memcmp(data + pos, pattern, m - 1) == 0) {
+            part.end_ = data + pos;
+            part.foundEnd_ = true;
+            state_ = boundary_close;
+            pos += m;
+            return;
+        }
+        pos += skip_[last];
+    }
+
+    // Hold back the longest tail that may be the start of a boundary
+    for (pos = std::max(start, size >= m ? size - m + 1 : 0); pos < size; ++pos) {
+        if (memcmp(data + pos, pattern, size - pos) == 0) {
+            boundaryCount_ = size - pos;
+            break;
+        }
+    }
+    part.end_ = data + pos;
+    pos = size;
 }
 
-MultiPartParser::result_type MultiPartParser::consume(std::vector<char>::iterator inputPtr,
-                                                      std::deque<ContentPart> &parts) {
+MultiPartParser::result_type MultiPartParser::consume(const char *inputPtr) {
     char input = *inputPtr;
     switch (state_) {
         case expecting_hyphen_1:
@@ -155,6 +193,8 @@ MultiPartParser::result_type MultiPartParser::consume(std::vector<char>::iterato
             return indeterminate;
         case expecting_newline_1:
             if (input == '\n') {
+                header_.name_.clear();
+                filename_.clear();
                 state_ = header_line_start;
             } else {
                 return bad;
@@ -163,15 +203,13 @@ MultiPartParser::result_type MultiPartParser::consume(std::vector<char>::iterato
         case header_line_start:
             if (input == '\r') {
                 state_ = expecting_newline_3;
-            } else if (!headers_.empty() && (input == ' ' || input == '\t')) {
+            } else if (!header_.name_.empty() && (input == ' ' || input == '\t')) {
                 state_ = header_lws;
             } else if (!isChar(input) || isCtl(input) || isTsspecial(input)) {
                 return bad;
             } else {
-                headers_.push_back(Header());
-                headers_.back().name_.reserve(20);
-                headers_.back().value_.reserve(50);
-                headers_.back().name_.push_back(input);
+                header_.name_.assign(1, input);
+                header_.value_.clear();
                 state_ = header_name;
             }
             return indeterminate;
@@ -184,7 +222,7 @@ MultiPartParser::result_type MultiPartParser::consume(std::vector<char>::iterato
                 return bad;
             } else {
                 state_ = header_value;
-                headers_.back().value_.push_back(input);
+                header_.value_.push_back(input);
             }
             return indeterminate;
         case header_name:
@@ -193,7 +231,7 @@ MultiPartParser::result_type MultiPartParser::consume(std::vector<char>::iterato
             } else if (!isChar(input) || isCtl(input) || isTsspecial(input)) {
                 return bad;
             } else {
-                headers_.back().name_.push_back(input);
+                header_.name_.push_back(input);
             }
             return indeterminate;
         case space_before_header_value:
@@ -205,20 +243,16 @@ MultiPartParser::result_type MultiPartParser::consume(std::vector<char>::iterato
             return indeterminate;
         case header_value: {
             if (input == '\r') {
-                Header &h = headers_.back();
-
-                if (strcasecmp(h.name_.c_str(), "Content-Disposition") == 0) {
-                    const std::string key = "filename=\"";
-                    std::size_t foundStart = h.value_.rfind(key);
-                    std::size_t foundEnd = h.value_.find("\"", foundStart + key.size());
+                if (strcasecmp(header_.name_.c_str(), "Content-Disposition") == 0) {
+                    const std::string &value = header_.value_;
+                    const char key[] = "filename=\"";
+                    const size_t keySize = sizeof(key) - 1;
+                    std::size_t foundStart = value.rfind(key);
+                    std::size_t foundEnd = value.find('"', foundStart + keySize);
                     if (foundStart != std::string::npos && foundEnd != std::string::npos &&
                         foundEnd > foundStart) {
-                        if (parts.empty()) {
-                            parts.push_back(ContentPart());
-                        }
-                        parts.back().filename_ = h.value_.substr(
-                            foundStart + key.size(), foundEnd - foundStart - key.size());
-                        headers_.clear();
+                        filename_.assign(
+                            value, foundStart + keySize, foundEnd - foundStart - keySize);
                     } else {
                         return bad;
                     }
@@ -227,7 +261,7 @@ MultiPartParser::result_type MultiPartParser::consume(std::vector<char>::iterato
             } else if (isCtl(input)) {
                 return bad;
             } else {
-                headers_.back().value_.push_back(input);
+                header_.value_.push_back(input);
             }
             return indeterminate;
         }
@@ -240,59 +274,23 @@ MultiPartParser::result_type MultiPartParser::consume(std::vector<char>::iterato
             return indeterminate;
         case expecting_newline_3: {
             if (input == '\n') {
-                if (parts.empty()) {
-                    parts.push_back(ContentPart());
-                }
-                parts.back().headerOnly_ = true;
-                state_ = part_data_start;
-            } else {
-                return bad;
-            }
-            return indeterminate;
-        }
-        case part_data_start:
-            if (parts.empty()) {
-                parts.push_back(ContentPart());
-            }
-            parts.back().headerOnly_ = false;
-            parts.back().start_ = inputPtr;
-            parts.back().foundStart_ = true;
-            state_ = part_data_cont;
-            return indeterminate;
-        case part_data_cont:
-            if (input == '-') {
-                state_ = expecting_hyphen_3;
-            }
-            return indeterminate;
-        case expecting_hyphen_3:
-            if (input == '-') {
-                state_ = boundary_next;
+                // The part data follows, or starts the next content
+                ContentPart &part = addPart(inputPtr + 1, inputPtr + 1);
+                std::string &filename = filenames_[noParts_ - 1];
+                filename.assign(filename_);
+                part.filename_ = StringView(filename);
+                part.foundStart_ = true;
                 boundaryCount_ = 0;
-            } else {
                 state_ = part_data_cont;
-            }
-            return indeterminate;
-        case boundary_next:
-            if (input == boundaryStr_[boundaryCount_++]) {
-                if (boundaryCount_ == boundaryStr_.size()) {
-                    state_ = boundary_close;
-                }
             } else {
-                boundaryCount_ = 0;
-                state_ = part_data_cont;
+                return bad;
             }
             return indeterminate;
+        }
         case boundary_close: {
-            if (parts.empty()) {
-                parts.push_back(ContentPart());
-            }
-            parts.back().end_ = inputPtr;
-            parts.back().foundEnd_ = true;
-
             if (input == '-') {
                 return done;
             } else if (input == '\r') {
-                parts.push_back(ContentPart());
                 state_ = expecting_newline_1;
             } else {
                 return bad;
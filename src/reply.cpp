@@ -12,6 +12,7 @@ const std::string ok = "HTTP/1.1 200 OK\r\n";
 const std::string created = "HTTP/1.1 201 Created\r\n";
 const std::string accepted = "HTTP/1.1 202 Accepted\r\n";
 const std::string no_content = "HTTP/1.1 204 No Content\r\n";
+const std::string partial_content = "HTTP/1.1 206 Partial Content\r\n";
 const std::string multiple_choices = "HTTP/1.1 300 Multiple Choices\r\n";
 const std::string moved_permanently = "HTTP/1.1 301 Moved Permanently\r\n";
 const std::string moved_temporarily = "HTTP/1.1 302 Moved Temporarily\r\n";
@@ -26,6 +27,7 @@ const std::string gone = "HTTP/1.1 410 Gone\r\n";
 const std::string length_required = "HTTP/1.1 411 Length Required\r\n";
 const std::string precondition_failed = "HTTP/1.1 412 Precondition Failed\r\n";
 const std::string payload_too_large = "HTTP/1.1 413 Payload Too Large\r\n";
+const std::string range_not_satisfiable = "HTTP/1.1 416 Range Not Satisfiable\r\n";
 const std::string expectation_failed = "HTTP/1.1 417 Expectation Failed\r\n";
 const std::string internal_server_error = "HTTP/1.1 500 Internal Server Error\r\n";
 const std::string not_implemented = "HTTP/1.1 501 Not Implemented\r\n";
@@ -46,6 +48,8 @@ asio::const_buffer toBuffer(Reply::status_type status) {
             return asio::buffer(accepted);
         case Reply::no_content:
             return asio::buffer(no_content);
+        case Reply::partial_content:
+            return asio::buffer(partial_content);
         case Reply::multiple_choices:
             return asio::buffer(multiple_choices);
         case Reply::moved_permanently:
@@ -74,6 +78,8 @@ asio::const_buffer toBuffer(Reply::status_type status) {
             return asio::buffer(precondition_failed);
         case Reply::payload_too_large:
             return asio::buffer(payload_too_large);
+        case Reply::range_not_satisfiable:
+            return asio::buffer(range_not_satisfiable);
         case Reply::expectation_failed:
             return asio::buffer(expectation_failed);
         case Reply::internal_server_error:
@@ -103,7 +109,7 @@ const char crlf[] = {'\r', '\n'};
 }  // namespace misc_strings
 
 Reply::Reply(std::vector<char>& content)
-    : content_(content), status_(status_type::ok), multiPartParser_(content_) {
+    : content_(content), status_(status_type::ok) {
     headers_.reserve(2);
 }
 
@@ -148,6 +154,15 @@ void Reply::sendPtr(status_type status,
     returnToClient_ = true;
 }
 
+void Reply::sendPtr(status_type status,
+                    const std::string& contentType,
+                    const char* data,
+                    size_t size,
+                    std::shared_ptr<const void> owner) {
+    sendPtr(status, contentType, data, size);
+    contentOwner_ = std::move(owner);
+}
+
 void Reply::sendBig(status_type status,
                     const std::string& contentType,
                     size_t totalSize,
@@ -164,6 +179,24 @@ void Reply::sendBig(status_type status,
     returnToClient_ = true;
 }
 
+void Reply::sendBig(status_type status,
+                    const std::string& contentType,
+                    size_t totalSize,
+                    OffsetStreamCallback callback) {
+    offsetCallback_ = callback;
+    streamOffset_ = 0;
+    sendBig(status,
+            contentType,
+            totalSize,
+            [this](const std::string& id, char* buf, size_t maxSize) {
+                int n = offsetCallback_(id, streamOffset_, buf, maxSize);
+                if (n > 0) {
+                    streamOffset_ += n;
+                }
+                return n;
+            });
+}
+
 void Reply::sendStreaming(status_type status,
                           const std::string& contentType,
                           StreamCallback callback) {
@@ -180,19 +213,18 @@ void Reply::sendStreaming(status_type status,
     returnToClient_ = true;
 }
 
-std::vector<asio::const_buffer> Reply::headerToBuffers() {
-    std::vector<asio::const_buffer> buffers;
-
-    buffers.push_back(status_strings::toBuffer(status_));
-    for (std::size_t i = 0; i < headers_.size(); ++i) {
-        Header& h = headers_[i];
-        buffers.push_back(asio::buffer(h.name_));
-        buffers.push_back(asio::buffer(misc_strings::name_value_separator));
-        buffers.push_back(asio::buffer(h.value_));
-        buffers.push_back(asio::buffer(misc_strings::crlf));
+void Reply::renderHeaders(std::vector<char>& out) const {
+    asio::const_buffer statusLine = status_strings::toBuffer(status_);
+    const char* status = static_cast<const char*>(statusLine.data());
+    out.insert(out.end(), status, status + statusLine.size());
+    for (const auto& h : headers_) {
+        out.insert(out.end(), h.name_.begin(), h.name_.end());
+        out.insert(out.end(),
+                   misc_strings::name_value_separator,
+                   misc_strings::name_value_separator + sizeof(misc_strings::name_value_separator));
+        out.insert(out.end(), h.value_.begin(), h.value_.end());
+        out.insert(out.end(), misc_strings::crlf, misc_strings::crlf + sizeof(misc_strings::crlf));
     }
-    buffers.push_back(asio::buffer(misc_strings::crlf));
-    return buffers;
 }
 
 std::vector<asio::const_buffer> Reply::contentToBuffers() {
@@ -211,6 +243,7 @@ const char ok[] = R"({"status":200,"message":"OK"})";
 const char created[] = R"({"status":201,"message":"Created"})";
 const char accepted[] = R"({"status":202,"message":"Accepted"})";
 const char no_content[] = R"({"status":204,"message":"No Content"})";
+const char partial_content[] = R"({"status":206,"message":"Partial Content"})";
 const char multiple_choices[] = R"({"status":300,"message":"Multiple Choices"})";
 const char moved_permanently[] = R"({"status":301,"message":"Moved Permanently"})";
 const char moved_temporarily[] = R"({"status":302,"message":"Moved Temporarily"})";
@@ -219,8 +252,13 @@ const char bad_request[] = R"({"status":400,"message":"Bad Request"})";
 const char unauthorized[] = R"({"status":401,"message":"Unauthorized"})";
 const char forbidden[] = R"({"status":403,"message":"Forbidden"})";
 const char not_found[] = R"({"status":404,"message":"Not Found"})";
+const char method_not_allowed[] = R"({"status":405,"message":"Method Not Allowed"})";
+const char conflict[] = R"({"status":409,"message":"Conflict"})";
+const char gone[] = R"({"status":410,"message":"Gone"})";
 const char length_required[] = R"({"status":411,"message":"Length Required"})";
+const char precondition_failed[] = R"({"status":412,"message":"Precondition Failed"})";
 const char payload_too_large[] = R"({"status":413,"message":"Payload Too Large"})";
+const char range_not_satisfiable[] = R"({"status":416,"message":"Range Not Satisfiable"})";
 const char expectation_failed[] = R"({"status":417,"message":"Expectation Failed"})";
 const char internal_server_error[] = R"({"status":500,"message":"Internal Server Error"})";
 const char not_implemented[] = R"({"status":501,"message":"Not Implemented"})";
@@ -229,85 +267,155 @@ const char service_unavailable[] = R"({"status":503,"message":"Service Unavailab
 const char version_not_supported[] = R"({"status":505,"message":"Version Not Supported"})";
 const char insufficient_storage[] = R"({"status":507,"message":"Insufficient Storage"})";
 
-std::vector<char> toArray(Reply::status_type status) {
+const char* toBody(Reply::status_type status) {
     switch (status) {
         case Reply::ok:
-            return std::vector<char>(ok, ok + sizeof(ok));
+            return ok;
         case Reply::created:
-            return std::vector<char>(created, created + sizeof(created));
+            return created;
         case Reply::accepted:
-            return std::vector<char>(accepted, accepted + sizeof(accepted));
+            return accepted;
         case Reply::no_content:
-            return std::vector<char>(no_content, no_content + sizeof(no_content));
+            return no_content;
+        case Reply::partial_content:
+            return partial_content;
         case Reply::multiple_choices:
-            return std::vector<char>(multiple_choices, multiple_choices + sizeof(multiple_choices));
+            return multiple_choices;
         case Reply::moved_permanently:
-            return std::vector<char>(moved_permanently,
-                                     moved_permanently + sizeof(moved_permanently));
+            return moved_permanently;
         case Reply::moved_temporarily:
-            return std::vector<char>(moved_temporarily,
-                                     moved_temporarily + sizeof(moved_temporarily));
+            return moved_temporarily;
         case Reply::not_modified:
-            return std::vector<char>(not_modified, not_modified + sizeof(not_modified));
+            return not_modified;
         case Reply::bad_request:
-            return std::vector<char>(bad_request, bad_request + sizeof(bad_request));
+            return bad_request;
         case Reply::unauthorized:
-            return std::vector<char>(unauthorized, unauthorized + sizeof(unauthorized));
+            return unauthorized;
         case Reply::forbidden:
-            return std::vector<char>(forbidden, forbidden + sizeof(forbidden));
+            return forbidden;
         case Reply::not_found:
-            return std::vector<char>(not_found, not_found + sizeof(not_found));
+            return not_found;
+        case Reply::method_not_allowed:
+            return method_not_allowed;
+        case Reply::conflict:
+            return conflict;
+        case Reply::gone:
+            return gone;
         case Reply::length_required:
-            return std::vector<char>(length_required, length_required + sizeof(length_required));
+            return length_required;
+        case Reply::precondition_failed:
+            return precondition_failed;
         case Reply::payload_too_large:
-            return std::vector<char>(payload_too_large,
-                                     payload_too_large + sizeof(payload_too_large));
+            return payload_too_large;
+        case Reply::range_not_satisfiable:
+            return range_not_satisfiable;
         case Reply::expectation_failed:
-            return std::vector<char>(expectation_failed,
-                                     expectation_failed + sizeof(expectation_failed));
+            return expectation_failed;
         case Reply::internal_server_error:
-            return std::vector<char>(internal_server_error,
-                                     internal_server_error + sizeof(internal_server_error));
+            return internal_server_error;
         case Reply::not_implemented:
-            return std::vector<char>(not_implemented, not_implemented + sizeof(not_implemented));
+            return not_implemented;
         case Reply::bad_gateway:
-            return std::vector<char>(bad_gateway, bad_gateway + sizeof(bad_gateway));
+            return bad_gateway;
         case Reply::service_unavailable:
-            return std::vector<char>(service_unavailable,
-                                     service_unavailable + sizeof(service_unavailable));
+            return service_unavailable;
         case Reply::version_not_supported:
-            return std::vector<char>(version_not_supported,
-                                     version_not_supported + sizeof(version_not_supported));
+            return version_not_supported;
         case Reply::insufficient_storage:
-            return std::vector<char>(insufficient_storage,
-                                     insufficient_storage + sizeof(insufficient_storage));
+            return insufficient_storage;
         default:
-            return std::vector<char>(internal_server_error,
-                                     internal_server_error + sizeof(internal_server_error));
+            return internal_server_error;
     }
 }
 
+// Error replies always close the connection, so they can be rendered
+// completely up front: status line, headers, empty line and JSON body. Not
+// 416 Range Not Satisfiable, as it carries the size in Content-Range.
+struct Prebuilt {
+    Reply::status_type status_;
+    std::string data_;
+    // Size of the status line and headers, without the empty line.
+    size_t headerSize_;
+};
+
+std::vector<Prebuilt> renderAll() {
+    const Reply::status_type statuses[] = {Reply::multiple_choices,
+                                           Reply::moved_permanently,
+                                           Reply::moved_temporarily,
+                                           Reply::not_modified,
+                                           Reply::bad_request,
+                                           Reply::unauthorized,
+                                           Reply::forbidden,
+                                           Reply::not_found,
+                                           Reply::method_not_allowed,
+                                           Reply::conflict,
+                                           Reply::gone,
+                                           Reply::length_required,
+                                           Reply::precondition_failed,
+                                           Reply::payload_too_large,
+                                           Reply::expectation_failed,
+                                           Reply::internal_server_error,
+                                           Reply::not_implemented,
+                                           Reply::bad_gateway,
+                                           Reply::service_unavailable,
+                                           Reply::version_not_supported,
+                                           Reply::insufficient_storage};
+    std::vector<Prebuilt> replies;
+    replies.reserve(sizeof(statuses) / sizeof(statuses[0]));
+    for (Reply::status_type status : statuses) {
+        asio::const_buffer statusLine = status_strings::toBuffer(status);
+        const char* body = toBody(status);
+        std::string data(static_cast<const char*>(statusLine.data()), statusLine.size());
+        data += "Content-Length: " + std::to_string(std::strlen(body)) + "\r\n";
+        data += "Content-Type: application/json\r\n";
+        data += "Connection: close\r\n";
+        size_t headerSize = data.size();
+        data += "\r\n";
+        data += body;
+        replies.push_back({status, std::move(data), headerSize});
+    }
+    return replies;
+}
+
+const Prebuilt* find(Reply::status_type status) {
+    static const std::vector<Prebuilt> replies = renderAll();
+    for (const auto& reply : replies) {
+        if (reply.status_ == status) {
+            return &reply;
+        }
+    }
+    return nullptr;
+}
+
 }  // namespace stock_replies
 
 void Reply::stockReply(const Request& req, Reply::status_type status) {
     status_ = status;
-    content_ = stock_replies::toArray(status);
     headers_.clear();
-    if (status_ == no_content) {
-        content_.clear();
-    } else {
-        addHeader("Content-Length", std::to_string(content_.size()));
+    content_.clear();
+    contentPtr_ = nullptr;
+    returnToClient_ = true;
+
+    const stock_replies::Prebuilt* prebuilt = stock_replies::find(status);
+    if (prebuilt != nullptr) {
+        // Written as is, without the body for HEAD
+        stockHeaderSize_ = prebuilt->headerSize_;
+        stockReply_ = StringView(prebuilt->data_.data(),
+                                 req.method_ == "HEAD" ? stockHeaderSize_ + 2
+                                                       : prebuilt->data_.size());
+        return;
     }
-    addHeader("Content-Type", "application/json");
 
-    if (!isStatusOk()) {
-        addHeader("Connection", "close");
+    const char* body = stock_replies::toBody(status);
+    if (status_ != no_content) {
+        content_.assign(body, body + std::strlen(body));
+        addHeader("Content-Length", std::to_string(content_.size()));
     }
+    addHeader("Content-Type", "application/json");
 
     if (req.method_ == "HEAD") {
         content_.clear();
     }
-    returnToClient_ = true;
 }
 
 void Reply::wrapContentInChunkFormat() {
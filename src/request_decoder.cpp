@@ -27,7 +27,7 @@ bool RequestDecoder::decodeRequest(Request &req, std::vector<char> &content) {
     }
 
     if (req.method_ != "GET") {
-        if (req.getHeaderValue("content-type") == "application/x-www-form-urlencoded") {
+        if (req.getHeaderView(Request::content_type) == "application/x-www-form-urlencoded") {
             std::string bodyStr;
             urlDecode(content.begin(), content.end(), bodyStr);
             keyValDecode(bodyStr, req.formParams_);
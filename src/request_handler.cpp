@@ -1,3 +1,10 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
 #include "beauty/header.hpp"
 #include "beauty/mime_types.hpp"
 #include "beauty/request_handler.hpp"
@@ -21,10 +28,170 @@ std::string combineUploadPaths(const std::string &dir, const std::string &filena
         return dir + filename;
     }
 }
+
+// Precompressed siblings, in order of preference.
+struct Precompressed {
+    const char *encoding_;
+    const char *suffix_;
+};
+const Precompressed precompressed[] = {{"br", ".br"}, {"gzip", ".gz"}};
+
+// Only text based content is worth compressing, or looking for precompressed
+// siblings of.
+bool isCompressibleType(const std::string &type) {
+    return type.compare(0, 5, "text/") == 0 || type == "application/javascript" ||
+           type == "application/json" || type == "application/xml" || type == "image/svg+xml";
+}
+
+bool isCompressible(const std::string &extension) {
+    return isCompressibleType(mime_types::extensionToType(extension));
+}
+
+// Check if the coding is listed in the Accept-Encoding value, and not with
+// q=0. A "*" matches any coding not listed.
+bool acceptsEncoding(StringView acceptEncoding, StringView coding) {
+    bool wildcard = false;
+    const char *it = acceptEncoding.begin();
+    while (it < acceptEncoding.end()) {
+        const char *end = std::find(it, acceptEncoding.end(), ',');
+        const char *params = std::find(it, end, ';');
+        const char *nameBegin = it;
+        const char *nameEnd = params;
+        while (nameBegin < nameEnd && (*nameBegin == ' ' || *nameBegin == '\t')) {
+            nameBegin++;
+        }
+        while (nameEnd > nameBegin && (nameEnd[-1] == ' ' || nameEnd[-1] == '\t')) {
+            nameEnd--;
+        }
+        // q=0, q=0.0 etc. means not acceptable
+        bool rejected = false;
+        StringView paramsView(params, end - params);
+        size_t q = paramsView.find("q=");
+        if (q != StringView::npos) {
+            rejected = true;
+            for (const char *p = params + q + 2; p < end && *p != ';' && *p != ' '; ++p) {
+                if (*p != '0' && *p != '.') {
+                    rejected = false;
+                }
+            }
+        }
+        StringView name(nameBegin, nameEnd - nameBegin);
+        if (name.iequals(coding)) {
+            return !rejected;
+        }
+        if (name == "*") {
+            wildcard = !rejected;
+        }
+        it = end == acceptEncoding.end() ? end : end + 1;
+    }
+    return wildcard;
+}
+
+void removeHeader(std::vector<Header> &headers, const char *name) {
+    headers.erase(std::remove_if(headers.begin(),
+                                 headers.end(),
+                                 [name](const Header &header) {
+                                     return StringView(header.name_).iequals(name);
+                                 }),
+                  headers.end());
+}
+
+// More ranges than this are likely abuse, and get all of the content instead.
+const size_t maxRanges = 16;
+
+// Parse the digits in [begin, end), saturating on overflow. False if empty or
+// not all digits.
+bool parseOffset(const char *begin, const char *end, size_t &value) {
+    if (begin == end) {
+        return false;
+    }
+    value = 0;
+    for (const char *p = begin; p < end; ++p) {
+        if (*p < '0' || *p > '9') {
+            return false;
+        }
+        size_t digit = *p - '0';
+        value = value > (static_cast<size_t>(-1) - digit) / 10 ? static_cast<size_t>(-1)
+                                                                  : value * 10 + digit;
+    }
+    return true;
+}
+
+// Parse a Range header value (e.g. "bytes=0-99, 200-, -50") into the ranges
+// satisfiable for content of size bytes. Returns false if the value is not a
+// valid byte range set (or too many ranges), i.e. is to be ignored.
+bool parseRanges(StringView value, size_t size, std::vector<ByteRange> &ranges) {
+    const StringView unit("bytes=");
+    if (value.size() < unit.size() || !StringView(value.data(), unit.size()).iequals(unit)) {
+        return false;
+    }
+    size_t nrOfRanges = 0;
+    const char *it = value.begin() + unit.size();
+    while (it < value.end()) {
+        const char *end = std::find(it, value.end(), ',');
+        const char *begin = it;
+        it = end == value.end() ? end : end + 1;
+        while (begin < end && (*begin == ' ' || *begin == '\t')) {
+            begin++;
+        }
+        while (end > begin && (end[-1] == ' ' || end[-1] == '\t')) {
+            end--;
+        }
+        if (begin == end) {
+            // Empty list elements are allowed
+            continue;
+        }
+        if (++nrOfRanges > maxRanges) {
+            return false;
+        }
+
+        const char *dash = std::find(begin, end, '-');
+        size_t first = 0;
+        size_t last = 0;
+        bool hasFirst = parseOffset(begin, dash, first);
+        bool hasLast = dash < end && parseOffset(dash + 1, end, last);
+        if (dash == end || (!hasFirst && dash != begin) || (!hasLast && dash + 1 != end) ||
+            (!hasFirst && !hasLast) || (hasFirst && hasLast && last < first)) {
+            return false;
+        }
+        if (!hasFirst) {
+            // The last bytes
+            if (last == 0 || size == 0) {
+                continue;
+            }
+            first = size - std::min(last, size);
+            last = size - 1;
+        } else if (first >= size) {
+            continue;
+        } else if (!hasLast || last >= size) {
+            last = size - 1;
+        }
+        ranges.push_back({first, last});
+    }
+    return nrOfRanges > 0;
+}
+
+// The headers preceding a range in a multipart/byteranges body.
+std::string rangePartHeader(const std::string &boundary,
+                            const std::string &contentType,
+                            const ByteRange &range,
+                            size_t size) {
+    return "\r\n--" + boundary + "\r\nContent-Type: " + contentType +
+           "\r\nContent-Range: bytes " + std::to_string(range.first_) + '-' +
+           std::to_string(range.last_) + '/' + std::to_string(size) + "\r\n\r\n";
+}
 }  // namespace
 
-RequestHandler::RequestHandler(size_t maxContentSize)
-    : maxContentSize_(maxContentSize), expectContinueCb_(defaultExpectContinueHandler) {}
+RequestHandler::RequestHandler(size_t maxContentSize, const Settings &settings)
+    : maxContentSize_(maxContentSize),
+      servePrecompressed_(settings.servePrecompressed_),
+      compressMinSize_(settings.compressMinSize_),
+      rawUploads_(settings.rawUploads_),
+      uploadBlockSize_(settings.uploadBlockSize_),
+      preallocateUploads_(settings.preallocateUploads_),
+      random_(static_cast<uint32_t>(
+          std::chrono::steady_clock::now().time_since_epoch().count())),
+      expectContinueCb_(defaultExpectContinueHandler) {}
 
 void RequestHandler::defaultExpectContinueHandler(const Request &, Reply &rep) {
     // Default: approve all 100-continue requests
@@ -35,6 +202,10 @@ void RequestHandler::setFileIO(IFileIO *fileIO) {
     fileIO_ = fileIO;
 }
 
+void RequestHandler::setCompressorFactory(ICompressorFactory *factory) {
+    compressorFactory_ = factory;
+}
+
 void RequestHandler::addRequestHandler(const handlerCallback &cb) {
     requestHandlers_.push_back(cb);
 }
@@ -73,6 +244,8 @@ void RequestHandler::handleRequest(unsigned connectionId,
         if (rep.returnToClient_) {
             if (req.method_ == "HEAD") {
                 rep.content_.clear();
+            } else if (rep.offsetCallback_) {
+                serveRanges(connectionId, req, rep, rep.totalStreamSize_);
             }
             return;
         }
@@ -83,6 +256,17 @@ void RequestHandler::handleRequest(unsigned connectionId,
         return;
     }
 
+    if (isRawUpload(req)) {
+        rep.status_ = Reply::ok;
+        rep.isRawUpload_ = true;
+        rep.lastOpenFileForWriteId_ = rep.filePath_ + std::to_string(connectionId);
+        fileIO_->openFileForWrite(rep.lastOpenFileForWriteId_, req, rep);
+        if (rep.isStatusOk()) {
+            writeRawBody(req, content, rep);
+        }
+        return;
+    }
+
     if (req.method_ == "POST") {
         if (rep.isMultiPart_ || rep.multiPartParser_.parseHeader(req)) {
             rep.status_ = Reply::ok;
@@ -94,6 +278,7 @@ void RequestHandler::handleRequest(unsigned connectionId,
             return;
         }
     } else if (req.method_ == "GET" || req.method_ == "HEAD") {
+        rep.status_ = Reply::ok;
         openAndReadFile(connectionId, req, rep);
         return;
     }
@@ -123,7 +308,9 @@ void RequestHandler::handleStreamingRead(unsigned connectionId, Reply &rep) {
 
             if (rep.useChunkedEncoding_) {
                 // Wrap content in chunk format if using chunked encoding
-                rep.wrapContentInChunkFormat();
+                if (!rep.compressor_) {
+                    rep.wrapContentInChunkFormat();
+                }
                 // For chunked: final when callback returns 0 or negative
                 rep.finalPart_ = false;  // Will be set on next iteration when bytesRead <= 0
             } else {
@@ -136,10 +323,16 @@ void RequestHandler::handleStreamingRead(unsigned connectionId, Reply &rep) {
                     rep.streamCallback_(std::to_string(connectionId), nullptr, 0);
                 }
             }
+            if (rep.compressor_) {
+                compressContent(rep, rep.content_.data(), rep.content_.size(), rep.finalPart_);
+            }
         } else {
             // End of stream
             rep.finalPart_ = true;
-            if (rep.useChunkedEncoding_) {
+            if (rep.compressor_) {
+                rep.content_.clear();
+                compressContent(rep, nullptr, 0, true);
+            } else if (rep.useChunkedEncoding_) {
                 // Send final chunk "0\r\n\r\n"
                 rep.content_.clear();
                 rep.wrapContentInChunkFormat();
@@ -151,10 +344,45 @@ void RequestHandler::handleStreamingRead(unsigned connectionId, Reply &rep) {
 }
 
 void RequestHandler::handleFileIORead(unsigned connectionId, const Request &req, Reply &rep) {
+    if (!rep.ranges_.empty()) {
+        readRanges(connectionId, req, rep);
+        return;
+    }
     size_t nrReadBytes = readFromFile(connectionId, req, rep);
+    handleFileData(connectionId, rep, nrReadBytes);
+}
 
-    if (nrReadBytes < maxContentSize_) {
-        rep.finalPart_ = true;
+bool RequestHandler::readFileAhead(unsigned connectionId,
+                                   const Request &req,
+                                   const Reply &rep,
+                                   std::vector<char> &buf,
+                                   std::function<void(int)> done) {
+    if (fileIO_ == nullptr || !rep.replyPartial_ || rep.finalPart_ || rep.streamCallback_ ||
+        !rep.ranges_.empty() || rep.nativeFile_.fd_ >= 0) {
+        return false;
+    }
+    buf.resize(maxContentSize_);
+    return fileIO_->readFileAsync(
+        std::to_string(connectionId), req, buf.data(), buf.size(), std::move(done));
+}
+
+void RequestHandler::handleFileIOReadAhead(unsigned connectionId,
+                                           Reply &rep,
+                                           std::vector<char> &buf,
+                                           int nrReadBytes) {
+    // The written content is reused for the next read
+    rep.content_.swap(buf);
+    size_t size = nrReadBytes > 0 ? nrReadBytes : 0;
+    rep.content_.resize(size);
+    handleFileData(connectionId, rep, size);
+}
+
+void RequestHandler::handleFileData(unsigned connectionId, Reply &rep, size_t nrReadBytes) {
+    rep.finalPart_ = nrReadBytes < maxContentSize_;
+    if (rep.compressor_) {
+        compressContent(rep, rep.content_.data(), nrReadBytes, rep.finalPart_);
+    }
+    if (rep.finalPart_) {
         fileIO_->closeReadFile(std::to_string(connectionId));
     }
 }
@@ -166,25 +394,91 @@ void RequestHandler::handleFileIOWrite(unsigned connectionId,
     if (rep.finalPart_) {
         return;
     }
+    if (rep.isRawUpload_) {
+        writeRawBody(req, content, rep);
+        return;
+    }
 
-    std::deque<MultiPartParser::ContentPart> parts;
-    MultiPartParser::result_type result = rep.multiPartParser_.parse(content, parts);
+    // The body bytes received before content
+    const size_t bodyOffset =
+        rep.noBodyBytesReceived_ - std::min(rep.noBodyBytesReceived_, content.size());
+    MultiPartParser::result_type result;
+    size_t pos = 0;
+    do {
+        size_t consumed = 0;
+        result = rep.multiPartParser_.parse(content.data() + pos, content.size() - pos, consumed);
+
+        if (result == MultiPartParser::result_type::bad) {
+            // Keep the data received before the error
+            writeFileParts(connectionId, req, rep, bodyOffset + pos);
+            rep.stockReply(req, Reply::status_type::bad_request);
+            return;
+        }
 
-    if (result == MultiPartParser::result_type::bad) {
-        rep.stockReply(req, Reply::status_type::bad_request);
-        return;
+        writeFileParts(connectionId, req, rep, bodyOffset + pos);
+        pos += consumed;
+        if (!rep.isStatusOk() && rep.status_ != Reply::status_type::no_content) {
+            if (!rep.returnToClient_) {
+                // Not sent with Reply::send, which adds it
+                rep.addHeader("Content-Length", std::to_string(rep.content_.size()));
+            }
+            return;
+        }
+    } while (result == MultiPartParser::result_type::parts_full);
+
+    if (result == MultiPartParser::result_type::done) {
+        rep.finalPart_ = true;
     }
+}
 
-    writeFileParts(connectionId, req, rep, parts);
-    if (!rep.isStatusOk() && rep.status_ != Reply::status_type::no_content) {
-        rep.addHeader("Content-Length", std::to_string(rep.content_.size()));
+bool RequestHandler::isRawUpload(const Request &req) const {
+    if (!rawUploads_ || fileIO_ == nullptr || (req.method_ != "PUT" && req.method_ != "POST") ||
+        (!req.isChunked_ && req.contentLength_ == std::numeric_limits<size_t>::max())) {
+        return false;
+    }
+    const StringView octetStream("application/octet-stream");
+    StringView contentType = req.getHeaderView(Request::content_type);
+    return contentType.size() >= octetStream.size() &&
+           StringView(contentType.data(), octetStream.size()).iequals(octetStream);
+}
+
+bool RequestHandler::getNativeWriteFile(const Reply &rep, NativeWriteFile &file) {
+    return fileIO_ != nullptr && rep.isRawUpload_ && !rep.lastOpenFileForWriteId_.empty() &&
+           fileIO_->getNativeWriteFile(rep.lastOpenFileForWriteId_, file);
+}
+
+void RequestHandler::writeRawBody(const Request &req, std::vector<char> &content, Reply &rep) {
+    // The body bytes are counted by the Connection. The size of a chunked
+    // body is known once its last chunk has been received.
+    bool lastData = rep.noBodyBytesReceived_ >= req.contentLength_;
+    fileIO_->writeFile(
+        rep.lastOpenFileForWriteId_, req, rep, content.data(), content.size(), lastData);
+    if (lastData || !rep.isStatusOk()) {
+        rep.lastOpenFileForWriteId_.clear();
+        rep.finalPart_ = true;
+    }
+}
+
+void RequestHandler::flushUpload(const Request &req, Reply &rep) {
+    if (fileIO_ == nullptr || !rep.isMultiPart_ || rep.lastOpenFileForWriteId_.empty() ||
+        rep.uploadBuffer_.empty()) {
         return;
     }
+    fileIO_->writeFile(rep.lastOpenFileForWriteId_,
+                       req,
+                       rep,
+                       rep.uploadBuffer_.data(),
+                       rep.uploadBuffer_.size(),
+                       false);
+    rep.uploadBuffer_.clear();
+}
 
-    if (result == MultiPartParser::result_type::done) {
-        rep.multiPartParser_.flush(content, parts);
-        writeFileParts(connectionId, req, rep, parts);
+void RequestHandler::closeRawUpload(const Request &req, Reply &rep) {
+    if (fileIO_ == nullptr || !rep.isRawUpload_ || rep.lastOpenFileForWriteId_.empty()) {
+        return;
     }
+    fileIO_->writeFile(rep.lastOpenFileForWriteId_, req, rep, nullptr, 0, true);
+    rep.lastOpenFileForWriteId_.clear();
 }
 
 void RequestHandler::closeFile(unsigned connectionId) {
@@ -195,23 +489,9 @@ void RequestHandler::closeFile(unsigned connectionId) {
 
 void RequestHandler::openAndReadFile(unsigned connectionId, const Request &req, Reply &rep) {
     // open the file to send back
-    size_t contentSize = fileIO_->openFileForRead(std::to_string(connectionId), req, rep);
+    size_t contentSize = openFileForRead(connectionId, req, rep);
 
     if (rep.isStatusOk()) {
-        if (req.method_ == "HEAD") {
-            // HEAD request, no content
-            rep.content_.clear();
-            fileIO_->closeReadFile(std::to_string(connectionId));
-        } else {
-            // fill initial content
-            rep.replyPartial_ = contentSize > maxContentSize_;
-            readFromFile(connectionId, req, rep);
-            if (!rep.replyPartial_) {
-                // all data fits in initial content
-                fileIO_->closeReadFile(std::to_string(connectionId));
-            }
-        }
-
         // Make sure Content-Length and Content-Type headers are Set
         bool hasContentLength = false;
         bool hasContentType = false;
@@ -230,11 +510,390 @@ void RequestHandler::openAndReadFile(unsigned connectionId, const Request &req,
             rep.headers_.push_back(
                 {"Content-Type", mime_types::extensionToType(rep.fileExtension_)});
         }
+
+        if (req.method_ == "HEAD") {
+            // HEAD request, no content
+            rep.content_.clear();
+            rep.contentPtr_ = nullptr;
+            fileIO_->closeReadFile(std::to_string(connectionId));
+        } else if (serveRanges(connectionId, req, rep, contentSize)) {
+            // only the requested ranges are sent
+        } else if (rep.contentPtr_ != nullptr) {
+            // content provided by the FileIO (Reply::sendPtr), e.g. cached
+            fileIO_->closeReadFile(std::to_string(connectionId));
+        } else if (useNativeFile(connectionId, contentSize, rep)) {
+            // the connection sends the content straight from the file
+        } else {
+            // fill initial content
+            rep.replyPartial_ = contentSize > maxContentSize_;
+            readFromFile(connectionId, req, rep);
+            if (!rep.replyPartial_) {
+                // all data fits in initial content
+                fileIO_->closeReadFile(std::to_string(connectionId));
+            }
+        }
     } else if (rep.status_ == Reply::not_modified) {
         // 304 Not Modified response, no content
     }
 }
 
+size_t RequestHandler::openFileForRead(unsigned connectionId, const Request &req, Reply &rep) {
+    const std::string id = std::to_string(connectionId);
+    if (!servePrecompressed_ || !isCompressible(rep.fileExtension_)) {
+        return fileIO_->openFileForRead(id, req, rep);
+    }
+
+    // The reply depends on Accept-Encoding whichever file is found
+    const StringView acceptEncoding = req.getHeaderView(Request::accept_encoding);
+    const std::string filePath = rep.filePath_;
+    const std::string fileExtension = rep.fileExtension_;
+    const Reply::status_type status = rep.status_;
+    const size_t nrOfHeaders = rep.headers_.size();
+    for (const auto &sibling : precompressed) {
+        if (!acceptsEncoding(acceptEncoding, sibling.encoding_)) {
+            continue;
+        }
+        rep.filePath_ = filePath + sibling.suffix_;
+        size_t contentSize = fileIO_->openFileForRead(id, req, rep);
+        if (rep.status_ != Reply::not_found) {
+            // The ETag, if any, is the one of the sibling, i.e. distinct per
+            // encoding. The content type is still by the original extension.
+            if (rep.isStatusOk()) {
+                rep.addHeader("Content-Encoding", sibling.encoding_);
+            }
+            rep.addHeader("Vary", "Accept-Encoding");
+            return contentSize;
+        }
+        // Undo what the failed open set, keeping e.g. the headers added by
+        // request handlers that left the request to be served from file
+        rep.headers_.erase(rep.headers_.begin() + nrOfHeaders, rep.headers_.end());
+        rep.content_.clear();
+        rep.contentPtr_ = nullptr;
+        rep.contentSize_ = 0;
+        rep.contentOwner_.reset();
+        rep.stockReply_ = StringView();
+        rep.stockHeaderSize_ = 0;
+        rep.returnToClient_ = false;
+        rep.status_ = status;
+        rep.fileExtension_ = fileExtension;
+    }
+
+    rep.filePath_ = filePath;
+    size_t contentSize = fileIO_->openFileForRead(id, req, rep);
+    if (rep.status_ != Reply::not_found) {
+        rep.addHeader("Vary", "Accept-Encoding");
+    }
+    return contentSize;
+}
+
+bool RequestHandler::serveRanges(unsigned connectionId,
+                                 const Request &req,
+                                 Reply &rep,
+                                 size_t size) {
+    const std::string id = std::to_string(connectionId);
+    const char *data = rep.contentPtr_;
+    if (data == nullptr && !rep.offsetCallback_ && !fileIO_->seekReadFile(id, 0)) {
+        // The file can only be read from the start
+        return false;
+    }
+    rep.addHeader("Accept-Ranges", "bytes");
+    if (!prepareRanges(req, rep, size)) {
+        return false;
+    }
+
+    // From here on the content is provided by readRanges
+    rep.streamCallback_ = nullptr;
+    rep.replyPartial_ = false;
+    if (!rep.offsetCallback_ && (data != nullptr || rep.ranges_.empty())) {
+        // The open file is not needed
+        fileIO_->closeReadFile(id);
+    }
+    if (rep.ranges_.empty()) {
+        if (rep.offsetCallback_) {
+            rep.offsetCallback_(id, 0, nullptr, 0);
+        }
+        return true;
+    }
+    rep.rangeData_ = data;
+    if (rep.ranges_.size() == 1) {
+        const ByteRange &range = rep.ranges_.front();
+        size_t length = range.last_ - range.first_ + 1;
+        if (data != nullptr) {
+            // Sent straight from memory
+            rep.contentPtr_ = data + range.first_;
+            rep.contentSize_ = length;
+            return true;
+        }
+        if (!rep.offsetCallback_ && fileIO_->seekReadFile(id, range.first_) &&
+            useNativeFile(connectionId, length, rep)) {
+            return true;
+        }
+    }
+    rep.contentPtr_ = nullptr;
+    rep.replyPartial_ = true;
+    readRanges(connectionId, req, rep);
+    return true;
+}
+
+bool RequestHandler::prepareRanges(const Request &req, Reply &rep, size_t size) {
+    const StringView range = req.getHeaderView(Request::range);
+    if (range.empty() || req.method_ != "GET" || rep.status_ != Reply::ok) {
+        return false;
+    }
+
+    std::string eTag;
+    std::string contentType;
+    for (const auto &header : rep.headers_) {
+        StringView name(header.name_);
+        if (name.iequals("ETag")) {
+            eTag = header.value_;
+        } else if (name.iequals("Content-Type")) {
+            contentType = header.value_;
+        }
+    }
+    // Only parts of the same version as the client has, by a strong ETag. A
+    // date is never matched, as Last-Modified is not sent.
+    const StringView ifRange = req.getHeaderView(Request::if_range);
+    if (!ifRange.empty() &&
+        (eTag.empty() || eTag.compare(0, 2, "W/") == 0 || !(ifRange == StringView(eTag)))) {
+        return false;
+    }
+
+    std::vector<ByteRange> ranges;
+    if (!parseRanges(range, size, ranges)) {
+        return false;
+    }
+    if (ranges.empty()) {
+        rep.stockReply(req, Reply::range_not_satisfiable);
+        rep.addHeader("Content-Range", "bytes */" + std::to_string(size));
+        return true;
+    }
+
+    rep.status_ = Reply::partial_content;
+    removeHeader(rep.headers_, "Content-Length");
+    if (ranges.size() == 1) {
+        const ByteRange &only = ranges.front();
+        rep.addHeader("Content-Range",
+                      "bytes " + std::to_string(only.first_) + '-' + std::to_string(only.last_) +
+                          '/' + std::to_string(size));
+        rep.addHeader("Content-Length", std::to_string(only.last_ - only.first_ + 1));
+    } else {
+        char boundary[17];
+        snprintf(boundary,
+                 sizeof(boundary),
+                 "%08x%08x",
+                 static_cast<unsigned>(random_.generateRandom()),
+                 static_cast<unsigned>(random_.generateRandom()));
+        rep.rangeBoundary_ = boundary;
+        rep.rangeContentType_ = contentType;
+        size_t contentLength = 0;
+        for (const auto &part : ranges) {
+            contentLength += rangePartHeader(rep.rangeBoundary_, contentType, part, size).size() +
+                             part.last_ - part.first_ + 1;
+        }
+        contentLength += rep.rangeBoundary_.size() + 8;  // "\r\n--" boundary "--\r\n"
+        removeHeader(rep.headers_, "Content-Type");
+        rep.addHeader("Content-Type", "multipart/byteranges; boundary=" + rep.rangeBoundary_);
+        rep.addHeader("Content-Length", std::to_string(contentLength));
+    }
+    rep.ranges_ = std::move(ranges);
+    rep.rangeTotalSize_ = size;
+    return true;
+}
+
+void RequestHandler::readRanges(unsigned connectionId, const Request &req, Reply &rep) {
+    const std::string id = std::to_string(connectionId);
+    const bool multipart = rep.ranges_.size() > 1;
+    bool failed = false;
+    rep.content_.clear();
+    while (rep.rangeIndex_ < rep.ranges_.size()) {
+        const ByteRange &range = rep.ranges_[rep.rangeIndex_];
+        if (!rep.rangePartStarted_) {
+            if (multipart) {
+                const std::string header = rangePartHeader(
+                    rep.rangeBoundary_, rep.rangeContentType_, range, rep.rangeTotalSize_);
+                if (rep.content_.size() + header.size() > maxContentSize_) {
+                    break;
+                }
+                rep.content_.insert(rep.content_.end(), header.begin(), header.end());
+            }
+            rep.rangePartStarted_ = true;
+            rep.rangeOffset_ = range.first_;
+            if (rep.rangeData_ == nullptr && !rep.offsetCallback_ &&
+                !fileIO_->seekReadFile(id, range.first_)) {
+                failed = true;
+                break;
+            }
+        }
+
+        size_t offset = rep.content_.size();
+        size_t size = std::min(maxContentSize_ - offset, range.last_ + 1 - rep.rangeOffset_);
+        if (size == 0) {
+            break;
+        }
+        rep.content_.resize(offset + size);
+        char *buf = rep.content_.data() + offset;
+        int nrReadBytes;
+        if (rep.rangeData_ != nullptr) {
+            std::memcpy(buf, rep.rangeData_ + rep.rangeOffset_, size);
+            nrReadBytes = static_cast<int>(size);
+        } else if (rep.offsetCallback_) {
+            nrReadBytes = rep.offsetCallback_(id, rep.rangeOffset_, buf, size);
+        } else {
+            nrReadBytes = fileIO_->readFile(id, req, buf, size);
+        }
+        if (nrReadBytes <= 0) {
+            // Shorter than announced
+            rep.content_.resize(offset);
+            failed = true;
+            break;
+        }
+        rep.content_.resize(offset + nrReadBytes);
+        rep.rangeOffset_ += nrReadBytes;
+        if (rep.rangeOffset_ > range.last_) {
+            rep.rangeIndex_++;
+            rep.rangePartStarted_ = false;
+        }
+    }
+
+    if (!failed && rep.rangeIndex_ < rep.ranges_.size()) {
+        return;
+    }
+    if (!failed && multipart) {
+        const std::string end = "\r\n--" + rep.rangeBoundary_ + "--\r\n";
+        if (rep.content_.size() + end.size() > maxContentSize_) {
+            // Sent next time
+            return;
+        }
+        rep.content_.insert(rep.content_.end(), end.begin(), end.end());
+    }
+    rep.finalPart_ = true;
+    if (rep.offsetCallback_) {
+        rep.offsetCallback_(id, rep.rangeOffset_, nullptr, 0);
+    } else if (rep.rangeData_ == nullptr) {
+        fileIO_->closeReadFile(id);
+    }
+}
+
+void RequestHandler::compressReply(unsigned connectionId, const Request &req, Reply &rep) {
+    if (compressorFactory_ == nullptr || rep.isStockReply() || rep.status_ != Reply::ok ||
+        req.method_ == "HEAD") {
+        return;
+    }
+
+    // Only content not already encoded, text based and of unknown or large
+    // enough size
+    std::string contentType;
+    size_t contentLength = std::string::npos;
+    bool hasVary = false;
+    for (const auto &header : rep.headers_) {
+        StringView name(header.name_);
+        if (name.iequals("Content-Encoding")) {
+            return;
+        } else if (name.iequals("Content-Type")) {
+            contentType = header.value_.substr(0, header.value_.find(';'));
+        } else if (name.iequals("Content-Length")) {
+            contentLength = std::strtoul(header.value_.c_str(), nullptr, 10);
+        } else if (name.iequals("Vary")) {
+            hasVary = true;
+        }
+    }
+    if (!isCompressibleType(contentType) || contentLength < compressMinSize_) {
+        return;
+    }
+
+    // The reply depends on Accept-Encoding whether compressed or not
+    if (!hasVary) {
+        rep.addHeader("Vary", "Accept-Encoding");
+    }
+    const StringView acceptEncoding = req.getHeaderView(Request::accept_encoding);
+    const char *coding = nullptr;
+    for (const char *candidate : {"gzip", "deflate"}) {
+        if (acceptsEncoding(acceptEncoding, candidate)) {
+            rep.compressor_ = compressorFactory_->create(candidate);
+            if (rep.compressor_) {
+                coding = candidate;
+                break;
+            }
+        }
+    }
+    if (coding == nullptr) {
+        return;
+    }
+
+    if (!rep.replyPartial_ && !rep.streamCallback_) {
+        // All content at hand, compressed in one go and sent with its length
+        const char *data = rep.contentPtr_ != nullptr ? rep.contentPtr_ : rep.content_.data();
+        size_t size = rep.contentPtr_ != nullptr ? rep.contentSize_ : rep.content_.size();
+        bool compressed = rep.compressor_->compress(data, size, rep.compressBuffer_, true);
+        rep.compressor_.reset();
+        if (!compressed) {
+            // Sent as is instead
+            std::vector<char>().swap(rep.compressBuffer_);
+            return;
+        }
+        rep.contentPtr_ = rep.compressBuffer_.data();
+        rep.contentSize_ = rep.compressBuffer_.size();
+        for (auto &header : rep.headers_) {
+            if (StringView(header.name_).iequals("Content-Length")) {
+                header.value_ = std::to_string(rep.contentSize_);
+            }
+        }
+        // Ranges are of the uncompressed content
+        removeHeader(rep.headers_, "Accept-Ranges");
+        rep.addHeader("Content-Encoding", coding);
+        return;
+    }
+
+    // Written in several parts, so the compressed length is not known until
+    // the end and the content is sent in chunks instead
+    removeHeader(rep.headers_, "Content-Length");
+    removeHeader(rep.headers_, "Accept-Ranges");
+    if (!rep.useChunkedEncoding_) {
+        rep.addHeader("Transfer-Encoding", "chunked");
+    }
+    rep.addHeader("Content-Encoding", coding);
+
+    if (rep.streamCallback_) {
+        // Compressed as produced, see handleStreamingRead
+        return;
+    }
+    if (rep.nativeFile_.fd_ >= 0) {
+        // The file goes through the compressor, so read it instead
+        rep.nativeFile_ = NativeReadFile();
+        readFromFile(connectionId, req, rep);
+    }
+    compressContent(rep, rep.content_.data(), rep.content_.size(), false);
+}
+
+void RequestHandler::compressContent(Reply &rep, const char *data, size_t size, bool finish) {
+    // Leave room for the chunk size line in front of the compressed data
+    const size_t maxChunkSizeLine = 2 * sizeof(size_t) + 2;
+    std::vector<char> &out = rep.compressBuffer_;
+    out.resize(maxChunkSizeLine);
+    bool compressed = rep.compressor_->compress(data, size, out, finish);
+
+    size_t begin = maxChunkSizeLine;
+    if (!compressed) {
+        out.resize(maxChunkSizeLine);
+    } else if (out.size() > maxChunkSizeLine) {
+        const std::string sizeLine = rep.toHexString(out.size() - maxChunkSizeLine) + "\r\n";
+        begin -= sizeLine.size();
+        std::copy(sizeLine.begin(), sizeLine.end(), out.begin() + begin);
+        out.push_back('\r');
+        out.push_back('\n');
+    }
+    if (finish || !compressed) {
+        // The last chunk. Also sent if compression failed, leaving the client
+        // with a truncated stream, but the connection in a known state.
+        const char lastChunk[] = "0\r\n\r\n";
+        out.insert(out.end(), lastChunk, lastChunk + sizeof(lastChunk) - 1);
+        rep.finalPart_ = true;
+    }
+    rep.contentPtr_ = out.data() + begin;
+    rep.contentSize_ = out.size() - begin;
+}
+
 size_t RequestHandler::readFromFile(unsigned connectionId, const Request &req, Reply &rep) {
     rep.content_.resize(maxContentSize_);
     int nrReadBytes = fileIO_->readFile(
@@ -243,56 +902,101 @@ size_t RequestHandler::readFromFile(unsigned connectionId, const Request &req, R
     return nrReadBytes;
 }
 
+bool RequestHandler::useNativeFile(unsigned connectionId, size_t contentSize, Reply &rep) {
+#if defined(BEAUTY_HAS_SENDFILE)
+    // Files fitting in one buffer go out with the headers in a single write
+    NativeReadFile file;
+    if (contentSize > maxContentSize_ &&
+        fileIO_->getNativeReadFile(std::to_string(connectionId), file) && file.fd_ >= 0 &&
+        file.length_ >= contentSize) {
+        // From the read position, i.e. the start of a range if any
+        file.length_ = contentSize;
+        rep.nativeFile_ = file;
+        rep.replyPartial_ = true;
+        return true;
+    }
+#else
+    (void)connectionId;
+    (void)contentSize;
+    (void)rep;
+#endif
+    return false;
+}
+
 void RequestHandler::writeFileParts(unsigned connectionId,
                                     const Request &req,
                                     Reply &rep,
-                                    std::deque<MultiPartParser::ContentPart> &parts) {
-    // It seems that some clients first deliver a "headerOnly" part of the
-    // multipart (assumably checking for non successful response) and then in
-    // successive request deliver the part data. If so, we handle this nicely
-    // here by giving the client an early non-successful reply. However this
-    const std::deque<MultiPartParser::ContentPart> &peakParts = rep.multiPartParser_.peakLastPart();
-    for (auto &part : peakParts) {
-        if (part.headerOnly_ && !part.filename_.empty()) {
-            rep.filePath_ = combineUploadPaths(req.requestPath_, part.filename_);
-            fileIO_->openFileForWrite(rep.filePath_ + std::to_string(connectionId), req, rep);
+                                    size_t bodyPos) {
+    const MultiPartParser &parser = rep.multiPartParser_;
+    for (size_t i = 0; i < parser.getNoParts(); ++i) {
+        const MultiPartParser::ContentPart &part = parser.getPart(i);
+        if (part.foundStart_ && !part.filename_.empty()) {
+            // Opened as soon as the part headers have been received, so that
+            // the client gets an early non-successful reply
+            rep.filePath_ = combineUploadPaths(req.requestPath_, part.filename_.str());
+            rep.lastOpenFileForWriteId_ = rep.filePath_ + std::to_string(connectionId);
+            fileIO_->openFileForWrite(rep.lastOpenFileForWriteId_, req, rep);
             if (!rep.isStatusOk()) {
+                rep.lastOpenFileForWriteId_.clear();
                 return;
             }
+            if (preallocateUploads_ && req.contentLength_ > bodyPos &&
+                req.contentLength_ != std::numeric_limits<size_t>::max()) {
+                fileIO_->preallocateWriteFile(rep.lastOpenFileForWriteId_,
+                                              req.contentLength_ - bodyPos);
+            }
+        }
+        if (rep.lastOpenFileForWriteId_.empty() || (part.start_ == part.end_ && !part.foundEnd_)) {
+            // Not a file, or no data yet
+            continue;
+        }
+        writeUploadData(req, rep, part.start_, part.end_ - part.start_, part.foundEnd_);
+        if (!rep.isStatusOk()) {
+            rep.lastOpenFileForWriteId_.clear();
+            rep.uploadBuffer_.clear();
+            return;
+        }
+        if (part.foundEnd_) {
+            rep.lastOpenFileForWriteId_.clear();
         }
     }
+}
 
-    // This loop do the actual writing of data to files in sucessive order.
-    for (auto &part : parts) {
-        // if 'headerOnly' it as already been handled above
-        if (part.headerOnly_ && !part.filename_.empty()) {
-            const std::string filePath = combineUploadPaths(req.requestPath_, part.filename_);
-            rep.lastOpenFileForWriteId_ = filePath + std::to_string(connectionId);
-        } else {
-            if (!part.filename_.empty()) {
-                // In case client did not issue "headerOnly", its OK, we open
-                // the file for writing here. However as we are one request too
-                // late, the response will be late too.
-                rep.filePath_ = combineUploadPaths(req.requestPath_, part.filename_);
-                rep.lastOpenFileForWriteId_ = rep.filePath_ + std::to_string(connectionId);
-                fileIO_->openFileForWrite(rep.lastOpenFileForWriteId_, req, rep);
-                if (!rep.isStatusOk()) {
-                    return;
-                }
-            }
-            size_t size = part.end_ - part.start_;
-            fileIO_->writeFile(
-                rep.lastOpenFileForWriteId_, req, rep, &(*part.start_), size, part.foundEnd_);
-            if (!rep.isStatusOk()) {
-                rep.lastOpenFileForWriteId_.clear();
-                return;
-            }
-            if (part.foundEnd_) {
-                rep.lastOpenFileForWriteId_.clear();
-                rep.finalPart_ = true;
-            }
+void RequestHandler::writeUploadData(
+    const Request &req, Reply &rep, const char *data, size_t size, bool lastData) {
+    const std::string &id = rep.lastOpenFileForWriteId_;
+    if (uploadBlockSize_ == 0) {
+        fileIO_->writeFile(id, req, rep, data, size, lastData);
+        return;
+    }
+
+    std::vector<char> &buffer = rep.uploadBuffer_;
+    if (!buffer.empty()) {
+        // Complete the block started by previous data
+        size_t n = std::min(size, uploadBlockSize_ - buffer.size());
+        buffer.insert(buffer.end(), data, data + n);
+        data += n;
+        size -= n;
+        if (buffer.size() < uploadBlockSize_ && !lastData) {
+            return;
+        }
+        bool last = lastData && size == 0;
+        fileIO_->writeFile(id, req, rep, buffer.data(), buffer.size(), last);
+        buffer.clear();
+        if (last || !rep.isStatusOk()) {
+            return;
         }
     }
+
+    // Whole blocks are written from data, the rest is kept for the next
+    size_t direct = lastData ? size : size - size % uploadBlockSize_;
+    if (direct > 0 || lastData) {
+        fileIO_->writeFile(id, req, rep, data, direct, lastData);
+    }
+    if (direct < size) {
+        buffer.reserve(uploadBlockSize_);
+        buffer.insert(buffer.end(), data + direct, data + size);
+    }
 }
 
 }  // namespace beauty
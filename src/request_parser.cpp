@@ -1,6 +1,8 @@
 #include <algorithm>
-#include <strings.h>
+#include <cstdlib>
+#include <cstring>
 
+#include "beauty/char_scan.hpp"
 #include "beauty/parse_common.hpp"
 #include "beauty/request.hpp"
 #include "beauty/request_parser.hpp"
@@ -11,25 +13,67 @@ RequestParser::RequestParser() : state_(method_start) {}
 
 void RequestParser::reset() {
     state_ = method_start;
+    contentLength_ = std::numeric_limits<size_t>::max();
+    unconsumedData_ = nullptr;
+    unconsumedSize_ = 0;
+    upgradeWebSocketHeader_ = false;
+    chunkedDecoder_.reset();
+}
+
+void RequestParser::setHeaderViewsOnly(bool headerViewsOnly) {
+    headerViewsOnly_ = headerViewsOnly;
+}
+
+void RequestParser::setMaxChunkSize(size_t maxChunkSize) {
+    chunkedDecoder_.setMaxChunkSize(maxChunkSize);
 }
 
 RequestParser::result_type RequestParser::parse(Request &req, std::vector<char> &content) {
-    auto begin = content.begin();
-    auto end = content.end();
+    // Body data is moved to the front of content while parsing, which never
+    // overtakes the read position nor reallocates, so data stays valid.
+    data_ = content.data();
+    copied_ = 0;
+    pos_ = 0;
     size_t totalContentLength = content.size();
+    unconsumedData_ = nullptr;
+    unconsumedSize_ = 0;
 
-    while (begin != end) {
-        result_type result = consume(req, content, *begin++);
+    while (pos_ < totalContentLength) {
+        if (state_ == chunked) {
+            break;
+        }
+        skipTokenBytes(req, content, totalContentLength);
+        if (pos_ == totalContentLength) {
+            break;
+        }
+        result_type result = consume(req, content, data_[pos_]);
+        ++pos_;
         if (result != indeterminate) {
             // Check for 100-continue protocol violation after parsing completes
-            if (result == good_headers_expect_continue && std::distance(begin, end) > 0) {
+            if (result == good_headers_expect_continue && pos_ < totalContentLength) {
                 // Client sent Expect: 100-continue but included body data without waiting
                 return expect_continue_with_body;
             }
+            if (result == good_complete && pos_ < totalContentLength) {
+                // Pipelined request(s) following this one
+                unconsumedData_ = data_ + pos_;
+                unconsumedSize_ = totalContentLength - pos_;
+            }
             return result;
         }
     }
 
+    if (state_ == chunked) {
+        return decodeChunkedBody(req, content, totalContentLength);
+    }
+
+    if (state_ != post) {
+        // Request line or headers are incomplete, e.g. split over several
+        // reads or the start of a pipelined request.
+        copyHeaderData(req);
+        return indeterminate;
+    }
+
     if (req.contentLength_ == std::numeric_limits<size_t>::max()) {
         // As we may not have received the Content-Length header for HTTP/1.0
         // requests, we decide good_part or good_complete on whether the
@@ -43,6 +87,116 @@ RequestParser::result_type RequestParser::parse(Request &req, std::vector<char>
     return good_part;
 }
 
+size_t RequestParser::getUnconsumedSize() const {
+    return unconsumedSize_;
+}
+
+void RequestParser::takeUnconsumed(std::vector<char> &dest) {
+    dest.assign(unconsumedData_, unconsumedData_ + unconsumedSize_);
+    unconsumedData_ = nullptr;
+    unconsumedSize_ = 0;
+}
+
+RequestParser::result_type RequestParser::parseChunked(std::vector<char> &content,
+                                                       size_t offset) {
+    unconsumedData_ = nullptr;
+    unconsumedSize_ = 0;
+    size_t bodySize = 0;
+    size_t consumed = 0;
+    ChunkedDecoder::result_type result = chunkedDecoder_.decode(
+        content.data() + offset, content.size() - offset, bodySize, consumed);
+    if (result == ChunkedDecoder::done && offset + consumed < content.size()) {
+        // Pipelined request(s) following this one, kept in place by the
+        // resize below
+        unconsumedData_ = content.data() + offset + consumed;
+        unconsumedSize_ = content.size() - offset - consumed;
+    }
+    content.resize(offset + bodySize);
+    return toResult(result);
+}
+
+RequestParser::result_type RequestParser::decodeChunkedBody(Request &req,
+                                                            std::vector<char> &content,
+                                                            size_t size) {
+    // The body is decoded in place and then moved to the front of content.
+    size_t bodySize = 0;
+    size_t consumed = 0;
+    ChunkedDecoder::result_type result =
+        chunkedDecoder_.decode(content.data() + pos_, size - pos_, bodySize, consumed);
+    if (result == ChunkedDecoder::done && pos_ + consumed < size) {
+        // Pipelined request(s) following this one
+        unconsumedData_ = data_ + pos_ + consumed;
+        unconsumedSize_ = size - pos_ - consumed;
+    }
+    moveBody(req, content, bodySize);
+    if (result == ChunkedDecoder::done) {
+        req.contentLength_ = content.size();
+    }
+    return toResult(result);
+}
+
+RequestParser::result_type RequestParser::toResult(ChunkedDecoder::result_type result) {
+    switch (result) {
+        case ChunkedDecoder::done:
+            return good_complete;
+        case ChunkedDecoder::bad:
+            return bad;
+        case ChunkedDecoder::chunk_too_large:
+            return payload_too_large;
+        default:
+            return good_part;
+    }
+}
+
+size_t RequestParser::moveBody(Request &req, std::vector<char> &content, size_t n) {
+    // Moved in chunks not reaching the read position, as resize clears the
+    // bytes it adds.
+    size_t moved = 0;
+    while (n > moved && content.size() < pos_) {
+        size_t bodySize = content.size();
+        size_t chunk = std::min(n - moved, pos_ - bodySize);
+        content.resize(bodySize + chunk);
+        std::memcpy(&content[bodySize], data_ + pos_, chunk);
+        pos_ += chunk;
+        moved += chunk;
+    }
+    req.noInitialBodyBytesReceived_ += moved;
+    return moved;
+}
+
+void RequestParser::skipTokenBytes(Request &req, std::vector<char> &content, size_t size) {
+    switch (state_) {
+        case method:
+        case header_name:
+            pos_ += scanToken(data_ + pos_, size - pos_);
+            break;
+        case uri:
+            pos_ += scanUri(data_ + pos_, size - pos_);
+            break;
+        case header_value:
+            pos_ += scanFieldValue(data_ + pos_, size - pos_);
+            break;
+        case post: {
+            // Move all but the last body byte, which is consumed to complete
+            // the request.
+            size_t n = std::min(contentLength_, size - pos_) - 1;
+            contentLength_ -= moveBody(req, content, n);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+size_t RequestParser::offset(const Request &req) const {
+    return req.headerData_.size() + pos_ - copied_;
+}
+
+void RequestParser::copyHeaderData(Request &req) {
+    req.headerData_.insert(req.headerData_.end(), data_ + copied_, data_ + pos_);
+    copied_ = pos_;
+}
+
 RequestParser::result_type RequestParser::consume(Request &req,
                                                   std::vector<char> &content,
                                                   char input) {
@@ -52,16 +206,15 @@ RequestParser::result_type RequestParser::consume(Request &req,
                 return bad;
             } else {
                 state_ = method;
-                req.method_.push_back(input);
+                req.methodRef_.offset_ = offset(req);
             }
             return indeterminate;
         case method:
             if (input == ' ') {
                 state_ = uri_start;
+                req.methodRef_.size_ = offset(req) - req.methodRef_.offset_;
             } else if (!isChar(input) || isCtl(input) || isTsspecial(input)) {
                 return bad;
-            } else {
-                req.method_.push_back(input);
             }
             return indeterminate;
         case uri_start:
@@ -69,16 +222,15 @@ RequestParser::result_type RequestParser::consume(Request &req,
                 return bad;
             } else {
                 state_ = uri;
-                req.uri_.push_back(input);
+                req.uriRef_.offset_ = offset(req);
             }
             return indeterminate;
         case uri:
             if (input == ' ') {
                 state_ = http_version_h;
+                req.uriRef_.size_ = offset(req) - req.uriRef_.offset_;
             } else if (isCtl(input)) {
                 return bad;
-            } else {
-                req.uri_.push_back(input);
             }
             return indeterminate;
         case http_version_h:
@@ -162,6 +314,9 @@ RequestParser::result_type RequestParser::consume(Request &req,
                 // Set default keep-alive based on HTTP version.
                 // Presence of a Connection header may override this later.
                 req.keepAlive_ = (req.httpVersionMajor_ == 1 && req.httpVersionMinor_ > 0);
+                copyHeaderData(req);
+                req.method_.assign(req.getMethodView().begin(), req.getMethodView().end());
+                req.uri_.assign(req.getUriView().begin(), req.getUriView().end());
             } else {
                 return bad;
             }
@@ -169,15 +324,20 @@ RequestParser::result_type RequestParser::consume(Request &req,
         case header_line_start:
             if (input == '\r') {
                 state_ = expecting_newline_3;
-            } else if (!req.headers_.empty() && (input == ' ' || input == '\t')) {
+            } else if (!req.headerRefs_.empty() && (input == ' ' || input == '\t')) {
+                // Obsolete line folding, the CRLF is replaced by spaces so
+                // that the value stays contiguous.
+                copyHeaderData(req);
+                size_t end = req.headerRefs_.back().value_.offset_ +
+                             req.headerRefs_.back().value_.size_;
+                req.headerData_[end] = ' ';
+                req.headerData_[end + 1] = ' ';
                 state_ = header_lws;
             } else if (!isChar(input) || isCtl(input) || isTsspecial(input)) {
                 return bad;
             } else {
-                req.headers_.push_back(Header());
-                req.headers_.back().name_.reserve(16);
-                req.headers_.back().value_.reserve(16);
-                req.headers_.back().name_.push_back(input);
+                req.headerRefs_.push_back(Request::HeaderRef());
+                req.headerRefs_.back().name_.offset_ = offset(req);
                 state_ = header_name;
             }
             return indeterminate;
@@ -190,33 +350,34 @@ RequestParser::result_type RequestParser::consume(Request &req,
                 return bad;
             } else {
                 state_ = header_value;
-                req.headers_.back().value_.push_back(input);
             }
             return indeterminate;
         case header_name:
             if (input == ':') {
                 state_ = space_before_header_value;
+                Request::Ref &name = req.headerRefs_.back().name_;
+                name.size_ = offset(req) - name.offset_;
             } else if (!isChar(input) || isCtl(input) || isTsspecial(input)) {
                 return bad;
-            } else {
-                req.headers_.back().name_.push_back(input);
             }
             return indeterminate;
         case space_before_header_value:
             if (input == ' ') {
                 state_ = header_value;
+                req.headerRefs_.back().value_.offset_ = offset(req) + 1;
             } else {
                 return bad;
             }
             return indeterminate;
         case header_value:
             if (input == '\r') {
+                Request::Ref &value = req.headerRefs_.back().value_;
+                value.size_ = offset(req) - value.offset_;
+                copyHeaderData(req);
                 storeHeaderValueIfNeeded(req);
                 state_ = expecting_newline_2;
             } else if (isCtl(input)) {
                 return bad;
-            } else {
-                req.headers_.back().value_.push_back(input);
             }
             return indeterminate;
         case expecting_newline_2:
@@ -231,9 +392,17 @@ RequestParser::result_type RequestParser::consume(Request &req,
             if (res != indeterminate) {
                 return res;
             }
+            // The header data must be copied before it is overwritten by body data
+            copyHeaderData(req);
             // start filling up body data
             content.clear();
-            if (contentLength_ == 0) {
+            if (req.isChunked_) {
+                if (input != '\n') {
+                    return bad;
+                }
+                req.noInitialBodyBytesReceived_ = 0;
+                state_ = chunked;
+            } else if (contentLength_ == 0) {
                 if (input == '\n') {
                     return good_complete;
                 } else {
@@ -259,36 +428,64 @@ RequestParser::result_type RequestParser::consume(Request &req,
 }
 
 void RequestParser::storeHeaderValueIfNeeded(Request &req) {
-    Header &h = req.headers_.back();
+    size_t index = req.headerRefs_.size() - 1;
+    StringView name = req.getHeaderNameView(index);
+    StringView value = req.getHeaderValueView(index);
+    Request::known_header known = Request::toKnownHeader(name);
+    if (known != Request::nr_of_known_headers && req.knownHeaders_[known] == 0) {
+        req.knownHeaders_[known] = index + 1;
+    }
 
-    if (strcasecmp(h.name_.c_str(), "Content-Length") == 0) {
-        size_t actualContentLength = atoi(h.value_.c_str());
-        req.contentLength_ = actualContentLength;
-        contentLength_ = actualContentLength;
-    } else if (strcasecmp(h.name_.c_str(), "Transfer-Encoding") == 0) {
-        if (strcasecmp(h.value_.c_str(), "chunked") == 0) {
-            req.isChunked_ = true;
+    if (!headerViewsOnly_) {
+        if (req.headers_.size() < req.headerRefs_.size()) {
+            req.headers_.push_back({name.str(), value.str()});
+        } else {
+            // Continuation of a folded header
+            req.headers_.back().value_ = value.str();
         }
-    } else if (strcasecmp(h.name_.c_str(), "Expect") == 0) {
-        if (strcasecmp(h.value_.c_str(), "100-continue") == 0) {
-            req.expectContinue_ = true;
+    }
+
+    switch (known) {
+        case Request::content_length: {
+            size_t actualContentLength = atoi(value.str().c_str());
+            req.contentLength_ = actualContentLength;
+            contentLength_ = actualContentLength;
+            break;
         }
-    } else if (strcasecmp(h.name_.c_str(), "Connection") == 0) {
-        if (req.httpVersionMajor_ == 1 && req.httpVersionMinor_ < 1) {
-            // HTTP/1.0: Keep-Alive must be explicitly specified
-            if (strcasecmp(h.value_.c_str(), "Keep-Alive") == 0) {
-                req.keepAlive_ = true;
+        case Request::transfer_encoding:
+            if (value.iequals("chunked")) {
+                req.isChunked_ = true;
             }
-        } else {
-            // HTTP/1.1+: Keep-Alive is default unless "close" is specified
-            if (strcasecmp(h.value_.c_str(), "close") == 0) {
-                req.keepAlive_ = false;
+            break;
+        case Request::expect:
+            if (value.iequals("100-continue")) {
+                req.expectContinue_ = true;
+            }
+            break;
+        case Request::connection:
+            if (req.httpVersionMajor_ == 1 && req.httpVersionMinor_ < 1) {
+                // HTTP/1.0: Keep-Alive must be explicitly specified
+                if (value.iequals("Keep-Alive")) {
+                    req.keepAlive_ = true;
+                }
+            } else {
+                // HTTP/1.1+: Keep-Alive is default unless "close" is specified
+                if (value.iequals("close")) {
+                    req.keepAlive_ = false;
+                }
             }
-        }
 
-        if (strcasecmp(h.value_.c_str(), "Upgrade") == 0) {
-            req.upgradeToWebSocket_ = true;
-        }
+            if (value.iequals("Upgrade")) {
+                req.upgradeToWebSocket_ = true;
+            }
+            break;
+        case Request::upgrade:
+            if (value.iequals("websocket")) {
+                upgradeWebSocketHeader_ = true;
+            }
+            break;
+        default:
+            break;
     }
 }
 
@@ -305,9 +502,9 @@ RequestParser::result_type RequestParser::checkRequestAfterAllHeaders(Request &r
         if (req.httpVersionMajor_ == 1 && req.httpVersionMinor_ > 0) {
             if (req.isChunked_) {
                 // setting Transfer-Encoding: chunked and Content-Length is invalid
-                return req.contentLength_ == std::numeric_limits<size_t>::max()
-                           ? missing_content_length
-                           : bad;
+                if (req.contentLength_ != std::numeric_limits<size_t>::max()) {
+                    return bad;
+                }
             } else if (req.contentLength_ == std::numeric_limits<size_t>::max()) {
                 return missing_content_length;
             }
@@ -320,11 +517,7 @@ RequestParser::result_type RequestParser::checkRequestAfterAllHeaders(Request &r
 
     if (req.upgradeToWebSocket_) {
         if (req.httpVersionMajor_ == 1 && req.httpVersionMinor_ == 1 && req.method_ == "GET") {
-            auto it = std::find_if(req.headers_.begin(), req.headers_.end(), [](const Header &h) {
-                return strcasecmp(h.name_.c_str(), "Upgrade") == 0 &&
-                       strcasecmp(h.value_.c_str(), "websocket") == 0;
-            });
-            if (it == req.headers_.end()) {
+            if (!upgradeWebSocketHeader_) {
                 return bad;
             }
         } else {
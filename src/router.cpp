@@ -236,16 +236,14 @@ bool Router::isPreflightRequest(const Request& req) {
         return false;
 
     // Check for required CORS preflight headers
-    std::string origin = req.getHeaderValue("Origin");
-    std::string requestMethod = req.getHeaderValue("Access-Control-Request-Method");
-
-    return !origin.empty() && !requestMethod.empty();
+    return !req.getHeaderView(Request::origin).empty() &&
+           !req.getHeaderView(Request::access_control_request_method).empty();
 }
 
 bool Router::handleCorsPreflight(const Request& req, Reply& rep) {
-    std::string origin = req.getHeaderValue("Origin");
-    std::string requestMethod = req.getHeaderValue("Access-Control-Request-Method");
-    std::string requestHeaders = req.getHeaderValue("Access-Control-Request-Headers");
+    std::string origin = req.getHeaderView(Request::origin).str();
+    std::string requestMethod = req.getHeaderView(Request::access_control_request_method).str();
+    std::string requestHeaders = req.getHeaderView(Request::access_control_request_headers).str();
 
     // Check if origin is allowed
     if (!corsConfig_.isOriginAllowed(origin)) {
@@ -334,11 +332,12 @@ bool Router::isCorsSafelistedHeader(const std::string& header) {
 }
 
 void Router::addCorsHeaders(const Request& req, Reply& rep) {
-    std::string origin = req.getHeaderValue("Origin");
+    StringView originView = req.getHeaderView(Request::origin);
 
-    if (origin.empty())
+    if (originView.empty())
         return;  // Not a cross-origin request
 
+    std::string origin = originView.str();
     if (!corsConfig_.isOriginAllowed(origin))
         return;  // Origin not allowed
 
@@ -7,7 +7,11 @@
 
 namespace {
 void defaultDebugMsgHandler(const std::string &) {}
-}
+
+#if defined(SO_REUSEPORT)
+typedef asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port;
+#endif
+}  // namespace
 
 namespace beauty {
 
@@ -17,9 +21,11 @@ Server::Server(asio::io_context &ioContext,
                size_t maxContentSize)
     : acceptor_(ioContext, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port)),
       connectionManager_(settings),
-      requestHandler_(maxContentSize),
+      requestHandler_(maxContentSize, settings),
       timer_(ioContext),
+      tickInterval_(settings.timerResolution_),
       maxContentSize_(maxContentSize),
+      bufferPool_(std::make_shared<BufferPool>(maxContentSize, settings.bufferPoolSize_)),
       debugMsgCb_(defaultDebugMsgHandler) {
     if (maxContentSize < 1024) {
         debugMsgCb_("maxContentSize must be equal or larger than 1024 bytes");
@@ -36,9 +42,11 @@ Server::Server(asio::io_context &ioContext,
                size_t maxContentSize)
     : acceptor_(ioContext),
       connectionManager_(settings),
-      requestHandler_(maxContentSize),
+      requestHandler_(maxContentSize, settings),
       timer_(ioContext),
+      tickInterval_(settings.timerResolution_),
       maxContentSize_(maxContentSize),
+      bufferPool_(std::make_shared<BufferPool>(maxContentSize, settings.bufferPoolSize_)),
       debugMsgCb_(defaultDebugMsgHandler) {
     // Register to handle the signals that indicate when the server should exit.
     // It is safe to register for the same signal multiple times in a program,
@@ -62,6 +70,13 @@ Server::Server(asio::io_context &ioContext,
     asio::ip::tcp::endpoint endpoint = *resolver.resolve(address, port).begin();
     acceptor_.open(endpoint.protocol());
     acceptor_.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+    if (settings.reusePort_) {
+#if defined(SO_REUSEPORT)
+        acceptor_.set_option(reuse_port(true));
+#else
+        debugMsgCb_("SO_REUSEPORT is not supported on this platform");
+#endif
+    }
     acceptor_.bind(endpoint);
     acceptor_.listen();
 
@@ -73,6 +88,10 @@ uint16_t Server::getBindedPort() const {
     return acceptor_.local_endpoint().port();
 }
 
+BufferPool::Stats Server::getBufferPoolStats() const {
+    return bufferPool_->getStats();
+}
+
 void Server::setFileIO(IFileIO *fileIO) {
     requestHandler_.setFileIO(fileIO);
 }
@@ -81,6 +100,10 @@ void Server::addRequestHandler(const handlerCallback &cb) {
     requestHandler_.addRequestHandler(cb);
 }
 
+void Server::setCompressorFactory(ICompressorFactory *factory) {
+    requestHandler_.setCompressorFactory(factory);
+}
+
 void Server::setExpectContinueHandler(const handlerCallback &cb) {
     requestHandler_.setExpectContinueHandler(cb);
 }
@@ -94,6 +117,15 @@ void Server::setDebugMsgHandler(const debugMsgCallback &cb) {
     debugMsgCb_ = cb;
 }
 
+void Server::stop() {
+    if (signals_) {
+        signals_->cancel();
+    }
+    timer_.cancel();
+    acceptor_.close();
+    connectionManager_.stopAll();
+}
+
 void Server::doAccept() {
     acceptor_.async_accept([this](std::error_code ec, asio::ip::tcp::socket socket) {
         // Check whether the server was stopped by a signal before this
@@ -106,8 +138,10 @@ void Server::doAccept() {
             connectionManager_.start(std::make_shared<Connection>(std::move(socket),
                                                                   connectionManager_,
                                                                   requestHandler_,
-                                                                  connectionId_++,
-                                                                  maxContentSize_));
+                                                                  connectionId_,
+                                                                  maxContentSize_,
+                                                                  bufferPool_));
+            connectionId_ += connectionIdStride_;
         } else {
             debugMsgCb_("doAccept: " + ec.message() + ":" + std::to_string(ec.value()));
         }
@@ -117,15 +151,16 @@ void Server::doAccept() {
 }
 
 void Server::doAwaitStop() {
-    signals_->async_wait([this](std::error_code /*ec*/, int /*signo*/) {
-        timer_.cancel();
-        acceptor_.close();
-        connectionManager_.stopAll();
+    signals_->async_wait([this](std::error_code ec, int /*signo*/) {
+        if (ec == asio::error::operation_aborted) {
+            return;
+        }
+        stop();
     });
 }
 
 void Server::doTick() {
-    timer_.expires_after(std::chrono::seconds(1));
+    timer_.expires_after(tickInterval_);
     timer_.async_wait([this](std::error_code ec) {
         if (!ec) {
             connectionManager_.tick();
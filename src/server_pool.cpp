@@ -0,0 +1,128 @@
+#include <string>
+#include <utility>
+
+#include "beauty/server_pool.hpp"
+
+namespace beauty {
+
+ServerPool::ServerPool(const std::string &address,
+                       const std::string &port,
+                       size_t nrOfWorkers,
+                       const Settings &settings,
+                       size_t maxContentSize)
+    : settings_(settings) {
+#if defined(SO_REUSEPORT)
+    settings_.reusePort_ = true;
+#else
+    nrOfWorkers = 1;
+#endif
+    if (nrOfWorkers == 0) {
+        nrOfWorkers = 1;
+    }
+
+    std::string bindPort = port;
+    for (size_t i = 0; i < nrOfWorkers; ++i) {
+        std::unique_ptr<Worker> worker(new Worker);
+        worker->server_.reset(
+            new Server(worker->ioContext_, address, bindPort, settings_, maxContentSize));
+
+        // Connection ids are interleaved, so they stay unique across workers.
+        worker->server_->connectionId_ = static_cast<unsigned>(i);
+        worker->server_->connectionIdStride_ = static_cast<unsigned>(nrOfWorkers);
+
+        // If an OS-assigned port was requested, the following workers must
+        // bind to the port picked for the first one.
+        if (i == 0) {
+            bindPort = std::to_string(worker->server_->getBindedPort());
+        }
+        workers_.push_back(std::move(worker));
+    }
+}
+
+ServerPool::~ServerPool() {
+    stop();
+    join();
+}
+
+uint16_t ServerPool::getBindedPort() const {
+    return workers_.front()->server_->getBindedPort();
+}
+
+size_t ServerPool::getNrOfWorkers() const {
+    return workers_.size();
+}
+
+asio::io_context &ServerPool::getIoContext(size_t worker) {
+    return workers_.at(worker)->ioContext_;
+}
+
+Server &ServerPool::getServer(size_t worker) {
+    return *workers_.at(worker)->server_;
+}
+
+void ServerPool::setFileIO(IFileIO *fileIO) {
+    for (auto &w : workers_) {
+        w->server_->setFileIO(fileIO);
+    }
+}
+
+void ServerPool::setCompressorFactory(ICompressorFactory *factory) {
+    for (auto &w : workers_) {
+        w->server_->setCompressorFactory(factory);
+    }
+}
+
+void ServerPool::addRequestHandler(const handlerCallback &cb) {
+    for (auto &w : workers_) {
+        w->server_->addRequestHandler(cb);
+    }
+}
+
+void ServerPool::setExpectContinueHandler(const handlerCallback &cb) {
+    for (auto &w : workers_) {
+        w->server_->setExpectContinueHandler(cb);
+    }
+}
+
+void ServerPool::setDebugMsgHandler(const debugMsgCallback &cb) {
+    for (auto &w : workers_) {
+        w->server_->setDebugMsgHandler(cb);
+    }
+}
+
+void ServerPool::setWsEndpoints(const wsEndpointsFactory &factory) {
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        workers_[i]->server_->setWsEndpoints(factory(i));
+    }
+}
+
+void ServerPool::start() {
+    for (auto &w : workers_) {
+        if (!w->thread_.joinable()) {
+            asio::io_context *ioc = &w->ioContext_;
+            w->thread_ = std::thread([ioc]() { ioc->run(); });
+        }
+    }
+}
+
+void ServerPool::run() {
+    start();
+    join();
+}
+
+void ServerPool::stop() {
+    for (auto &w : workers_) {
+        Server *server = w->server_.get();
+        asio::post(w->ioContext_, [server]() { server->stop(); });
+    }
+}
+
+void ServerPool::join() {
+    for (auto &w : workers_) {
+        if (w->thread_.joinable()) {
+            w->thread_.join();
+        }
+    }
+}
+
+}  // namespace beauty
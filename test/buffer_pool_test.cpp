@@ -0,0 +1,242 @@
+#include <catch2/catch_test_macros.hpp>
+#include <sys/resource.h>
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "beauty/buffer_pool.hpp"
+#include "beauty/server.hpp"
+
+using namespace std::literals::chrono_literals;
+using namespace beauty;
+
+TEST_CASE("buffer pool", "[buffer_pool]") {
+    BufferPool pool(1024, 2);
+
+    SECTION("it should allocate on miss and reuse released buffers") {
+        std::vector<char> buf;
+        pool.acquire(buf);
+        REQUIRE(buf.capacity() >= 1024);
+        REQUIRE(buf.empty());
+        const char* data = buf.data();
+
+        pool.release(buf);
+        REQUIRE(buf.capacity() == 0);
+
+        std::vector<char> other;
+        pool.acquire(other);
+        REQUIRE(other.data() == data);
+
+        auto stats = pool.getStats();
+        REQUIRE(stats.misses_ == 1);
+        REQUIRE(stats.hits_ == 1);
+        REQUIRE(stats.inUse_ == 1);
+        REQUIRE(stats.pooled_ == 0);
+    }
+    SECTION("it should not acquire twice") {
+        std::vector<char> buf;
+        pool.acquire(buf);
+        buf.push_back('a');
+        pool.acquire(buf);
+        REQUIRE(buf.size() == 1);
+        REQUIRE(pool.getStats().misses_ == 1);
+        REQUIRE(pool.getStats().inUse_ == 1);
+    }
+    SECTION("it should ignore release of empty buffers") {
+        std::vector<char> buf;
+        pool.release(buf);
+        REQUIRE(pool.getStats().pooled_ == 0);
+    }
+    SECTION("it should free buffers beyond the cap") {
+        std::vector<std::vector<char>> bufs(3);
+        for (auto& b : bufs) {
+            pool.acquire(b);
+        }
+        for (auto& b : bufs) {
+            pool.release(b);
+        }
+        auto stats = pool.getStats();
+        REQUIRE(stats.misses_ == 3);
+        REQUIRE(stats.pooled_ == 2);
+        REQUIRE(stats.discarded_ == 1);
+        REQUIRE(stats.inUse_ == 0);
+    }
+    SECTION("it should free buffers that have grown, e.g. large reply content") {
+        std::vector<char> buf;
+        pool.acquire(buf);
+        buf.resize(64 * 1024);
+        pool.release(buf);
+        REQUIRE(buf.capacity() == 0);
+
+        auto stats = pool.getStats();
+        REQUIRE(stats.pooled_ == 0);
+        REQUIRE(stats.discarded_ == 1);
+        REQUIRE(stats.inUse_ == 0);
+    }
+    SECTION("it should only count buffers it has handed out") {
+        std::vector<char> buf;
+        pool.acquire(buf);
+        std::vector<char> other(1024);
+        pool.release(other);
+        REQUIRE(pool.getStats().inUse_ == 1);
+        REQUIRE(pool.getStats().pooled_ == 1);
+
+        // swapped out, e.g. when content is swapped into another buffer
+        std::vector<char>().swap(buf);
+        pool.release(buf);
+        REQUIRE(pool.getStats().inUse_ == 0);
+    }
+}
+
+TEST_CASE("server buffer pool", "[buffer_pool]") {
+    asio::io_context ioc;
+    Settings settings(5s, 100, 0);
+    Server dut(ioc, "127.0.0.1", "0", settings);
+    dut.addRequestHandler([](const Request&, Reply& rep) { rep.send(Reply::status_type::ok); });
+    auto t = std::thread([&ioc]() { ioc.run(); });
+
+    SECTION("it should reuse buffers between requests") {
+        asio::io_context clientIoc;
+        asio::ip::tcp::socket socket(clientIoc);
+        socket.connect(
+            asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), dut.getBindedPort()));
+        const std::string request = "GET /api HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+        std::string data;
+        for (int i = 0; i < 10; ++i) {
+            asio::write(socket, asio::buffer(request));
+            size_t n = asio::read_until(socket, asio::dynamic_buffer(data), "\r\n\r\n");
+            data.erase(0, n);
+        }
+
+        // Only the receive and send buffer are ever allocated, the send buffer
+        // is returned after each reply and reused for the next.
+        std::promise<BufferPool::Stats> promise;
+        asio::post(ioc, [&]() { promise.set_value(dut.getBufferPoolStats()); });
+        auto stats = promise.get_future().get();
+        REQUIRE(stats.misses_ == 2);
+        REQUIRE(stats.hits_ >= 9);
+    }
+
+    ioc.stop();
+    t.join();
+}
+
+namespace {
+
+const std::string KeepAliveRequest = "GET /api HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+
+BufferPool::Stats getStats(asio::io_context& ioc, Server& server) {
+    std::promise<BufferPool::Stats> promise;
+    asio::post(ioc, [&]() { promise.set_value(server.getBufferPoolStats()); });
+    return promise.get_future().get();
+}
+
+// The reply may be read by the client before the server has handled the write
+// completion, so give the server some time to park the connections.
+BufferPool::Stats waitForBuffersInUse(asio::io_context& ioc, Server& server, size_t inUse) {
+    auto stats = getStats(ioc, server);
+    for (int i = 0; i < 100 && stats.inUse_ != inUse; ++i) {
+        std::this_thread::sleep_for(10ms);
+        stats = getStats(ioc, server);
+    }
+    return stats;
+}
+
+// Opens connections that each complete one keep-alive request and then stay idle.
+std::vector<std::unique_ptr<asio::ip::tcp::socket>> openIdleConnections(asio::io_context& ioc,
+                                                                        uint16_t port,
+                                                                        size_t count) {
+    std::vector<std::unique_ptr<asio::ip::tcp::socket>> sockets;
+    std::string data;
+    for (size_t i = 0; i < count; ++i) {
+        sockets.emplace_back(new asio::ip::tcp::socket(ioc));
+        auto& socket = *sockets.back();
+        socket.connect(asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), port));
+        asio::write(socket, asio::buffer(KeepAliveRequest));
+        size_t n = asio::read_until(socket, asio::dynamic_buffer(data), "\r\n\r\n");
+        data.erase(0, n);
+    }
+    return sockets;
+}
+
+}  // namespace
+
+TEST_CASE("idle connection buffers", "[buffer_pool]") {
+    asio::io_context ioc;
+    Settings settings(5s, 100, 0);
+    settings.waitReadableWhenIdle_ = true;
+    Server dut(ioc, "127.0.0.1", "0", settings);
+    dut.addRequestHandler([](const Request&, Reply& rep) { rep.send(Reply::status_type::ok); });
+    auto t = std::thread([&ioc]() { ioc.run(); });
+
+    asio::io_context clientIoc;
+    auto sockets = openIdleConnections(clientIoc, dut.getBindedPort(), 3);
+
+    SECTION("it should not hold buffers for idle connections") {
+        auto stats = waitForBuffersInUse(ioc, dut, 0);
+        REQUIRE(stats.inUse_ == 0);
+        REQUIRE(stats.pooled_ > 0);
+    }
+    SECTION("it should borrow a buffer once data is readable") {
+        std::string data;
+        for (auto& socket : sockets) {
+            asio::write(*socket, asio::buffer(KeepAliveRequest));
+            asio::read_until(*socket, asio::dynamic_buffer(data), "\r\n\r\n");
+            REQUIRE(data.substr(0, 15) == "HTTP/1.1 200 OK");
+            data.clear();
+        }
+        REQUIRE(waitForBuffersInUse(ioc, dut, 0).inUse_ == 0);
+    }
+    SECTION("it should close connections when the peer closes") {
+        for (auto& socket : sockets) {
+            socket->close();
+        }
+        REQUIRE(waitForBuffersInUse(ioc, dut, 0).inUse_ == 0);
+    }
+
+    ioc.stop();
+    t.join();
+}
+
+// Not run by default, use: beauty_test "[.benchmark][buffer_pool]"
+TEST_CASE("idle connection footprint", "[.benchmark][buffer_pool]") {
+    // Each connection uses two file descriptors in this process.
+    size_t nrOfConnections = 10000;
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        getrlimit(RLIMIT_NOFILE, &limit);
+        nrOfConnections = std::min<size_t>(nrOfConnections, (limit.rlim_cur - 64) / 2);
+    }
+
+    for (bool waitReadable : {false, true}) {
+        asio::io_context ioc;
+        Settings settings(60s, 100, 0);
+        settings.waitReadableWhenIdle_ = waitReadable;
+        Server dut(ioc, "127.0.0.1", "0", settings);
+        dut.addRequestHandler(
+            [](const Request&, Reply& rep) { rep.send(Reply::status_type::ok); });
+        auto t = std::thread([&ioc]() { ioc.run(); });
+
+        asio::io_context clientIoc;
+        auto sockets = openIdleConnections(clientIoc, dut.getBindedPort(), nrOfConnections);
+        auto stats = waitForBuffersInUse(ioc, dut, waitReadable ? 0 : nrOfConnections);
+        const size_t maxContentSize = 1024;  // Server default
+        size_t bufferBytes = stats.inUse_ * maxContentSize;
+        std::cout << "waitReadableWhenIdle: " << waitReadable
+                  << ", idle connections: " << sockets.size()
+                  << ", buffers in use: " << stats.inUse_
+                  << ", buffer bytes/connection: " << bufferBytes / sockets.size()
+                  << ", connection object bytes: " << sizeof(Connection) << std::endl;
+        REQUIRE(stats.inUse_ == (waitReadable ? 0 : nrOfConnections));
+
+        ioc.stop();
+        t.join();
+    }
+}
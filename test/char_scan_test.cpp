@@ -0,0 +1,176 @@
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "beauty/char_scan.hpp"
+#include "beauty/parse_common.hpp"
+#include "beauty/request.hpp"
+#include "beauty/request_parser.hpp"
+
+using namespace beauty;
+
+namespace {
+
+// Byte-wise references, as in the request parser state machine.
+bool isTokenChar(char c) {
+    return isChar(c) && !isCtl(c) && !isTsspecial(c);
+}
+
+bool isUriChar(char c) {
+    return !isCtl(c) && c != ' ';
+}
+
+bool isFieldValueChar(char c) {
+    return !isCtl(c);
+}
+
+template <bool (*Pred)(char)>
+size_t scanByteWise(const char *data, size_t size) {
+    size_t i = 0;
+    while (i < size && Pred(data[i])) {
+        ++i;
+    }
+    return i;
+}
+
+const std::string browserRequest =
+    "GET /assets/js/app.bundle.min.js?v=3.14.159 HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like "
+    "Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+    "sec-ch-ua-platform: \"Windows\"\r\n"
+    "Accept: */*\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Dest: script\r\n"
+    "Referer: https://www.example.com/products/category/index.html\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: en-US,en;q=0.9,sv;q=0.8\r\n"
+    "Cookie: session=3f2a9c1e7b4d4e8a9f0c1d2e3f4a5b6c; theme=dark; "
+    "_ga=GA1.1.1234567890.1700000000; consent=analytics%3Dtrue%26ads%3Dfalse\r\n"
+    "\r\n";
+
+}  // namespace
+
+TEST_CASE("char scan", "[char_scan]") {
+    SECTION("it should stop at the same byte as the state machine") {
+        // Every byte value at every position of the blocks and the tail.
+        size_t mismatches = 0;
+        for (size_t length = 1; length < 70; ++length) {
+            for (size_t pos = 0; pos < length; ++pos) {
+                for (int b = 0; b < 256; ++b) {
+                    std::string s(length, 'a');
+                    s[pos] = static_cast<char>(b);
+                    const char *d = s.data();
+                    size_t token = scanByteWise<isTokenChar>(d, s.size());
+                    size_t uri = scanByteWise<isUriChar>(d, s.size());
+                    size_t value = scanByteWise<isFieldValueChar>(d, s.size());
+                    mismatches += scanToken(d, s.size()) != token;
+                    mismatches += scanUri(d, s.size()) != uri;
+                    mismatches += scanFieldValue(d, s.size()) != value;
+                    mismatches += scanTokenScalar(d, s.size()) != token;
+                    mismatches += scanUriScalar(d, s.size()) != uri;
+                    mismatches += scanFieldValueScalar(d, s.size()) != value;
+                }
+            }
+        }
+        REQUIRE(mismatches == 0);
+    }
+    SECTION("it should find the delimiters of a request") {
+        const std::string line = "Accept-Language: en-US,en;q=0.9\r\n";
+        REQUIRE(scanToken(line.data(), line.size()) == line.find(':'));
+        REQUIRE(scanFieldValue(line.data(), line.size()) == line.find('\r'));
+        const std::string requestLine = "/index.html?a=b HTTP/1.1\r\n";
+        REQUIRE(scanUri(requestLine.data(), requestLine.size()) == requestLine.find(' '));
+    }
+    SECTION("it should return the size if there is no delimiter") {
+        const std::string value(100, 'x');
+        REQUIRE(scanToken(value.data(), value.size()) == value.size());
+        REQUIRE(scanUri(value.data(), value.size()) == value.size());
+        REQUIRE(scanFieldValue(value.data(), value.size()) == value.size());
+        REQUIRE(scanToken(value.data(), 0) == 0);
+    }
+}
+
+TEST_CASE("parse browser request", "[char_scan]") {
+    std::vector<char> content;
+    content.reserve(1024);
+    Request request(content);
+    RequestParser parser;
+    content.assign(browserRequest.begin(), browserRequest.end());
+
+    REQUIRE(parser.parse(request, content) == RequestParser::good_complete);
+    REQUIRE(request.method_ == "GET");
+    REQUIRE(request.uri_ == "/assets/js/app.bundle.min.js?v=3.14.159");
+    REQUIRE(request.getNoHeaders() == 14);
+    REQUIRE(request.getHeaderValue("accept-encoding") == "gzip, deflate, br, zstd");
+    REQUIRE(request.getHeaderValue("Cookie").size() == 125);
+}
+
+// Not run by default, use: beauty_test "[.benchmark][char_scan]"
+TEST_CASE("request header scanning throughput", "[.benchmark][char_scan]") {
+    using namespace std::chrono;
+    const size_t iterations = 200000;
+    const double totalBytes = static_cast<double>(browserRequest.size()) * iterations;
+    size_t sink = 0;
+
+    // The token states of the state machine: method, uri, header names and
+    // values, as scanned from the start of each.
+    auto scanRequest = [&](size_t (*token)(const char *, size_t),
+                           size_t (*uri)(const char *, size_t),
+                           size_t (*value)(const char *, size_t)) {
+        const char *d = browserRequest.data();
+        size_t size = browserRequest.size();
+        size_t pos = token(d, size) + 1;
+        pos += uri(d + pos, size - pos) + 1;
+        pos = browserRequest.find('\n', pos) + 1;
+        while (pos < size && d[pos] != '\r') {
+            pos += token(d + pos, size - pos) + 2;
+            pos += value(d + pos, size - pos) + 2;
+        }
+        return pos;
+    };
+    struct Variant {
+        const char *name_;
+        size_t (*token_)(const char *, size_t);
+        size_t (*uri_)(const char *, size_t);
+        size_t (*value_)(const char *, size_t);
+    };
+    const Variant variants[] = {
+        {"byte-wise predicates",
+         scanByteWise<isTokenChar>,
+         scanByteWise<isUriChar>,
+         scanByteWise<isFieldValueChar>},
+        {"table scalar", scanTokenScalar, scanUriScalar, scanFieldValueScalar},
+        {"simd (if available)", scanToken, scanUri, scanFieldValue},
+    };
+
+    for (const auto &v : variants) {
+        auto start = steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i) {
+            sink += scanRequest(v.token_, v.uri_, v.value_);
+        }
+        double ns = static_cast<double>(duration_cast<nanoseconds>(steady_clock::now() - start).count());
+        std::cout << v.name_ << ": " << totalBytes / ns << " bytes/ns" << std::endl;
+    }
+
+    std::vector<char> content;
+    content.reserve(1024);
+    auto start = steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        // Includes allocating the request, reused by a connection.
+        Request request(content);
+        RequestParser parser;
+        content.assign(browserRequest.begin(), browserRequest.end());
+        sink += parser.parse(request, content);
+    }
+    double ns = static_cast<double>(duration_cast<nanoseconds>(steady_clock::now() - start).count());
+    std::cout << "RequestParser::parse: " << totalBytes / ns << " bytes/ns" << std::endl;
+
+    REQUIRE(sink > 0);
+}
@@ -1,7 +1,12 @@
 #include <catch2/catch_test_macros.hpp>
+#include <cstdio>
+#include <filesystem>
 #include <fstream>
 #include <numeric>
+#include <thread>
 
+#include "etag_generator.hpp"
+#include "file_cache.hpp"
 #include "file_io.hpp"
 #include "utils/mock_file_io.hpp"
 
@@ -51,6 +56,33 @@ TEST_CASE("file_io.cpp", "[file_io]") {
         expected = {10, 11, 12, 13, 14, 15, 16, 17, 18, 19};
         REQUIRE(readData == expected);
     }
+    SECTION("should provide native file from current position") {
+        fio.openFileForRead("0", req, rep);
+        std::vector<uint32_t> readData(10);
+        fio.readFile("0", req, (char*)readData.data(), readData.size() * typeSize);
+
+        NativeReadFile file;
+        REQUIRE(fio.getNativeReadFile("0", file));
+        REQUIRE(file.fd_ >= 0);
+        REQUIRE(file.offset_ == readData.size() * typeSize);
+        REQUIRE(file.length_ == (arr.size() - readData.size()) * typeSize);
+        fio.closeReadFile("0");
+
+        REQUIRE_FALSE(fio.getNativeReadFile("0", file));
+    }
+    SECTION("should reserve space for uploads without changing their size") {
+        rep.filePath_ = "preallocate_test.bin";
+        fio.openFileForWrite("0", req, rep);
+        // Not supported by all file systems
+        fio.preallocateWriteFile("0", 1024 * 1024);
+        REQUIRE(std::filesystem::file_size("preallocate_test.bin") == 0);
+
+        std::string data(100, 'x');
+        fio.writeFile("0", req, rep, data.data(), data.size(), true);
+        REQUIRE(std::filesystem::file_size("preallocate_test.bin") == data.size());
+        REQUIRE_FALSE(fio.preallocateWriteFile("0", 1024));
+        std::remove("preallocate_test.bin");
+    }
     SECTION("should allow parallell reads") {
         fio.openFileForRead("0", req, rep);
         std::vector<uint32_t> readData(10);
@@ -75,6 +107,123 @@ TEST_CASE("file_io.cpp", "[file_io]") {
     }
 }
 
+TEST_CASE("file_cache.cpp", "[file_io]") {
+    auto writeFile = [](const std::string& path, char c, size_t size) {
+        std::ofstream of(path, std::ios::out | std::ios::binary);
+        of << std::string(size, c);
+    };
+    writeFile("cache_a.bin", 'a', 100);
+    writeFile("cache_b.bin", 'b', 100);
+    writeFile("cache_c.bin", 'c', 100);
+    FileCache cache(250, 200);
+
+    SECTION("should keep files within the memory budget, evicting the least recently used") {
+        REQUIRE(cache.load("./cache_a.bin", "") != nullptr);
+        REQUIRE(cache.load("./cache_b.bin", "") != nullptr);
+        REQUIRE(cache.find("./cache_a.bin") != nullptr);
+        REQUIRE(cache.load("./cache_c.bin", "") != nullptr);
+
+        REQUIRE(cache.getNrOfEntries() == 2);
+        REQUIRE(cache.getMemoryUsage() == 200);
+        REQUIRE(cache.find("./cache_a.bin") != nullptr);
+        REQUIRE(cache.find("./cache_b.bin") == nullptr);
+        REQUIRE(cache.find("./cache_c.bin")->content_ == std::vector<char>(100, 'c'));
+    }
+    SECTION("should not cache files larger than the max file size") {
+        writeFile("cache_big.bin", 'x', 201);
+        REQUIRE(cache.load("./cache_big.bin", "") == nullptr);
+        REQUIRE(cache.getNrOfEntries() == 0);
+        std::remove("cache_big.bin");
+    }
+    SECTION("should keep invalidated content alive while referenced") {
+        auto entry = cache.load("./cache_a.bin", "\"etag\"");
+        cache.invalidate("./cache_a.bin");
+
+        REQUIRE(cache.find("./cache_a.bin") == nullptr);
+        REQUIRE(cache.getMemoryUsage() == 0);
+        REQUIRE(entry->content_ == std::vector<char>(100, 'a'));
+        REQUIRE(entry->eTag_ == "\"etag\"");
+    }
+#if defined(__linux__)
+    SECTION("should invalidate files changed on disk") {
+        REQUIRE(cache.load("./cache_a.bin", "") != nullptr);
+        writeFile("cache_a.bin", 'z', 100);
+
+        // The watcher thread invalidates the entry shortly after
+        for (int i = 0; i < 200 && cache.find("./cache_a.bin") != nullptr; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        REQUIRE(cache.find("./cache_a.bin") == nullptr);
+        REQUIRE(cache.load("./cache_a.bin", "")->content_ == std::vector<char>(100, 'z'));
+    }
+#endif
+
+    std::remove("cache_a.bin");
+    std::remove("cache_b.bin");
+    std::remove("cache_c.bin");
+}
+
+TEST_CASE("etag_generator.cpp", "[file_io]") {
+    auto writeFile = [](const std::string& path, const std::string& content) {
+        std::ofstream of(path, std::ios::out | std::ios::binary);
+        of << content;
+    };
+    std::string content(200000, 'x');
+    for (size_t i = 0; i < content.size(); ++i) {
+        content[i] = static_cast<char>(i * 7 % 251);
+    }
+    writeFile("etag_a.bin", content);
+    writeFile("etag_b.bin", content);
+
+    SECTION("should hash as XXH64") {
+        std::string bytes(100, 0);
+        std::iota(bytes.begin(), bytes.end(), 0);
+        REQUIRE(ETagGenerator::hash("", 0) == 0xef46db3751d8e999ULL);
+        REQUIRE(ETagGenerator::hash("abc", 3) == 0x44bc2cf5ad770999ULL);
+        REQUIRE(ETagGenerator::hash(bytes.data(), bytes.size()) == 0x6ac1e58032166597ULL);
+    }
+    SECTION("should build ETags from the file metadata") {
+        ETagGenerator eTags;
+        std::string eTag = eTags.get("./etag_a.bin");
+        REQUIRE(eTag.size() > 2);
+        REQUIRE(eTag.front() == '"');
+        REQUIRE(eTag.back() == '"');
+        REQUIRE(eTags.get("./etag_a.bin") == eTag);
+        REQUIRE(eTags.get("./etag_b.bin") != eTag);
+        REQUIRE(eTags.get("./etag_missing.bin").empty());
+        REQUIRE(eTags.get(".").empty());
+
+        writeFile("etag_a.bin", "changed");
+        REQUIRE(eTags.get("./etag_a.bin") != eTag);
+    }
+    SECTION("should hash the content when asked for") {
+        ETagGenerator eTags(true);
+        std::string eTag = eTags.get("./etag_a.bin");
+        char expected[32];
+        snprintf(expected,
+                 sizeof(expected),
+                 "\"%llx\"",
+                 static_cast<unsigned long long>(
+                     ETagGenerator::hash(content.data(), content.size())));
+        REQUIRE(eTag == expected);
+        REQUIRE(eTags.get("./etag_b.bin") == eTag);
+
+        writeFile("etag_a.bin", "changed");
+        eTags.invalidate("./etag_a.bin");
+        REQUIRE(eTags.get("./etag_a.bin") != eTag);
+    }
+    SECTION("should provide ETags of files in subdirectories") {
+        std::filesystem::create_directories("etag_dir/sub");
+        writeFile("etag_dir/sub/c.bin", content);
+        REQUIRE(!ETagGenerator().get("./etag_dir/sub/c.bin").empty());
+        REQUIRE(!ETagGenerator(true).get("./etag_dir/sub/c.bin").empty());
+        std::filesystem::remove_all("etag_dir");
+    }
+
+    std::remove("etag_a.bin");
+    std::remove("etag_b.bin");
+}
+
 TEST_CASE("Reading from MockFileIO", "[file_handler]") {
     std::vector<uint32_t> arr(100);
     size_t typeSize = sizeof(decltype(arr)::value_type);
@@ -1,4 +1,6 @@
 #include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <iostream>
 
 #include "beauty/multipart_parser.hpp"
 #include "beauty/request.hpp"
@@ -7,39 +9,47 @@ using namespace beauty;
 
 namespace {
 
-std::vector<char> convertToCharVec(const std::string &s) {
-    std::vector<char> ret(s.begin(), s.end());
-    return ret;
-}
+// A part found by the parser, copied as the parts are only valid until the
+// next parse call.
+struct Part {
+    std::string filename_;
+    std::string data_;
+    bool foundStart_;
+    bool foundEnd_;
+};
 
 struct Fixture {
-    Fixture(size_t maxContentSize) : parser_(content_) {
-        content_.reserve(maxContentSize);
-    }
     bool parseHeader(const Request &req) {
         return parser_.parseHeader(req);
     }
-    MultiPartParser::result_type parse(std::vector<char> &content,
-                                       std::deque<MultiPartParser::ContentPart> &parts) {
-        return parser_.parse(content, parts);
-    }
-
-    void flush(std::vector<char> &content, std::deque<MultiPartParser::ContentPart> &parts) {
-        parser_.flush(content, parts);
-    }
 
-    const std::deque<MultiPartParser::ContentPart> &peakLastPart() const {
-        return parser_.peakLastPart();
+    // Parse all of content, also if the parts found fill up the parser.
+    MultiPartParser::result_type parse(const std::string &content, std::vector<Part> &parts) {
+        parts.clear();
+        MultiPartParser::result_type result;
+        size_t pos = 0;
+        do {
+            size_t consumed = 0;
+            result = parser_.parse(content.data() + pos, content.size() - pos, consumed);
+            pos += consumed;
+            for (size_t i = 0; i < parser_.getNoParts(); ++i) {
+                const MultiPartParser::ContentPart &part = parser_.getPart(i);
+                parts.push_back({part.filename_.str(),
+                                 std::string(part.start_, part.end_),
+                                 part.foundStart_,
+                                 part.foundEnd_});
+            }
+        } while (result == MultiPartParser::parts_full);
+        return result;
     }
 
-    std::vector<char> content_;
     MultiPartParser parser_;
 };
 
 }  // namespace
 
 TEST_CASE("parse header", "[multipart_parser]") {
-    Fixture fixture(1024);
+    Fixture fixture;
     std::vector<char> body;  // not used in tests
     Request request(body);
 
@@ -62,7 +72,7 @@ TEST_CASE("parse header", "[multipart_parser]") {
 }
 
 TEST_CASE("parse single part content", "[multipart_parser]") {
-    Fixture fixture(1024);
+    Fixture fixture;
     std::vector<char> body;  // not used in tests
     Request request(body);
     request.headers_.push_back({"From", "user@example.com"});
@@ -79,27 +89,22 @@ TEST_CASE("parse single part content", "[multipart_parser]") {
         "This body is a bit tricky as it contains some ------WebKitFormBoundary chars, but not "
         "all,.\n"
         "\r\n------WebKitFormBoundarylSu7ajtLodoq9XHE--\r\n";
-    std::vector<char> content = convertToCharVec(contentStr);
 
     SECTION("should return done for single parts") {
-        // getting back the initial empty parts
-        std::deque<MultiPartParser::ContentPart> parts;
-        REQUIRE(fixture.parse(content, parts) == MultiPartParser::result_type::done);
-        REQUIRE(parts.size() == 0);
-
-        // result==done so call flush
-        fixture.flush(content, parts);
+        std::vector<Part> parts;
+        REQUIRE(fixture.parse(contentStr, parts) == MultiPartParser::result_type::done);
         REQUIRE(parts.size() == 1);
         REQUIRE(parts[0].filename_ == "testfile01.txt");
         REQUIRE(parts[0].foundStart_);
-        REQUIRE(*parts[0].start_ == 'T');
         REQUIRE(parts[0].foundEnd_);
-        REQUIRE(*(parts[0].end_ - 2) == '.');
+        REQUIRE(parts[0].data_ ==
+                "This body is a bit tricky as it contains some ------WebKitFormBoundary chars, "
+                "but not all,.\n");
     }
 }
 
 TEST_CASE("parse multi-part content", "[multipart_parser]") {
-    Fixture fixture(1024);
+    Fixture fixture;
     std::vector<char> body;  // not used in tests
     Request request(body);
     request.headers_.push_back({"From", "user@example.com"});
@@ -121,33 +126,25 @@ TEST_CASE("parse multi-part content", "[multipart_parser]") {
         "\r\n"
         "Second part!\n"
         "\r\n------WebKitFormBoundarylSu7ajtLodoq9XHE--\r\n";
-    std::vector<char> content = convertToCharVec(contentStr);
 
     SECTION("should return done for multiple parts") {
-        std::deque<MultiPartParser::ContentPart> parts;
-        // getting back the initial empty parts
-        REQUIRE(fixture.parse(content, parts) == MultiPartParser::result_type::done);
-        REQUIRE(parts.size() == 0);
-
-        // result==done so call flush
-        fixture.flush(content, parts);
+        std::vector<Part> parts;
+        REQUIRE(fixture.parse(contentStr, parts) == MultiPartParser::result_type::done);
         REQUIRE(parts.size() == 2);
         REQUIRE(parts[0].filename_ == "testfile01.txt");
         REQUIRE(parts[0].foundStart_);
-        REQUIRE(*parts[0].start_ == 'F');
         REQUIRE(parts[0].foundEnd_);
-        REQUIRE(*(parts[0].end_ - 2) == '.');
+        REQUIRE(parts[0].data_ == "First part.\n");
 
         REQUIRE(parts[1].filename_ == "testfile02.txt");
-        REQUIRE(parts[0].foundStart_);
-        REQUIRE(*parts[1].start_ == 'S');
-        REQUIRE(parts[0].foundEnd_);
-        REQUIRE(*(parts[1].end_ - 2) == '!');
+        REQUIRE(parts[1].foundStart_);
+        REQUIRE(parts[1].foundEnd_);
+        REQUIRE(parts[1].data_ == "Second part!\n");
     }
 }
 
 TEST_CASE("parse until start of content", "[multipart_parser]") {
-    Fixture fixture(1024);
+    Fixture fixture;
     std::vector<char> body;  // not used in tests
     Request request(body);
     request.headers_.push_back({"From", "user@example.com"});
@@ -164,35 +161,26 @@ TEST_CASE("parse until start of content", "[multipart_parser]") {
     const std::string contentStr2 =
         "First part.\n\r\n----------------------------567026409988538820744572--\r\n";
 
-    SECTION("should return start and end not found for first part") {
-        std::deque<MultiPartParser::ContentPart> parts;
-        // getting back the initial empty parts
-        std::vector<char> content = convertToCharVec(contentStr1);
-        REQUIRE(fixture.parse(content, parts) == MultiPartParser::result_type::indeterminate);
-        REQUIRE(parts.size() == 0);
-
-        content = convertToCharVec(contentStr2);
-        REQUIRE(fixture.parse(content, parts) == MultiPartParser::result_type::done);
+    SECTION("should return the start of the part before its data") {
+        std::vector<Part> parts;
+        REQUIRE(fixture.parse(contentStr1, parts) == MultiPartParser::result_type::indeterminate);
         REQUIRE(parts.size() == 1);
         REQUIRE(parts[0].filename_ == "firstpart.txt");
-        REQUIRE(!parts[0].foundStart_);
+        REQUIRE(parts[0].foundStart_);
         REQUIRE(!parts[0].foundEnd_);
-        REQUIRE(parts[0].headerOnly_);
+        REQUIRE(parts[0].data_.empty());
 
-        // result == done so call flush
-        fixture.flush(content, parts);
+        REQUIRE(fixture.parse(contentStr2, parts) == MultiPartParser::result_type::done);
         REQUIRE(parts.size() == 1);
         REQUIRE(parts[0].filename_ == "");
-        REQUIRE(parts[0].foundStart_);
+        REQUIRE(!parts[0].foundStart_);
         REQUIRE(parts[0].foundEnd_);
-        REQUIRE(!parts[0].headerOnly_);
-        REQUIRE(*parts[0].start_ == 'F');
-        REQUIRE(*(parts[0].end_ - 2) == '.');
+        REQUIRE(parts[0].data_ == "First part.\n");
     }
 }
 
 TEST_CASE("parse empty content", "[multipart_parser]") {
-    Fixture fixture(1024);
+    Fixture fixture;
     std::vector<char> body;  // not used in tests
     Request request(body);
     request.headers_.push_back({"From", "user@example.com"});
@@ -201,22 +189,15 @@ TEST_CASE("parse empty content", "[multipart_parser]") {
     request.headers_.push_back({"Content-Length", "184"});
     REQUIRE(fixture.parseHeader(request));  // make sure boundary is set
 
-    std::vector<char> content;
-
     SECTION("should return indeterminate") {
-        std::deque<MultiPartParser::ContentPart> parts;
-        // getting back the initial empty parts
-        REQUIRE(fixture.parse(content, parts) == MultiPartParser::result_type::indeterminate);
-        REQUIRE(parts.size() == 0);
-
-        // result==done so call flush
-        fixture.flush(content, parts);
+        std::vector<Part> parts;
+        REQUIRE(fixture.parse("", parts) == MultiPartParser::result_type::indeterminate);
         REQUIRE(parts.size() == 0);
     }
 }
 
 TEST_CASE("parse empty part content", "[multipart_parser]") {
-    Fixture fixture(1024);
+    Fixture fixture;
     std::vector<char> body;  // not used in tests
     Request request(body);
     request.headers_.push_back({"From", "user@example.com"});
@@ -232,26 +213,20 @@ TEST_CASE("parse empty part content", "[multipart_parser]") {
         "\r\n"
         "\r\n"
         "------WebKitFormBoundarylSu7ajtLodoq9XHE--\r\n";
-    std::vector<char> content = convertToCharVec(contentStr);
 
     SECTION("should return size = 0") {
-        std::deque<MultiPartParser::ContentPart> parts;
-        // getting back the initial empty parts
-        REQUIRE(fixture.parse(content, parts) == MultiPartParser::result_type::done);
-        REQUIRE(parts.size() == 0);
-
-        // result==done so call flush
-        fixture.flush(content, parts);
+        std::vector<Part> parts;
+        REQUIRE(fixture.parse(contentStr, parts) == MultiPartParser::result_type::done);
         REQUIRE(parts.size() == 1);
         REQUIRE(parts[0].filename_ == "empty.txt");
         REQUIRE(parts[0].foundStart_);
         REQUIRE(parts[0].foundEnd_);
-        REQUIRE(parts[0].start_ == parts[0].end_);
+        REQUIRE(parts[0].data_.empty());
     }
 }
 
 TEST_CASE("content start and end in consecutive buffers", "[multipart_parser]") {
-    Fixture fixture(1024);
+    Fixture fixture;
     std::vector<char> body;  // not used in tests
     Request request(body);
     request.headers_.push_back({"From", "user@example.com"});
@@ -266,44 +241,27 @@ TEST_CASE("content start and end in consecutive buffers", "[multipart_parser]")
     const std::string contentStr2 =
         "dy is a bit tricky as it contains some ------WebKitFormBoundary chars, but not "
         "all.\n\r\n------WebKitFormBoundarylSu7ajtLodoq9XHE--\r\n";
-    std::deque<MultiPartParser::ContentPart> parts;
-
-    // getting back the initial empty parts
-    std::vector<char> content = convertToCharVec(contentStr1);
-    REQUIRE(fixture.parse(content, parts) == MultiPartParser::result_type::indeterminate);
-    REQUIRE(parts.size() == 0);
+    std::vector<Part> parts;
 
-    // peaking the last part..
-    const std::deque<MultiPartParser::ContentPart> &peakParts = fixture.peakLastPart();
-    REQUIRE(peakParts.size() == 1);
-    REQUIRE(peakParts[0].filename_ == "testfile01.txt");
-    REQUIRE(peakParts[0].foundStart_);
-    REQUIRE(*peakParts[0].start_ == 'T');
-    REQUIRE(!peakParts[0].foundEnd_);
-    REQUIRE(*(peakParts[0].end_ - 1) == 'o');
-
-    // ..that is actually delivered in the next parse call
-    content = convertToCharVec(contentStr2);
-    REQUIRE(fixture.parse(content, parts) == MultiPartParser::result_type::done);
+    // The data found is returned right away
+    REQUIRE(fixture.parse(contentStr1, parts) == MultiPartParser::result_type::indeterminate);
     REQUIRE(parts.size() == 1);
     REQUIRE(parts[0].filename_ == "testfile01.txt");
     REQUIRE(parts[0].foundStart_);
-    REQUIRE(*parts[0].start_ == 'T');
     REQUIRE(!parts[0].foundEnd_);
-    REQUIRE(*(parts[0].end_ - 1) == 'o');
+    REQUIRE(parts[0].data_ == "This bo");
 
-    // result==done so call flush
-    fixture.flush(content, parts);
+    REQUIRE(fixture.parse(contentStr2, parts) == MultiPartParser::result_type::done);
     REQUIRE(parts.size() == 1);
     REQUIRE(parts[0].filename_ == "");
     REQUIRE(!parts[0].foundStart_);
-    REQUIRE(*parts[0].start_ == 'd');
     REQUIRE(parts[0].foundEnd_);
-    REQUIRE(*(parts[0].end_ - 2) == '.');
+    REQUIRE(parts[0].data_ ==
+            "dy is a bit tricky as it contains some ------WebKitFormBoundary chars, but not all.\n");
 }
 
 TEST_CASE("content end in next to last body part", "[multipart_parser]") {
-    Fixture fixture(1024);
+    Fixture fixture;
     std::vector<char> body;  // not used in tests
     Request request(body);
     request.headers_.push_back({"From", "user@example.com"});
@@ -321,61 +279,41 @@ TEST_CASE("content end in next to last body part", "[multipart_parser]") {
     const std::string contentStr4 =
         "not all. Note that the closing boundary comes in the last part.\n\r\n------We";
     const std::string contentStr5 = "bKitFormBoundarylSu7ajtLodoq9XHE--\r\n";
-    std::deque<MultiPartParser::ContentPart> parts;
+    std::vector<Part> parts;
 
-    // getting back the initial empty parts
-    std::vector<char> content = convertToCharVec(contentStr1);
-    REQUIRE(fixture.parse(content, parts) == MultiPartParser::result_type::indeterminate);
+    // The part headers are split over the first two buffers
+    REQUIRE(fixture.parse(contentStr1, parts) == MultiPartParser::result_type::indeterminate);
     REQUIRE(parts.size() == 0);
 
-    // Note: Whenever no start or end is found, the multipart parser assumes
-    // that we're in the middle of a large file and creates a part with
-    // start/end to match the entire request.content_ buffer. However as this
-    // use case uses very small contentStr's (75 chars), this situation happens
-    // here for the first contentStr1. For real use cases it must be
-    // a requirement that if receiving any body data in the first request, we
-    // at least get all the first multipart headers.
-    // So here we "overlook" this and get parts.size() == 1, but really it
-    // should be 0. But to get '0', the code would need more logic that in
-    // practise doesn't make much sense.
-    content = convertToCharVec(contentStr2);
-    REQUIRE(fixture.parse(content, parts) == MultiPartParser::result_type::indeterminate);
-    REQUIRE(parts.size() == 1);
-
-    content = convertToCharVec(contentStr3);
-    REQUIRE(fixture.parse(content, parts) == MultiPartParser::result_type::indeterminate);
+    REQUIRE(fixture.parse(contentStr2, parts) == MultiPartParser::result_type::indeterminate);
     REQUIRE(parts.size() == 1);
     REQUIRE(parts[0].filename_ == "testfile01.txt");
     REQUIRE(parts[0].foundStart_);
-    REQUIRE(*parts[0].start_ == 'T');
     REQUIRE(!parts[0].foundEnd_);
-    REQUIRE(*(parts[0].end_ - 1) == 'o');
+    REQUIRE(parts[0].data_ == "This bo");
 
-    content = convertToCharVec(contentStr4);
-    REQUIRE(fixture.parse(content, parts) == MultiPartParser::result_type::indeterminate);
+    REQUIRE(fixture.parse(contentStr3, parts) == MultiPartParser::result_type::indeterminate);
     REQUIRE(parts.size() == 1);
-    REQUIRE(parts[0].filename_ == "");
     REQUIRE(!parts[0].foundStart_);
-    REQUIRE(*parts[0].start_ == 'd');
     REQUIRE(!parts[0].foundEnd_);
-    REQUIRE(*(parts[0].end_ - 1) == ' ');
+    REQUIRE(parts[0].data_ == contentStr3);
 
-    content = convertToCharVec(contentStr5);
-    REQUIRE(fixture.parse(content, parts) == MultiPartParser::result_type::done);
+    // The start of the boundary is held back
+    REQUIRE(fixture.parse(contentStr4, parts) == MultiPartParser::result_type::indeterminate);
+    REQUIRE(parts.size() == 1);
+    REQUIRE(!parts[0].foundEnd_);
+    REQUIRE(parts[0].data_ ==
+            "not all. Note that the closing boundary comes in the last part.\n");
+
+    REQUIRE(fixture.parse(contentStr5, parts) == MultiPartParser::result_type::done);
     REQUIRE(parts.size() == 1);
-    REQUIRE(parts[0].filename_ == "");
     REQUIRE(!parts[0].foundStart_);
-    REQUIRE(*parts[0].start_ == 'n');
     REQUIRE(parts[0].foundEnd_);
-    REQUIRE(*(parts[0].end_ - 2) == '.');
-
-    // result==done so call flush
-    fixture.flush(content, parts);
-    REQUIRE(parts.size() == 0);
+    REQUIRE(parts[0].data_.empty());
 }
 
 TEST_CASE("content end in previous body part and last part contain content", "[multipart_parser]") {
-    Fixture fixture(1024);
+    Fixture fixture;
     std::vector<char> body;  // not used in tests
     Request request(body);
     request.headers_.push_back({"From", "user@example.com"});
@@ -397,31 +335,169 @@ TEST_CASE("content end in previous body part and last part contain content", "[m
         "Content-Type: text/plain\r\n\r\n"
         "Third part!\n"
         "\r\n------WebKitFormBoundarylSu7ajtLodoq9XHE--\r\n";
-    std::deque<MultiPartParser::ContentPart> parts;
+    std::vector<Part> parts;
 
-    // getting back the initial empty parts
-    std::vector<char> content = convertToCharVec(contentStr1);
-    REQUIRE(fixture.parse(content, parts) == MultiPartParser::result_type::indeterminate);
-    REQUIRE(parts.size() == 0);
-
-    content = convertToCharVec(contentStr2);
-    REQUIRE(fixture.parse(content, parts) == MultiPartParser::result_type::done);
+    REQUIRE(fixture.parse(contentStr1, parts) == MultiPartParser::result_type::indeterminate);
     REQUIRE(parts.size() == 2);
     REQUIRE(parts[0].filename_ == "testfile01.txt");
-    REQUIRE(parts[0].foundStart_);
-    REQUIRE(*parts[0].start_ == 'F');
     REQUIRE(parts[0].foundEnd_);
-    REQUIRE(*(parts[0].end_ - 2) == '.');
+    REQUIRE(parts[0].data_ == "First part.\n");
     REQUIRE(parts[1].filename_ == "testfile02.txt");
-    REQUIRE(*parts[1].start_ == 'S');
-    REQUIRE(*(parts[1].end_ - 2) == '!');
+    REQUIRE(!parts[1].foundEnd_);
+    REQUIRE(parts[1].data_ == "Second part!\n");
 
-    // result==done so call flush
-    fixture.flush(content, parts);
-    REQUIRE(parts.size() == 1);
-    REQUIRE(parts[0].filename_ == "testfile03.txt");
-    REQUIRE(parts[0].foundStart_);
-    REQUIRE(*parts[0].start_ == 'T');
+    REQUIRE(fixture.parse(contentStr2, parts) == MultiPartParser::result_type::done);
+    REQUIRE(parts.size() == 2);
+    REQUIRE(!parts[0].foundStart_);
     REQUIRE(parts[0].foundEnd_);
-    REQUIRE(*(parts[0].end_ - 2) == '!');
+    REQUIRE(parts[0].data_.empty());
+    REQUIRE(parts[1].filename_ == "testfile03.txt");
+    REQUIRE(parts[1].foundStart_);
+    REQUIRE(parts[1].foundEnd_);
+    REQUIRE(parts[1].data_ == "Third part!\n");
+}
+
+TEST_CASE("boundary split over buffers", "[multipart_parser]") {
+    std::vector<char> body;  // not used in tests
+    Request request(body);
+    request.headers_.push_back(
+        {"Content-Type",
+         "multipart/form-data; boundary=--------------------------567026409988538820744572"});
+    const std::string delimiter = "----------------------------567026409988538820744572";
+    // Part data with hyphens and near misses of the boundary
+    const std::string data =
+        "First - part --\n\r\n-------------------------------567026409988538820744573 and "
+        "--------------------------5670264099885388207445\r\n--";
+    const std::string contentStr =
+        delimiter +
+        "\r\nContent-Disposition: form-data; name=\"file1\"; filename=\"firstpart.txt\"\r\n"
+        "Content-Type: text/plain\r\n\r\n" +
+        data + "\r\n" + delimiter + "--\r\n";
+    const size_t dataEnd = contentStr.find("First") + data.size();
+
+    // Parse contentStr split at the given positions, and collect the part
+    // data as the request handler writes it.
+    auto parseSplit = [&](const std::vector<size_t> &splits, std::string &written) {
+        Fixture fixture;
+        REQUIRE(fixture.parseHeader(request));
+        std::vector<Part> parts;
+        MultiPartParser::result_type result = MultiPartParser::indeterminate;
+        size_t pos = 0;
+        for (size_t i = 0; i <= splits.size() && result == MultiPartParser::indeterminate; ++i) {
+            size_t next = i < splits.size() ? splits[i] : contentStr.size();
+            result = fixture.parse(contentStr.substr(pos, next - pos), parts);
+            for (auto &part : parts) {
+                written += part.data_;
+            }
+            pos = next;
+        }
+        return result;
+    };
+
+    SECTION("should find the boundary wherever the content is split") {
+        for (size_t split = 1; split < contentStr.size(); ++split) {
+            std::string written;
+            REQUIRE(parseSplit({split}, written) == MultiPartParser::done);
+            REQUIRE(written == data);
+        }
+    }
+    SECTION("should find the boundary split over several buffers") {
+        std::string written;
+        REQUIRE(parseSplit({dataEnd + 5, dataEnd + 6, dataEnd + 30}, written) ==
+                MultiPartParser::done);
+        REQUIRE(written == data);
+    }
+    SECTION("should not take near misses split over buffers for the boundary") {
+        // The near miss of the boundary in data, split after its hyphens
+        size_t nearMiss = contentStr.find("--------------------------5670264099885388207445");
+        std::string written;
+        REQUIRE(parseSplit({nearMiss + 20, nearMiss + 28, dataEnd + 10}, written) ==
+                MultiPartParser::done);
+        REQUIRE(written == data);
+    }
+}
+
+TEST_CASE("parse more parts than found per call", "[multipart_parser]") {
+    Fixture fixture;
+    std::vector<char> body;  // not used in tests
+    Request request(body);
+    request.headers_.push_back(
+        {"Content-Type", "multipart/form-data; boundary=----WebKitFormBoundarylSu7ajtLodoq9XHE"});
+    REQUIRE(fixture.parseHeader(request));  // make sure boundary is set
+
+    const size_t noFiles = MultiPartParser::maxParts + 2;
+    std::string contentStr;
+    for (size_t i = 0; i < noFiles; ++i) {
+        contentStr += "------WebKitFormBoundarylSu7ajtLodoq9XHE\r\n"
+                      "Content-Disposition: form-data; name=\"file\"; filename=\"file" +
+                      std::to_string(i) + ".txt\"\r\n\r\nPart " + std::to_string(i) + "\r\n";
+    }
+    contentStr += "------WebKitFormBoundarylSu7ajtLodoq9XHE--\r\n";
+
+    SECTION("should continue with the rest of the content in the next call") {
+        size_t consumed = 0;
+        REQUIRE(fixture.parser_.parse(contentStr.data(), contentStr.size(), consumed) ==
+                MultiPartParser::parts_full);
+        REQUIRE(fixture.parser_.getNoParts() == MultiPartParser::maxParts);
+        REQUIRE(consumed < contentStr.size());
+
+        std::vector<Part> parts;
+        REQUIRE(fixture.parse(contentStr.substr(consumed), parts) == MultiPartParser::done);
+        REQUIRE(parts.size() == 2);
+        REQUIRE(parts[1].filename_ == "file" + std::to_string(noFiles - 1) + ".txt");
+    }
+    SECTION("should return all of the parts") {
+        std::vector<Part> parts;
+        REQUIRE(fixture.parse(contentStr, parts) == MultiPartParser::done);
+        REQUIRE(parts.size() == noFiles);
+        for (size_t i = 0; i < noFiles; ++i) {
+            REQUIRE(parts[i].filename_ == "file" + std::to_string(i) + ".txt");
+            REQUIRE(parts[i].data_ == "Part " + std::to_string(i));
+            REQUIRE(parts[i].foundEnd_);
+        }
+    }
+}
+
+// Not run by default, use: beauty_test "[.benchmark][multipart_parser]"
+TEST_CASE("multipart upload parsing throughput", "[.benchmark][multipart_parser]") {
+    using namespace std::chrono;
+    std::vector<char> body;  // not used in tests
+    Request request(body);
+    request.headers_.push_back(
+        {"Content-Type", "multipart/form-data; boundary=----WebKitFormBoundarylSu7ajtLodoq9XHE"});
+    const std::string headers =
+        "------WebKitFormBoundarylSu7ajtLodoq9XHE\r\n"
+        "Content-Disposition: form-data; name=\"file1\"; filename=\"testfile01.txt\"\r\n"
+        "Content-Type: application/octet-stream\r\n\r\n";
+    const std::string closing = "\r\n------WebKitFormBoundarylSu7ajtLodoq9XHE--\r\n";
+    const size_t totalSize = 100 * 1024 * 1024;
+
+    for (size_t bufferSize : {1024, 64 * 1024}) {
+        // Binary file data, with the odd hyphen and line break
+        std::vector<char> block(bufferSize);
+        uint32_t x = 12345;
+        for (auto &c : block) {
+            x = x * 1103515245 + 12345;
+            c = static_cast<char>(x >> 24);
+        }
+        MultiPartParser parser;
+        REQUIRE(parser.parseHeader(request));
+        std::vector<char> content;
+        content.reserve(bufferSize);
+        size_t consumed = 0;
+
+        auto start = steady_clock::now();
+        parser.parse(headers.data(), headers.size(), consumed);
+        for (size_t n = 0; n < totalSize; n += bufferSize) {
+            // As received, the parser is not given the same buffer twice
+            content.assign(block.begin(), block.end());
+            REQUIRE(parser.parse(content.data(), content.size(), consumed) ==
+                    MultiPartParser::indeterminate);
+        }
+        REQUIRE(parser.parse(closing.data(), closing.size(), consumed) == MultiPartParser::done);
+        double ns = static_cast<double>(
+            duration_cast<nanoseconds>(steady_clock::now() - start).count());
+        std::cout << bufferSize << " byte buffers: " << totalSize / ns * 1e3 << " MB/s"
+                  << std::endl;
+    }
 }
@@ -41,6 +41,14 @@ TEST_CASE("decode GET request", "[request_decoder]") {
         REQUIRE(getRequest.queryParams_[0] ==
                 std::make_pair<std::string, std::string>("myKey", "my value"));
     }
+    SECTION("it should decode each escape from its two hex digits only") {
+        getRequest.uri_ = "/file.bin?myKey=%41%4a1%2F";
+        std::vector<char> content;
+        REQUIRE(reqDecoder.decodeRequest(getRequest, content) == true);
+        REQUIRE(getRequest.queryParams_.size() == 1);
+        REQUIRE(getRequest.queryParams_[0] ==
+                std::make_pair<std::string, std::string>("myKey", "AJ1/"));
+    }
 }
 
 TEST_CASE("decode POST request", "[request_decoder]") {
@@ -1,4 +1,5 @@
 #include <catch2/catch_test_macros.hpp>
+#include <cctype>
 #include <iostream>
 
 #include "beauty/request.hpp"
@@ -242,8 +243,8 @@ TEST_CASE("parse POST request", "[request_parser]") {
 
         REQUIRE(result == RequestParser::missing_content_length);
     }
-    SECTION("should return missing_content_length for POST HTTP/1.1 with chunked body") {
-        const std::string request =
+    SECTION("should decode the chunked body of POST HTTP/1.1") {
+        const char request[] =
             "POST /uri.cgi HTTP/1.1\r\n"
             "Content-Type: text/plain\r\n"
             "Transfer-Encoding: chunked\r\n"
@@ -259,8 +260,13 @@ TEST_CASE("parse POST request", "[request_parser]") {
             "sequence\0\r\n"
             "0\r\n\r\n";
 
-        auto result = fixture.parse_complete(request);
-        REQUIRE(result == RequestParser::missing_content_length);
+        auto result = fixture.parse_complete(std::string(request, sizeof(request) - 1));
+        REQUIRE(result == RequestParser::good_complete);
+        const char expected[] =
+            "This is the data in the first chunk and this is the second one consequence\0";
+        std::vector<char> expectedContent(expected, expected + sizeof(expected) - 1);
+        REQUIRE(fixture.content_ == expectedContent);
+        REQUIRE(fixture.request.getNoInitialBodyBytesReceived() == expectedContent.size());
     }
     SECTION("should return bad POST HTTP/1.1 with chunked body and Content-Length") {
         const std::string request =
@@ -478,3 +484,285 @@ TEST_CASE("Should parse request with Content-Length:0", "[request_parser]") {
     REQUIRE(fixture.request.httpVersionMinor_ == 1);
     REQUIRE(fixture.request.body_.empty());
 }
+
+TEST_CASE("parse pipelined requests", "[request_parser]") {
+    RequestFixture fixture(1024);
+    const std::string first =
+        "POST /first HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "Content-Length: 4\r\n"
+        "\r\n"
+        "body";
+    const std::string second =
+        "GET /second HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "\r\n";
+
+    SECTION("it should keep the bytes following a complete request") {
+        RequestParser parser;
+        fixture.content_.assign(first.begin(), first.end());
+        fixture.content_.insert(fixture.content_.end(), second.begin(), second.end());
+
+        auto result = parser.parse(fixture.request, fixture.content_);
+
+        REQUIRE(result == RequestParser::good_complete);
+        REQUIRE(fixture.request.uri_ == "/first");
+        REQUIRE(fixture.content_ == convertToCharVec("body"));
+        REQUIRE(parser.getUnconsumedSize() == second.size());
+
+        std::vector<char> unconsumed;
+        parser.takeUnconsumed(unconsumed);
+        REQUIRE(unconsumed == convertToCharVec(second));
+        REQUIRE(parser.getUnconsumedSize() == 0);
+    }
+    SECTION("it should wait for more data when headers are incomplete") {
+        RequestParser parser;
+        const std::string part = second.substr(0, 20);
+        fixture.content_.assign(part.begin(), part.end());
+
+        auto result = parser.parse(fixture.request, fixture.content_);
+        REQUIRE(result == RequestParser::indeterminate);
+
+        const std::string rest = second.substr(20);
+        fixture.content_.assign(rest.begin(), rest.end());
+        result = parser.parse(fixture.request, fixture.content_);
+        REQUIRE(result == RequestParser::good_complete);
+        REQUIRE(fixture.request.uri_ == "/second");
+        REQUIRE(parser.getUnconsumedSize() == 0);
+    }
+}
+
+TEST_CASE("parse request header views", "[request_parser]") {
+    RequestFixture fixture(1024);
+    const std::string request =
+        "GET /uri?a=1 HTTP/1.1\r\n"
+        "Host: www.example.com\r\n"
+        "X-Empty: \r\n"
+        "x-folded: first\r\n"
+        " second\r\n"
+        "\r\n";
+
+    SECTION("it should provide views of the request line and headers") {
+        auto result = fixture.parse_complete(request);
+
+        REQUIRE(result == RequestParser::good_complete);
+        REQUIRE(fixture.request.getMethodView() == "GET");
+        REQUIRE(fixture.request.getUriView() == "/uri?a=1");
+        REQUIRE(fixture.request.getNoHeaders() == 3);
+        REQUIRE(fixture.request.getHeaderNameView(0) == "Host");
+        REQUIRE(fixture.request.getHeaderValueView(0) == "www.example.com");
+        REQUIRE(fixture.request.getHeaderView("host") == "www.example.com");
+        REQUIRE(fixture.request.getHeaderView("x-empty").empty());
+        REQUIRE(fixture.request.getHeaderView("missing").empty());
+        REQUIRE(fixture.request.headers_.size() == 3);
+    }
+    SECTION("it should join folded header lines") {
+        auto result = fixture.parse_complete(request);
+
+        REQUIRE(result == RequestParser::good_complete);
+        REQUIRE(fixture.request.getHeaderView("X-Folded") == "first   second");
+        REQUIRE(fixture.request.getHeaderValue("X-Folded") == "first   second");
+    }
+    SECTION("it should keep views of headers split over several reads") {
+        RequestParser parser;
+        for (size_t i = 0; i < request.size(); i += 7) {
+            const std::string part = request.substr(i, 7);
+            fixture.content_.assign(part.begin(), part.end());
+            auto result = parser.parse(fixture.request, fixture.content_);
+            REQUIRE(result ==
+                    (i + 7 < request.size() ? RequestParser::indeterminate
+                                            : RequestParser::good_complete));
+        }
+        REQUIRE(fixture.request.uri_ == "/uri?a=1");
+        REQUIRE(fixture.request.getHeaderView("Host") == "www.example.com");
+        REQUIRE(fixture.request.getHeaderView("X-Folded") == "first   second");
+    }
+    SECTION("it should only fill the views if configured") {
+        RequestParser parser;
+        parser.setHeaderViewsOnly(true);
+        fixture.content_.assign(request.begin(), request.end());
+
+        auto result = parser.parse(fixture.request, fixture.content_);
+
+        REQUIRE(result == RequestParser::good_complete);
+        REQUIRE(fixture.request.method_ == "GET");
+        REQUIRE(fixture.request.headers_.empty());
+        REQUIRE(fixture.request.getNoHeaders() == 3);
+        REQUIRE(fixture.request.getHeaderValue("HOST") == "www.example.com");
+    }
+    SECTION("it should keep the views when body data follows the headers") {
+        RequestParser parser;
+        parser.setHeaderViewsOnly(true);
+        const std::string post =
+            "POST /uri HTTP/1.1\r\n"
+            "content-length: 4\r\n"
+            "Upgrade-Insecure-Requests: 1\r\n"
+            "\r\n"
+            "body";
+        fixture.content_.assign(post.begin(), post.end());
+
+        auto result = parser.parse(fixture.request, fixture.content_);
+
+        REQUIRE(result == RequestParser::good_complete);
+        REQUIRE(fixture.content_ == convertToCharVec("body"));
+        REQUIRE(fixture.request.getNoInitialBodyBytesReceived() == 4);
+        REQUIRE(fixture.request.getUriView() == "/uri");
+        REQUIRE(fixture.request.getHeaderView("Content-Length") == "4");
+        REQUIRE(fixture.request.getHeaderView("upgrade-insecure-requests") == "1");
+    }
+}
+
+TEST_CASE("parse request body larger than the headers", "[request_parser]") {
+    RequestFixture fixture(1024);
+    std::string body;
+    for (size_t i = 0; i < 500; ++i) {
+        body.push_back(static_cast<char>('a' + i % 26));
+    }
+    const std::string request =
+        "POST /uri HTTP/1.1\r\n"
+        "Content-Length: 500\r\n"
+        "\r\n" +
+        body;
+
+    auto result = fixture.parse_complete(request);
+
+    REQUIRE(result == RequestParser::good_complete);
+    REQUIRE(fixture.content_ == convertToCharVec(body));
+    REQUIRE(fixture.request.getNoInitialBodyBytesReceived() == 500);
+}
+
+TEST_CASE("parse chunked request body", "[request_parser]") {
+    RequestFixture fixture(1024);
+    RequestParser parser;
+    const std::string headers =
+        "POST /upload HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "\r\n";
+
+    SECTION("it should decode chunks received over several reads") {
+        std::string body;
+        for (size_t i = 0; i < 300; ++i) {
+            body.push_back(static_cast<char>('a' + i % 26));
+        }
+        const std::string chunks = "64\r\n" + body.substr(0, 100) + "\r\n" +
+                                   "C8;name=value\r\n" + body.substr(100) + "\r\n" +
+                                   "0\r\nChecksum: 1234\r\n\r\n";
+        const std::string request = headers + chunks;
+
+        // Split within the size line of the second chunk
+        const size_t split = headers.size() + 108;
+        fixture.content_.assign(request.begin(), request.begin() + split);
+        auto result = parser.parse(fixture.request, fixture.content_);
+        REQUIRE(result == RequestParser::good_part);
+        REQUIRE(fixture.content_ == convertToCharVec(body.substr(0, 100)));
+
+        // Split within the data of the second chunk
+        size_t offset = fixture.content_.size();
+        fixture.content_.insert(fixture.content_.end(), request.begin() + split,
+                                request.begin() + split + 100);
+        result = parser.parseChunked(fixture.content_, offset);
+        REQUIRE(result == RequestParser::good_part);
+
+        offset = fixture.content_.size();
+        fixture.content_.insert(fixture.content_.end(), request.begin() + split + 100,
+                                request.end());
+        result = parser.parseChunked(fixture.content_, offset);
+        REQUIRE(result == RequestParser::good_complete);
+        REQUIRE(fixture.content_ == convertToCharVec(body));
+        REQUIRE(parser.getUnconsumedSize() == 0);
+    }
+    SECTION("it should keep the bytes following the last chunk") {
+        const std::string next =
+            "GET /next HTTP/1.1\r\n"
+            "Host: example.com\r\n"
+            "\r\n";
+        fixture.content_.assign(headers.begin(), headers.end());
+        auto result = parser.parse(fixture.request, fixture.content_);
+        REQUIRE(result == RequestParser::good_part);
+        REQUIRE(fixture.content_.empty());
+
+        const std::string chunks = "4\r\nbody\r\n0\r\n\r\n" + next;
+        fixture.content_.assign(chunks.begin(), chunks.end());
+        result = parser.parseChunked(fixture.content_, 0);
+        REQUIRE(result == RequestParser::good_complete);
+        REQUIRE(fixture.content_ == convertToCharVec("body"));
+
+        std::vector<char> unconsumed;
+        parser.takeUnconsumed(unconsumed);
+        REQUIRE(unconsumed == convertToCharVec(next));
+    }
+    SECTION("it should reject invalid chunks") {
+        const std::string request = headers + "4\r\nbodyX\r\n0\r\n\r\n";
+        REQUIRE(fixture.parse_complete(request) == RequestParser::bad);
+    }
+    SECTION("it should reject an invalid chunk size") {
+        const std::string request = headers + "x4\r\nbody\r\n0\r\n\r\n";
+        REQUIRE(fixture.parse_complete(request) == RequestParser::bad);
+    }
+    SECTION("it should reject chunks larger than the max chunk size") {
+        parser.setMaxChunkSize(16);
+        const std::string request = headers + "11\r\n";
+        fixture.content_.assign(request.begin(), request.end());
+        REQUIRE(parser.parse(fixture.request, fixture.content_) ==
+                RequestParser::payload_too_large);
+    }
+    SECTION("it should reject chunk sizes overflowing size_t") {
+        const std::string request = headers + "10000000000000000\r\n";
+        fixture.content_.assign(request.begin(), request.end());
+        REQUIRE(parser.parse(fixture.request, fixture.content_) ==
+                RequestParser::payload_too_large);
+    }
+}
+
+TEST_CASE("known header lookup", "[request_parser]") {
+    RequestFixture fixture(1024);
+    const std::string request =
+        "GET /uri HTTP/1.1\r\n"
+        "Host: www.example.com\r\n"
+        "origin: http://localhost:8080\r\n"
+        "Origin: http://other\r\n"
+        "If-None-Match: \"abc\"\r\n"
+        "X-Custom: value\r\n"
+        "\r\n";
+
+    SECTION("it should find well known headers by index") {
+        auto result = fixture.parse_complete(request);
+
+        REQUIRE(result == RequestParser::good_complete);
+        REQUIRE(fixture.request.getHeaderView(Request::host) == "www.example.com");
+        REQUIRE(fixture.request.getHeaderView(Request::origin) == "http://localhost:8080");
+        REQUIRE(fixture.request.getHeaderView(Request::if_none_match) == "\"abc\"");
+        REQUIRE(fixture.request.getHeaderView(Request::range).empty());
+        REQUIRE(fixture.request.getHeaderValue("ORIGIN") == "http://localhost:8080");
+        REQUIRE(fixture.request.getHeaderValue("x-custom") == "value");
+    }
+    SECTION("it should classify header names case insensitively") {
+        REQUIRE(Request::toKnownHeader("content-TYPE") == Request::content_type);
+        REQUIRE(Request::toKnownHeader("Sec-WebSocket-Key") == Request::sec_websocket_key);
+        REQUIRE(Request::toKnownHeader("Content-Typ") == Request::nr_of_known_headers);
+        REQUIRE(Request::knownHeaderName(Request::accept_encoding) == "Accept-Encoding");
+    }
+    SECTION("it should classify all well known headers, and only these") {
+        for (int i = 0; i < Request::nr_of_known_headers; ++i) {
+            auto known = static_cast<Request::known_header>(i);
+            std::string name = Request::knownHeaderName(known).str();
+            REQUIRE(Request::toKnownHeader(name) == known);
+            for (auto& c : name) {
+                c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+            }
+            REQUIRE(Request::toKnownHeader(name) == known);
+        }
+        // names of the same length as well known ones
+        REQUIRE(Request::toKnownHeader("Accepx") == Request::nr_of_known_headers);
+        REQUIRE(Request::toKnownHeader("Server") == Request::nr_of_known_headers);
+        REQUIRE(Request::toKnownHeader("X-Forwarded-Proto") == Request::nr_of_known_headers);
+        REQUIRE(Request::toKnownHeader("") == Request::nr_of_known_headers);
+    }
+    SECTION("it should look up headers of a request not parsed") {
+        fixture.request.headers_.push_back({"Content-Type", "text/plain"});
+
+        REQUIRE(fixture.request.getHeaderView(Request::content_type) == "text/plain");
+        REQUIRE(fixture.request.getHeaderValue("content-type") == "text/plain");
+    }
+}
@@ -0,0 +1,191 @@
+#include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include "beauty/server_pool.hpp"
+
+using namespace std::literals::chrono_literals;
+using namespace beauty;
+
+namespace {
+
+const std::string GetApiKeepAliveRequest =
+    "GET /api/status HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n\r\n";
+
+// Minimal blocking client sending requests on a persistent connection.
+class BlockingClient {
+   public:
+    explicit BlockingClient(uint16_t port) : socket_(ioc_) {
+        socket_.connect(asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), port));
+        socket_.set_option(asio::ip::tcp::no_delay(true));
+    }
+
+    // Returns the status code of the response, 0 on failure.
+    int get(const std::string& request) {
+        std::error_code ec;
+        asio::write(socket_, asio::buffer(request), ec);
+        if (ec) {
+            return 0;
+        }
+        size_t headerEnd = asio::read_until(socket_, asio::dynamic_buffer(data_), "\r\n\r\n", ec);
+        if (ec) {
+            return 0;
+        }
+        std::string headers = data_.substr(0, headerEnd);
+        size_t contentLength = 0;
+        size_t pos = headers.find("Content-Length: ");
+        if (pos != std::string::npos) {
+            contentLength = std::stoul(headers.substr(pos + 16));
+        }
+        if (data_.size() < headerEnd + contentLength) {
+            asio::read(socket_,
+                       asio::dynamic_buffer(data_),
+                       asio::transfer_exactly(headerEnd + contentLength - data_.size()),
+                       ec);
+            if (ec) {
+                return 0;
+            }
+        }
+        data_.erase(0, headerEnd + contentLength);
+        return std::stoi(headers.substr(9, 3));
+    }
+
+   private:
+    asio::io_context ioc_;
+    asio::ip::tcp::socket socket_;
+    std::string data_;
+};
+
+// Simulates a handler doing some work before replying.
+void busyApiHandler(const Request& req, Reply& rep) {
+    if (req.requestPath_ != "/api/status") {
+        return;
+    }
+    volatile uint64_t sum = 0;
+    for (uint64_t i = 0; i < 20000; ++i) {
+        sum = sum + i * i;
+    }
+    static const std::string body = "{\"status\":\"ok\"}";
+    rep.content_.assign(body.begin(), body.end());
+    rep.send(Reply::status_type::ok, "application/json");
+}
+
+double measureRequestsPerSecond(size_t nrOfWorkers, size_t nrOfClients) {
+    Settings settings(5s, 1000000, 0);
+    ServerPool pool("127.0.0.1", "0", nrOfWorkers, settings);
+    pool.addRequestHandler(busyApiHandler);
+    uint16_t port = pool.getBindedPort();
+    pool.start();
+
+    std::atomic<bool> running(true);
+    std::atomic<size_t> completed(0);
+    std::vector<std::thread> clients;
+    for (size_t i = 0; i < nrOfClients; ++i) {
+        clients.emplace_back([&]() {
+            BlockingClient client(port);
+            while (running && client.get(GetApiKeepAliveRequest) == 200) {
+                completed++;
+            }
+        });
+    }
+    std::this_thread::sleep_for(2s);
+    running = false;
+    for (auto& c : clients) {
+        c.join();
+    }
+    pool.stop();
+    pool.join();
+    return completed / 2.0;
+}
+
+}  // namespace
+
+TEST_CASE("server pool", "[server_pool]") {
+    Settings settings(5s, 1000, 0);
+
+    SECTION("it should bind all workers to the same port") {
+        ServerPool pool("127.0.0.1", "0", 4, settings);
+        REQUIRE(pool.getBindedPort() != 0);
+        for (size_t i = 0; i < pool.getNrOfWorkers(); ++i) {
+            REQUIRE(pool.getServer(i).getBindedPort() == pool.getBindedPort());
+        }
+    }
+    SECTION("it should serve requests from all worker threads") {
+        ServerPool pool("127.0.0.1", "0", 4, settings);
+        std::mutex m;
+        std::set<std::thread::id> threadIds;
+        pool.addRequestHandler([&](const Request&, Reply& rep) {
+            {
+                std::lock_guard<std::mutex> lock(m);
+                threadIds.insert(std::this_thread::get_id());
+            }
+            rep.send(Reply::status_type::ok);
+        });
+        uint16_t port = pool.getBindedPort();
+        pool.start();
+
+        // Each connection is accepted by one of the workers, so with many
+        // connections it is very unlikely that all are accepted by the same.
+        int nrOk = 0;
+        for (int i = 0; i < 64; ++i) {
+            BlockingClient client(port);
+            if (client.get(GetApiKeepAliveRequest) == 200) {
+                nrOk++;
+            }
+        }
+        pool.stop();
+        pool.join();
+
+        REQUIRE(nrOk == 64);
+        if (pool.getNrOfWorkers() > 1) {
+            REQUIRE(threadIds.size() > 1);
+        }
+    }
+    SECTION("it should create WebSocket endpoints per worker") {
+        class Endpoint : public WsEndpoint {
+           public:
+            Endpoint() : WsEndpoint("/ws") {}
+            void onWsOpen(const std::string&) override {}
+            void onWsMessage(const std::string&, const WsMessage&) override {}
+            void onWsClose(const std::string&) override {}
+            void onWsError(const std::string&, const std::string&) override {}
+        };
+        ServerPool pool("127.0.0.1", "0", 3, settings);
+        std::set<size_t> workers;
+        pool.setWsEndpoints([&](size_t worker) {
+            workers.insert(worker);
+            return std::set<std::shared_ptr<WsEndpoint>>{std::make_shared<Endpoint>()};
+        });
+        REQUIRE(workers.size() == pool.getNrOfWorkers());
+    }
+    SECTION("it should stop all workers") {
+        ServerPool pool("127.0.0.1", "0", 2, settings);
+        uint16_t port = pool.getBindedPort();
+        pool.start();
+        BlockingClient client(port);
+        pool.stop();
+        pool.join();
+        REQUIRE(client.get(GetApiKeepAliveRequest) == 0);
+    }
+}
+
+// Not run by default, use: beauty_test "[.benchmark][server_pool]"
+TEST_CASE("server pool requests/s scaling", "[.benchmark][server_pool]") {
+    const size_t nrOfClients = 16;
+    size_t maxWorkers = std::max(1u, std::thread::hardware_concurrency());
+    double single = 0;
+    for (size_t workers = 1; workers <= maxWorkers; workers *= 2) {
+        double rps = measureRequestsPerSecond(workers, nrOfClients);
+        if (workers == 1) {
+            single = rps;
+        }
+        std::cout << "workers: " << workers << ", requests/s: " << static_cast<size_t>(rps)
+                  << ", scaling: " << (single > 0 ? rps / single : 0) << std::endl;
+        REQUIRE(rps > 0);
+    }
+}
@@ -1,13 +1,22 @@
 #include <catch2/catch_test_macros.hpp>
+#include <atomic>
 #include <chrono>
+#include <fstream>
 #include <future>
+#include <iostream>
+#include <iterator>
+#include <mutex>
 #include <numeric>
+#include <set>
+#include <sstream>
 #include <thread>
 
+#include "file_io.hpp"
 #include "utils/mock_file_io.hpp"
 #include "utils/mock_not_found_handler.hpp"
 #include "utils/mock_request_handler.hpp"
 #include "utils/test_client.hpp"
+#include "zlib_compressor.hpp"
 
 #include "beauty/server.hpp"
 #include "beauty/request_handler.hpp"
@@ -54,6 +63,24 @@ std::vector<char> convertToCharVec(const std::string& s) {
     return ret;
 }
 
+// FileIO counting the writes which complete a file.
+class CountingFileIO : public FileIO {
+   public:
+    using FileIO::FileIO;
+    void writeFile(const std::string& id,
+                   const Request& request,
+                   Reply& reply,
+                   const char* buf,
+                   size_t size,
+                   bool lastData) override {
+        FileIO::writeFile(id, request, reply, buf, size, lastData);
+        if (lastData) {
+            ++nrOfLastWrites_;
+        }
+    }
+    std::atomic<int> nrOfLastWrites_{0};
+};
+
 // Test requests.
 // We specify the "Connection: close" header so that the server will close the
 // socket after transmitting the response. This will allow us to treat all data
@@ -597,6 +624,49 @@ TEST_CASE("server with write fileIO", "[server]") {
         CHECK(result.size() == expected.size());
         REQUIRE(result == expected);
     }
+    SECTION("it should write all files of a multipart request that exceeds buffer size") {
+        const std::string boundary = "boundary123456789";
+        const std::string firstContent(3000, 'A');
+        const std::string secondContent(2000, 'B');
+        std::string requestBody;
+        for (const auto& file : {std::make_pair("first.txt", firstContent),
+                                 std::make_pair("second.txt", secondContent)}) {
+            requestBody += "--" + boundary +
+                           "\r\nContent-Disposition: form-data; name=\"file\"; filename=\"" +
+                           file.first + "\"\r\n\r\n" + file.second + "\r\n";
+        }
+        requestBody += "--" + boundary + "--\r\n";
+        const std::string requestHeaders =
+            "POST / HTTP/1.1\r\nHost: 127.0.0.1:8081\r\n"
+            "Content-Type: multipart/form-data; boundary=" +
+            boundary + "\r\nContent-Length: " + std::to_string(requestBody.length()) +
+            "\r\n\r\n";
+
+        openConnection(c, "127.0.0.1", port);
+        auto fut = createFutureResult(c, ExpectedResult::Headers);
+        c.sendRequest(requestHeaders + requestBody);
+        auto res = fut.get();
+
+        REQUIRE(res.statusCode_ == 201);
+        REQUIRE(mockFileIO.getOpenFileForWriteCalls() == 2);
+        REQUIRE(mockFileIO.getLastData("/first.txt0") == true);
+        REQUIRE(mockFileIO.getLastData("/second.txt0") == true);
+        std::vector<char> result = mockFileIO.getMockWriteFile("/first.txt0");
+        REQUIRE(std::string(result.begin(), result.end()) == firstContent);
+        result = mockFileIO.getMockWriteFile("/second.txt0");
+        REQUIRE(std::string(result.begin(), result.end()) == secondContent);
+    }
+    SECTION("it should not write octet-stream bodies to files unless enabled") {
+        openConnection(c, "127.0.0.1", port);
+        auto fut = createFutureResult(c, ExpectedResult::Headers);
+        c.sendRequest(
+            "PUT /index.html HTTP/1.1\r\nHost: 127.0.0.1:8081\r\n"
+            "Content-Type: application/octet-stream\r\nContent-Length: 5\r\n\r\nhello");
+        auto res = fut.get();
+
+        REQUIRE(res.statusCode_ != 201);
+        REQUIRE(mockFileIO.getOpenFileForWriteCalls() == 0);
+    }
 
     ioc.stop();
     t.join();
@@ -906,3 +976,1354 @@ TEST_CASE("server with write fileIO with 100-continue support", "[server]") {
     ioc.stop();
     t.join();
 }
+
+TEST_CASE("server with pipelined requests", "[server]") {
+    asio::io_context ioc;
+    Settings settings(5s, 100, 0);
+    Server dut(ioc, "127.0.0.1", "0", settings);
+    dut.addRequestHandler([](const Request& req, Reply& rep) {
+        std::string content = req.method_ + " " + req.requestPath_;
+        if (!req.body_.empty()) {
+            content += " " + std::string(req.body_.begin(), req.body_.end());
+        }
+        rep.content_.assign(content.begin(), content.end());
+        rep.send(Reply::status_type::ok, "text/plain");
+    });
+    auto t = std::thread(&asio::io_context::run, &ioc);
+
+    asio::io_context clientIoc;
+    asio::ip::tcp::socket socket(clientIoc);
+    socket.connect(
+        asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), dut.getBindedPort()));
+
+    // Reads until the server closes the connection.
+    auto readAll = [&socket]() {
+        std::string data;
+        std::error_code ec;
+        asio::read(socket, asio::dynamic_buffer(data), ec);
+        return data;
+    };
+    auto countOf = [](const std::string& data, const std::string& what) {
+        size_t n = 0;
+        for (size_t pos = data.find(what); pos != std::string::npos;
+             pos = data.find(what, pos + 1)) {
+            ++n;
+        }
+        return n;
+    };
+
+    SECTION("it should answer all requests in order") {
+        const std::string requests =
+            "GET /first HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n"
+            "POST /second HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: 4\r\n\r\nbody"
+            "GET /third HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n";
+        asio::write(socket, asio::buffer(requests));
+
+        std::string data = readAll();
+        REQUIRE(countOf(data, "HTTP/1.1 200 OK") == 3);
+        size_t first = data.find("GET /first");
+        size_t second = data.find("POST /second body");
+        size_t third = data.find("GET /third");
+        REQUIRE(first != std::string::npos);
+        REQUIRE(second != std::string::npos);
+        REQUIRE(third != std::string::npos);
+        REQUIRE(first < second);
+        REQUIRE(second < third);
+    }
+    SECTION("it should complete a request split after pipelined ones") {
+        const std::string requests =
+            "GET /first HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n"
+            "GET /second HTTP/1.1\r\nHo";
+        asio::write(socket, asio::buffer(requests));
+
+        std::string data;
+        asio::read_until(socket, asio::dynamic_buffer(data), "GET /first");
+        asio::write(socket, asio::buffer(std::string("st: 127.0.0.1\r\nConnection: close\r\n\r\n")));
+
+        data += readAll();
+        REQUIRE(countOf(data, "HTTP/1.1 200 OK") == 2);
+        REQUIRE(data.find("GET /second") != std::string::npos);
+    }
+
+    ioc.stop();
+    t.join();
+}
+
+TEST_CASE("server keep-alive timeout", "[server]") {
+    asio::io_context ioc;
+    Settings settings(300ms, 100, 0);
+    // Activity is timestamped with a clock updated once per resolution
+    settings.timerResolution_ = 1s;
+    Server dut(ioc, "127.0.0.1", "0", settings);
+    dut.addRequestHandler([](const Request&, Reply& rep) { rep.send(Reply::status_type::ok); });
+    auto t = std::thread(&asio::io_context::run, &ioc);
+
+    asio::io_context clientIoc;
+    asio::ip::tcp::socket socket(clientIoc);
+    socket.connect(
+        asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), dut.getBindedPort()));
+    const std::string request = "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+
+    SECTION("it should not close idle connections before the timeout") {
+        // over more than one resolution
+        std::string data;
+        for (int i = 0; i < 10; ++i) {
+            asio::write(socket, asio::buffer(request));
+            size_t n = asio::read_until(socket, asio::dynamic_buffer(data), "\r\n\r\n");
+            REQUIRE(data.find("HTTP/1.1 200 OK\r\n") == 0);
+            data.erase(0, n);
+            std::this_thread::sleep_for(150ms);
+        }
+
+        // closed once idle, within two resolutions
+        auto start = std::chrono::steady_clock::now();
+        std::error_code ec;
+        asio::read(socket, asio::dynamic_buffer(data), ec);
+        REQUIRE(ec == asio::error::eof);
+        REQUIRE(std::chrono::steady_clock::now() - start < 3s);
+    }
+
+    ioc.stop();
+    t.join();
+}
+
+TEST_CASE("server reply headers", "[server]") {
+    asio::io_context ioc;
+    Settings settings(5s, 100, 0);
+    settings.sendDateHeader_ = true;
+    Server dut(ioc, "127.0.0.1", "0", settings);
+    dut.addRequestHandler([](const Request&, Reply& rep) {
+        const std::string content = "hello";
+        rep.content_.assign(content.begin(), content.end());
+        rep.send(Reply::status_type::ok, "text/plain");
+    });
+    auto t = std::thread(&asio::io_context::run, &ioc);
+
+    asio::io_context clientIoc;
+    asio::ip::tcp::socket socket(clientIoc);
+    socket.connect(
+        asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), dut.getBindedPort()));
+
+    SECTION("it should render all headers in order, followed by the content") {
+        asio::write(socket, asio::buffer(std::string("GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n")));
+        std::string data;
+        size_t n = asio::read_until(socket, asio::dynamic_buffer(data), "\r\n\r\n");
+        if (data.size() < n + 5) {
+            asio::read(socket,
+                       asio::dynamic_buffer(data),
+                       asio::transfer_exactly(n + 5 - data.size()));
+        }
+
+        const std::string expectedStart =
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Length: 5\r\n"
+            "Content-Type: text/plain\r\n"
+            "Connection: keep-alive\r\n"
+            "Keep-Alive: timeout=5, max=100\r\n"
+            "Date: ";
+        REQUIRE(data.substr(0, expectedStart.size()) == expectedStart);
+        // e.g. "Date: Sun, 06 Nov 1994 08:49:37 GMT"
+        size_t dateEnd = data.find("\r\n", expectedStart.size());
+        REQUIRE(dateEnd - expectedStart.size() == 29);
+        REQUIRE(data.substr(dateEnd - 4, 4) == " GMT");
+        REQUIRE(data.substr(n) == "hello");
+    }
+
+    ioc.stop();
+    t.join();
+}
+
+TEST_CASE("server stock replies", "[server]") {
+    asio::io_context ioc;
+    Settings settings(5s, 100, 0);
+    Server dut(ioc, "127.0.0.1", "0", settings);
+    auto t = std::thread(&asio::io_context::run, &ioc);
+
+    asio::io_context clientIoc;
+    asio::ip::tcp::socket socket(clientIoc);
+    socket.connect(
+        asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), dut.getBindedPort()));
+
+    auto readAll = [&socket]() {
+        std::string data;
+        std::error_code ec;
+        asio::read(socket, asio::dynamic_buffer(data), ec);
+        REQUIRE(ec == asio::error::eof);
+        return data;
+    };
+
+    SECTION("it should send the prebuilt reply and close the connection") {
+        asio::write(socket, asio::buffer(std::string("GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n")));
+
+        REQUIRE(readAll() ==
+                "HTTP/1.1 501 Not Implemented\r\n"
+                "Content-Length: 42\r\n"
+                "Content-Type: application/json\r\n"
+                "Connection: close\r\n"
+                "\r\n"
+                "{\"status\":501,\"message\":\"Not Implemented\"}");
+    }
+
+    SECTION("it should send the prebuilt reply without body for HEAD") {
+        asio::write(socket,
+                    asio::buffer(std::string("HEAD / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n")));
+
+        REQUIRE(readAll() ==
+                "HTTP/1.1 501 Not Implemented\r\n"
+                "Content-Length: 42\r\n"
+                "Content-Type: application/json\r\n"
+                "Connection: close\r\n"
+                "\r\n");
+    }
+
+    ioc.stop();
+    t.join();
+}
+
+TEST_CASE("server with native file io", "[server]") {
+    // FileIO provides native files, sent with sendfile() where supported
+    std::vector<char> fileContent(100000);
+    for (size_t i = 0; i < fileContent.size(); ++i) {
+        fileContent[i] = static_cast<char>(i % 251);
+    }
+    {
+        std::ofstream of("native_file_test.bin", std::ios::out | std::ios::binary);
+        of.write(fileContent.data(), fileContent.size());
+    }
+    asio::io_context ioc;
+    FileIO fileIO("./");
+    Settings settings(5s, 100, 0);
+    Server dut(ioc, "127.0.0.1", "0", settings);
+    dut.setFileIO(&fileIO);
+    auto t = std::thread(&asio::io_context::run, &ioc);
+
+    asio::io_context clientIoc;
+    asio::ip::tcp::socket socket(clientIoc);
+    socket.connect(
+        asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), dut.getBindedPort()));
+
+    SECTION("it should send the whole file after the headers") {
+        const std::string request =
+            "GET /native_file_test.bin HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+        std::string data;
+        for (int i = 0; i < 2; ++i) {
+            // twice on the same connection
+            asio::write(socket, asio::buffer(request));
+            size_t n = asio::read_until(socket, asio::dynamic_buffer(data), "\r\n\r\n");
+            REQUIRE(data.find("HTTP/1.1 200 OK\r\n") == 0);
+            REQUIRE(data.substr(0, n).find("Content-Length: 100000\r\n") != std::string::npos);
+            if (data.size() < n + fileContent.size()) {
+                asio::read(socket,
+                           asio::dynamic_buffer(data),
+                           asio::transfer_exactly(n + fileContent.size() - data.size()));
+            }
+            REQUIRE(std::equal(fileContent.begin(), fileContent.end(), data.begin() + n));
+            data.erase(0, n + fileContent.size());
+        }
+    }
+
+    ioc.stop();
+    t.join();
+    std::remove("native_file_test.bin");
+}
+
+TEST_CASE("server with cached file io", "[server]") {
+    {
+        std::ofstream of("cached_file_test.bin", std::ios::out | std::ios::binary);
+        of << std::string(5000, 'a');
+    }
+    asio::io_context ioc;
+    FileIO fileIO("./");
+    fileIO.enableCache(1024 * 1024, 64 * 1024);
+    Settings settings(5s, 100, 0);
+    Server dut(ioc, "127.0.0.1", "0", settings);
+    dut.setFileIO(&fileIO);
+    auto t = std::thread(&asio::io_context::run, &ioc);
+
+    asio::io_context clientIoc;
+    asio::ip::tcp::socket socket(clientIoc);
+    socket.connect(
+        asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), dut.getBindedPort()));
+    auto get = [&socket](const std::string& method) {
+        asio::write(socket,
+                    asio::buffer(method + " /cached_file_test.bin HTTP/1.1\r\n"
+                                          "Host: 127.0.0.1\r\n\r\n"));
+        std::string data;
+        size_t n = asio::read_until(socket, asio::dynamic_buffer(data), "\r\n\r\n");
+        size_t pos = data.find("Content-Length: ");
+        size_t contentLength = method == "HEAD" ? 0 : std::stoul(data.substr(pos + 16));
+        if (data.size() < n + contentLength) {
+            asio::read(socket,
+                       asio::dynamic_buffer(data),
+                       asio::transfer_exactly(n + contentLength - data.size()));
+        }
+        return data;
+    };
+
+    SECTION("it should serve files from memory") {
+        for (int i = 0; i < 2; ++i) {
+            std::string data = get("GET");
+            REQUIRE(data.find("HTTP/1.1 200 OK\r\n") == 0);
+            REQUIRE(data.find("Content-Length: 5000\r\n") != std::string::npos);
+            REQUIRE(data.find("Content-Type: text/plain\r\n") != std::string::npos);
+            REQUIRE(data.substr(data.size() - 5000) == std::string(5000, 'a'));
+        }
+        std::string data = get("HEAD");
+        REQUIRE(data.find("Content-Length: 5000\r\n") != std::string::npos);
+        REQUIRE(data.substr(data.size() - 4) == "\r\n\r\n");
+    }
+    SECTION("it should serve files written through the FileIO right away") {
+        get("GET");
+
+        std::vector<char> body;
+        Request req(body);
+        std::vector<char> sendBuffer;
+        Reply rep(sendBuffer);
+        rep.filePath_ = "cached_file_test.bin";
+        fileIO.openFileForWrite("upload", req, rep);
+        const std::string content(3000, 'b');
+        fileIO.writeFile("upload", req, rep, content.data(), content.size(), true);
+
+        std::string data = get("GET");
+        REQUIRE(data.find("Content-Length: 3000\r\n") != std::string::npos);
+        REQUIRE(data.substr(data.size() - 3000) == content);
+    }
+
+    ioc.stop();
+    t.join();
+    std::remove("cached_file_test.bin");
+}
+
+TEST_CASE("server with precompressed files", "[server]") {
+    auto writeFile = [](const std::string& path, const std::string& content) {
+        std::ofstream of(path, std::ios::out | std::ios::binary);
+        of << content;
+    };
+    writeFile("precompressed.js", "plain");
+    writeFile("precompressed.js.gz", "gzip");
+    writeFile("precompressed.css", "plain");
+    writeFile("precompressed.css.br", "br");
+    writeFile("precompressed.css.gz", "gzip");
+    asio::io_context ioc;
+    FileIO fileIO("./");
+    Settings settings(5s, 100, 0);
+    settings.servePrecompressed_ = true;
+    Server dut(ioc, "127.0.0.1", "0", settings);
+    dut.setFileIO(&fileIO);
+    // e.g. security headers, leaving the request to be served from file
+    dut.addRequestHandler(
+        [](const Request&, Reply& rep) { rep.addHeader("X-Content-Type-Options", "nosniff"); });
+    auto t = std::thread(&asio::io_context::run, &ioc);
+
+    asio::io_context clientIoc;
+    asio::ip::tcp::socket socket(clientIoc);
+    socket.connect(
+        asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), dut.getBindedPort()));
+    std::string headers;
+    auto get = [&socket, &headers](const std::string& path, const std::string& acceptEncoding) {
+        std::string request = "GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n";
+        if (!acceptEncoding.empty()) {
+            request += "Accept-Encoding: " + acceptEncoding + "\r\n";
+        }
+        asio::write(socket, asio::buffer(request + "\r\n"));
+        std::string data;
+        size_t n = asio::read_until(socket, asio::dynamic_buffer(data), "\r\n\r\n");
+        headers = data.substr(0, n);
+        size_t contentLength = std::stoul(headers.substr(headers.find("Content-Length: ") + 16));
+        if (data.size() < n + contentLength) {
+            asio::read(socket,
+                       asio::dynamic_buffer(data),
+                       asio::transfer_exactly(n + contentLength - data.size()));
+        }
+        return data.substr(n, contentLength);
+    };
+    auto getETag = [&headers]() {
+        size_t pos = headers.find("ETag: ");
+        return pos == std::string::npos ? "" : headers.substr(pos, headers.find("\r\n", pos) - pos);
+    };
+
+    SECTION("it should serve the sibling of an accepted encoding") {
+        REQUIRE(get("/precompressed.js", "gzip, deflate, br") == "gzip");
+        REQUIRE(headers.find("Content-Encoding: gzip\r\n") != std::string::npos);
+        REQUIRE(headers.find("Vary: Accept-Encoding\r\n") != std::string::npos);
+        REQUIRE(headers.find("Content-Type: application/javascript\r\n") != std::string::npos);
+        std::string gzipETag = getETag();
+
+        REQUIRE(get("/precompressed.js", "") == "plain");
+        REQUIRE(headers.find("Content-Encoding") == std::string::npos);
+        REQUIRE(headers.find("Vary: Accept-Encoding\r\n") != std::string::npos);
+        REQUIRE(getETag() != gzipETag);
+    }
+    SECTION("it should prefer br") {
+        REQUIRE(get("/precompressed.css", "gzip, br") == "br");
+        REQUIRE(headers.find("Content-Encoding: br\r\n") != std::string::npos);
+        REQUIRE(headers.find("Content-Type: text/css\r\n") != std::string::npos);
+    }
+    SECTION("it should not serve encodings with q=0") {
+        REQUIRE(get("/precompressed.css", "br;q=0, gzip;q=0.5") == "gzip");
+        REQUIRE(get("/precompressed.css", "*;q=0") == "plain");
+        REQUIRE(get("/precompressed.css", "*") == "br");
+    }
+    SECTION("it should keep headers added by request handlers when a sibling is missing") {
+        REQUIRE(get("/precompressed.js", "br, gzip") == "gzip");
+        REQUIRE(headers.find("X-Content-Type-Options: nosniff\r\n") != std::string::npos);
+        REQUIRE(headers.find("Content-Encoding: gzip\r\n") != std::string::npos);
+
+        REQUIRE(get("/precompressed.js", "br") == "plain");
+        REQUIRE(headers.find("X-Content-Type-Options: nosniff\r\n") != std::string::npos);
+        REQUIRE(headers.find("Content-Encoding") == std::string::npos);
+        REQUIRE(headers.find("Vary: Accept-Encoding\r\n") != std::string::npos);
+    }
+
+    ioc.stop();
+    t.join();
+    for (const char* path : {"precompressed.js",
+                             "precompressed.js.gz",
+                             "precompressed.css",
+                             "precompressed.css.br",
+                             "precompressed.css.gz"}) {
+        std::remove(path);
+    }
+}
+
+TEST_CASE("server with compression", "[server]") {
+    std::string text;
+    for (int i = 0; text.size() < 5000; ++i) {
+        text += "{\"id\":" + std::to_string(i) + ",\"name\":\"sensor\",\"value\":42},";
+    }
+    std::ofstream("compressed.txt", std::ios::out | std::ios::binary) << text;
+
+    asio::io_context ioc;
+    FileIO fileIO("./");
+    ZlibCompressorFactory compressorFactory;
+    Settings settings(5s, 100, 0);
+    Server dut(ioc, "127.0.0.1", "0", settings);
+    dut.setFileIO(&fileIO);
+    dut.setCompressorFactory(&compressorFactory);
+    dut.addRequestHandler([&text](const Request& req, Reply& rep) {
+        if (req.requestPath_ == "/json" || req.requestPath_ == "/png" ||
+            req.requestPath_ == "/small") {
+            size_t size = req.requestPath_ == "/small" ? 100 : text.size();
+            rep.content_.assign(text.begin(), text.begin() + size);
+            rep.send(Reply::ok, req.requestPath_ == "/png" ? "image/png" : "application/json");
+        } else if (req.requestPath_ == "/stream") {
+            auto offset = std::make_shared<size_t>(0);
+            rep.sendStreaming(Reply::ok,
+                              "text/plain",
+                              [&text, offset](const std::string&, char* buf, size_t maxSize) {
+                                  size_t n = std::min<size_t>({text.size() - *offset, maxSize, 500});
+                                  std::memcpy(buf, text.data() + *offset, n);
+                                  *offset += n;
+                                  return static_cast<int>(n);
+                              });
+        } else if (req.requestPath_ == "/big") {
+            auto offset = std::make_shared<size_t>(0);
+            rep.sendBig(Reply::ok,
+                        "text/plain",
+                        text.size(),
+                        [&text, offset](const std::string&, char* buf, size_t maxSize) {
+                            size_t n = std::min(text.size() - *offset, maxSize);
+                            if (buf != nullptr) {
+                                std::memcpy(buf, text.data() + *offset, n);
+                            }
+                            *offset += n;
+                            return static_cast<int>(n);
+                        });
+        }
+    });
+    auto t = std::thread(&asio::io_context::run, &ioc);
+
+    asio::io_context clientIoc;
+    asio::ip::tcp::socket socket(clientIoc);
+    socket.connect(
+        asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), dut.getBindedPort()));
+    std::string headers;
+    // The content of the reply, de-chunked if chunked
+    auto get = [&socket, &headers](const std::string& path, const std::string& acceptEncoding) {
+        std::string request = "GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n";
+        if (!acceptEncoding.empty()) {
+            request += "Accept-Encoding: " + acceptEncoding + "\r\n";
+        }
+        asio::write(socket, asio::buffer(request + "\r\n"));
+        std::string data;
+        size_t n = asio::read_until(socket, asio::dynamic_buffer(data), "\r\n\r\n");
+        headers = data.substr(0, n);
+        data.erase(0, n);
+        size_t pos = headers.find("Content-Length: ");
+        if (pos != std::string::npos) {
+            size_t contentLength = std::stoul(headers.substr(pos + 16));
+            if (data.size() < contentLength) {
+                asio::read(socket,
+                           asio::dynamic_buffer(data),
+                           asio::transfer_exactly(contentLength - data.size()));
+            }
+            return data;
+        }
+        std::string content;
+        for (;;) {
+            n = asio::read_until(socket, asio::dynamic_buffer(data), "\r\n");
+            size_t chunkSize = std::stoul(data.substr(0, n - 2), nullptr, 16);
+            data.erase(0, n);
+            if (data.size() < chunkSize + 2) {
+                asio::read(socket,
+                           asio::dynamic_buffer(data),
+                           asio::transfer_exactly(chunkSize + 2 - data.size()));
+            }
+            content += data.substr(0, chunkSize);
+            data.erase(0, chunkSize + 2);
+            if (chunkSize == 0) {
+                return content;
+            }
+        }
+    };
+    // Decompress gzip or zlib data
+    auto inflateAll = [](const std::string& in) {
+        z_stream stream = {};
+        inflateInit2(&stream, 15 + 32);
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+        stream.avail_in = static_cast<uInt>(in.size());
+        std::string out;
+        char buf[4096];
+        int ret;
+        do {
+            stream.next_out = reinterpret_cast<Bytef*>(buf);
+            stream.avail_out = sizeof(buf);
+            ret = inflate(&stream, Z_NO_FLUSH);
+            out.append(buf, sizeof(buf) - stream.avail_out);
+        } while (ret == Z_OK);
+        inflateEnd(&stream);
+        return ret == Z_STREAM_END ? out : "inflate failed";
+    };
+
+    SECTION("it should compress handler content") {
+        std::string content = get("/json", "gzip, deflate");
+        REQUIRE(headers.find("Content-Encoding: gzip\r\n") != std::string::npos);
+        REQUIRE(headers.find("Vary: Accept-Encoding\r\n") != std::string::npos);
+        REQUIRE(headers.find("Content-Length: " + std::to_string(content.size()) + "\r\n") !=
+                std::string::npos);
+        REQUIRE(content.size() < text.size() / 4);
+        REQUIRE(inflateAll(content) == text);
+    }
+    SECTION("it should use deflate if gzip is not accepted") {
+        std::string content = get("/json", "gzip;q=0, deflate");
+        REQUIRE(headers.find("Content-Encoding: deflate\r\n") != std::string::npos);
+        REQUIRE(inflateAll(content) == text);
+    }
+    SECTION("it should not compress if not accepted, small or not text based") {
+        REQUIRE(get("/json", "") == text);
+        REQUIRE(headers.find("Content-Encoding") == std::string::npos);
+        REQUIRE(headers.find("Vary: Accept-Encoding\r\n") != std::string::npos);
+
+        REQUIRE(get("/small", "gzip").size() == 100);
+        REQUIRE(headers.find("Content-Encoding") == std::string::npos);
+
+        REQUIRE(get("/png", "gzip") == text);
+        REQUIRE(headers.find("Content-Encoding") == std::string::npos);
+    }
+    SECTION("it should compress streamed content in chunks") {
+        REQUIRE(inflateAll(get("/stream", "gzip")) == text);
+        REQUIRE(headers.find("Content-Encoding: gzip\r\n") != std::string::npos);
+        REQUIRE(headers.find("Transfer-Encoding: chunked\r\n") != std::string::npos);
+
+        REQUIRE(inflateAll(get("/big", "gzip")) == text);
+        REQUIRE(headers.find("Content-Encoding: gzip\r\n") != std::string::npos);
+        REQUIRE(headers.find("Transfer-Encoding: chunked\r\n") != std::string::npos);
+        REQUIRE(headers.find("Content-Length") == std::string::npos);
+    }
+    SECTION("it should compress files larger than the buffer in chunks") {
+        REQUIRE(inflateAll(get("/compressed.txt", "gzip")) == text);
+        REQUIRE(headers.find("Transfer-Encoding: chunked\r\n") != std::string::npos);
+        REQUIRE(headers.find("Content-Type: text/plain\r\n") != std::string::npos);
+
+        // The connection is kept in sync
+        REQUIRE(get("/compressed.txt", "") == text);
+        REQUIRE(headers.find("Content-Length: " + std::to_string(text.size()) + "\r\n") !=
+                std::string::npos);
+    }
+
+    ioc.stop();
+    t.join();
+    std::remove("compressed.txt");
+}
+
+TEST_CASE("server with range requests", "[server]") {
+    std::string text;
+    for (int i = 0; text.size() < 5000; ++i) {
+        text += std::to_string(i) + ',';
+    }
+    std::ofstream("ranges.txt", std::ios::out | std::ios::binary) << text;
+
+    asio::io_context ioc;
+    FileIO fileIO("./");
+    Settings settings(5s, 100, 0);
+    Server dut(ioc, "127.0.0.1", "0", settings);
+    dut.setFileIO(&fileIO);
+    dut.addRequestHandler([&text](const Request& req, Reply& rep) {
+        if (req.requestPath_ == "/big") {
+            rep.sendBig(Reply::ok,
+                        "text/plain",
+                        text.size(),
+                        [&text](const std::string&, size_t offset, char* buf, size_t maxSize) {
+                            size_t n = std::min(text.size() - offset, maxSize);
+                            if (buf != nullptr) {
+                                std::memcpy(buf, text.data() + offset, n);
+                            }
+                            return static_cast<int>(n);
+                        });
+        }
+    });
+    auto t = std::thread(&asio::io_context::run, &ioc);
+
+    asio::io_context clientIoc;
+    asio::ip::tcp::socket socket(clientIoc);
+    socket.connect(
+        asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), dut.getBindedPort()));
+    std::string headers;
+    auto get = [&socket, &headers](const std::string& path, const std::string& extraHeaders) {
+        asio::write(socket,
+                    asio::buffer("GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n" +
+                                 extraHeaders + "\r\n"));
+        std::string data;
+        size_t n = asio::read_until(socket, asio::dynamic_buffer(data), "\r\n\r\n");
+        headers = data.substr(0, n);
+        data.erase(0, n);
+        size_t contentLength = std::stoul(headers.substr(headers.find("Content-Length: ") + 16));
+        if (data.size() < contentLength) {
+            asio::read(socket,
+                       asio::dynamic_buffer(data),
+                       asio::transfer_exactly(contentLength - data.size()));
+        }
+        return data;
+    };
+    auto hasHeader = [&headers](const std::string& header) {
+        return headers.find(header + "\r\n") != std::string::npos;
+    };
+    const std::string size = std::to_string(text.size());
+
+    auto checkRanges = [&]() {
+        // Single range
+        REQUIRE(get("/ranges.txt", "Range: bytes=10-19\r\n") == text.substr(10, 10));
+        REQUIRE(headers.find("HTTP/1.1 206 Partial Content\r\n") == 0);
+        REQUIRE(hasHeader("Content-Range: bytes 10-19/" + size));
+        REQUIRE(hasHeader("Content-Length: 10"));
+        REQUIRE(hasHeader("Content-Type: text/plain"));
+        REQUIRE(hasHeader("Accept-Ranges: bytes"));
+
+        // Larger than the buffer
+        REQUIRE(get("/ranges.txt", "Range: bytes=1000-2999\r\n") == text.substr(1000, 2000));
+        REQUIRE(hasHeader("Content-Range: bytes 1000-2999/" + size));
+
+        // Suffix and open ended ranges
+        REQUIRE(get("/ranges.txt", "Range: bytes=-100\r\n") == text.substr(text.size() - 100));
+        REQUIRE(get("/ranges.txt", "Range: bytes=4000-\r\n") == text.substr(4000));
+        REQUIRE(hasHeader("Content-Range: bytes 4000-" + std::to_string(text.size() - 1) + "/" +
+                          size));
+
+        // Several ranges
+        std::string content = get("/ranges.txt", "Range: bytes=0-4, 3000-3999\r\n");
+        REQUIRE(headers.find("HTTP/1.1 206 Partial Content\r\n") == 0);
+        size_t pos = headers.find("Content-Type: multipart/byteranges; boundary=");
+        REQUIRE(pos != std::string::npos);
+        pos += 45;
+        std::string boundary = headers.substr(pos, headers.find("\r\n", pos) - pos);
+        REQUIRE(content == "\r\n--" + boundary +
+                               "\r\nContent-Type: text/plain\r\nContent-Range: bytes 0-4/" +
+                               size + "\r\n\r\n" + text.substr(0, 5) + "\r\n--" + boundary +
+                               "\r\nContent-Type: text/plain\r\nContent-Range: bytes 3000-3999/" +
+                               size + "\r\n\r\n" + text.substr(3000, 1000) + "\r\n--" +
+                               boundary + "--\r\n");
+
+        // Not satisfiable
+        get("/ranges.txt", "Range: bytes=9000-\r\n");
+        REQUIRE(headers.find("HTTP/1.1 416 Range Not Satisfiable\r\n") == 0);
+        REQUIRE(hasHeader("Content-Range: bytes */" + size));
+    };
+
+    SECTION("it should send the requested ranges of files") {
+        checkRanges();
+    }
+    SECTION("it should send the requested ranges of cached files") {
+        fileIO.enableCache(1024 * 1024, 64 * 1024);
+        checkRanges();
+    }
+    SECTION("it should send the whole file for invalid ranges or other versions") {
+        REQUIRE(get("/ranges.txt", "Range: lines=1-2\r\n") == text);
+        REQUIRE(headers.find("HTTP/1.1 200 OK\r\n") == 0);
+
+        REQUIRE(get("/ranges.txt", "Range: bytes=0-1\r\nIf-Range: \"other\"\r\n") == text);
+        REQUIRE(headers.find("HTTP/1.1 200 OK\r\n") == 0);
+        REQUIRE(hasHeader("Accept-Ranges: bytes"));
+    }
+    SECTION("it should send the requested ranges of sendBig replies") {
+        REQUIRE(get("/big", "") == text);
+        REQUIRE(hasHeader("Accept-Ranges: bytes"));
+
+        REQUIRE(get("/big", "Range: bytes=1000-2999\r\n") == text.substr(1000, 2000));
+        REQUIRE(hasHeader("Content-Range: bytes 1000-2999/" + size));
+
+        std::string content = get("/big", "Range: bytes=0-0,-1\r\n");
+        REQUIRE(content.find("\r\n\r\n" + text.substr(0, 1) + "\r\n--") != std::string::npos);
+        REQUIRE(content.find("\r\n\r\n" + text.substr(text.size() - 1) + "\r\n--") !=
+                std::string::npos);
+    }
+
+    ioc.stop();
+    t.join();
+    std::remove("ranges.txt");
+}
+
+namespace {
+// Reads files with readFile only (no sendfile), noting the reading threads.
+class ReadOnlyFileIO : public FileIO {
+   public:
+    using FileIO::FileIO;
+
+    bool getNativeReadFile(const std::string&, NativeReadFile&) override {
+        return false;
+    }
+    int readFile(const std::string& id,
+                 const Request& request,
+                 char* buf,
+                 size_t maxSize) override {
+        {
+            std::lock_guard<std::mutex> lock(threadsMutex_);
+            readThreads_.insert(std::this_thread::get_id());
+        }
+        return FileIO::readFile(id, request, buf, maxSize);
+    }
+
+    std::mutex threadsMutex_;
+    std::set<std::thread::id> readThreads_;
+};
+}  // namespace
+
+TEST_CASE("server with async file reads", "[server]") {
+    std::string text;
+    for (int i = 0; text.size() < 20000; ++i) {
+        text += std::to_string(i) + ',';
+    }
+    std::ofstream("async.txt", std::ios::out | std::ios::binary) << text;
+
+    asio::io_context ioc;
+    ReadOnlyFileIO fileIO("./");
+    fileIO.enableAsyncReads(2);
+    Settings settings(5s, 100, 0);
+    Server dut(ioc, "127.0.0.1", "0", settings);
+    dut.setFileIO(&fileIO);
+    auto t = std::thread(&asio::io_context::run, &ioc);
+
+    asio::io_context clientIoc;
+    asio::ip::tcp::socket socket(clientIoc);
+    socket.connect(
+        asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), dut.getBindedPort()));
+    auto get = [&socket](const std::string& path) {
+        asio::write(socket,
+                    asio::buffer("GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n"));
+        std::string data;
+        size_t n = asio::read_until(socket, asio::dynamic_buffer(data), "\r\n\r\n");
+        std::string headers = data.substr(0, n);
+        data.erase(0, n);
+        size_t contentLength = std::stoul(headers.substr(headers.find("Content-Length: ") + 16));
+        if (data.size() < contentLength) {
+            asio::read(socket,
+                       asio::dynamic_buffer(data),
+                       asio::transfer_exactly(contentLength - data.size()));
+        }
+        return data;
+    };
+
+    SECTION("it should read the file on the FileIO threads") {
+        REQUIRE(get("/async.txt") == text);
+        REQUIRE(get("/async.txt") == text);
+
+        // Only the first part is read when the file is opened
+        std::lock_guard<std::mutex> lock(fileIO.threadsMutex_);
+        REQUIRE(fileIO.readThreads_.size() >= 2);
+        REQUIRE(fileIO.readThreads_.size() <= 3);
+        REQUIRE(fileIO.readThreads_.count(t.get_id()) == 1);
+    }
+    SECTION("it should keep serving after a client closed during a file reply") {
+        const std::string request = "GET /async.txt HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+        asio::write(socket, asio::buffer(request));
+        std::string data(1000, '\0');
+        asio::read(socket, asio::buffer(&data[0], data.size()));
+        socket.close();
+
+        socket = asio::ip::tcp::socket(clientIoc);
+        socket.connect(asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"),
+                                               dut.getBindedPort()));
+        REQUIRE(get("/async.txt") == text);
+    }
+
+    ioc.stop();
+    t.join();
+    std::remove("async.txt");
+}
+
+TEST_CASE("server with a send window", "[server]") {
+    std::string text;
+    for (int i = 0; text.size() < 20000; ++i) {
+        text += std::to_string(i) + ',';
+    }
+    std::ofstream("window.txt", std::ios::out | std::ios::binary) << text;
+
+    asio::io_context ioc;
+    ReadOnlyFileIO fileIO("./");
+    Settings settings(5s, 100, 0);
+    settings.sendWindowParts_ = 4;
+    Server dut(ioc, "127.0.0.1", "0", settings);
+    dut.setFileIO(&fileIO);
+    size_t nrOfCalls = 0;
+    dut.addRequestHandler([&text, &nrOfCalls](const Request& req, Reply& rep) {
+        nrOfCalls = 0;
+        auto offset = std::make_shared<size_t>(0);
+        auto callback = [&text, &nrOfCalls, offset](const std::string&, char* buf, size_t maxSize) {
+            size_t n = std::min(text.size() - *offset, maxSize);
+            if (buf != nullptr) {
+                std::memcpy(buf, text.data() + *offset, n);
+                nrOfCalls++;
+            }
+            *offset += n;
+            return static_cast<int>(n);
+        };
+        if (req.requestPath_ == "/big") {
+            rep.sendBig(Reply::ok, "text/plain", text.size(), callback);
+        } else if (req.requestPath_ == "/stream") {
+            rep.sendStreaming(Reply::ok, "text/plain", callback);
+        }
+    });
+    auto t = std::thread(&asio::io_context::run, &ioc);
+
+    asio::io_context clientIoc;
+    asio::ip::tcp::socket socket(clientIoc);
+    socket.connect(
+        asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), dut.getBindedPort()));
+    std::string headers;
+    // The content of the reply, de-chunked if chunked
+    auto get = [&socket, &headers](const std::string& path, const std::string& extraHeaders) {
+        asio::write(socket,
+                    asio::buffer("GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n" +
+                                 extraHeaders + "\r\n"));
+        std::string data;
+        size_t n = asio::read_until(socket, asio::dynamic_buffer(data), "\r\n\r\n");
+        headers = data.substr(0, n);
+        data.erase(0, n);
+        size_t pos = headers.find("Content-Length: ");
+        if (pos != std::string::npos) {
+            size_t contentLength = std::stoul(headers.substr(pos + 16));
+            if (data.size() < contentLength) {
+                asio::read(socket,
+                           asio::dynamic_buffer(data),
+                           asio::transfer_exactly(contentLength - data.size()));
+            }
+            return data;
+        }
+        std::string content;
+        for (;;) {
+            n = asio::read_until(socket, asio::dynamic_buffer(data), "\r\n");
+            size_t chunkSize = std::stoul(data.substr(0, n - 2), nullptr, 16);
+            data.erase(0, n);
+            if (data.size() < chunkSize + 2) {
+                asio::read(socket,
+                           asio::dynamic_buffer(data),
+                           asio::transfer_exactly(chunkSize + 2 - data.size()));
+            }
+            content += data.substr(0, chunkSize);
+            data.erase(0, chunkSize + 2);
+            if (chunkSize == 0) {
+                return content;
+            }
+        }
+    };
+
+    SECTION("it should write sendBig and streamed replies in windows of parts") {
+        REQUIRE(get("/big", "") == text);
+        REQUIRE(nrOfCalls == (text.size() + 1023) / 1024);
+        REQUIRE(get("/stream", "") == text);
+        REQUIRE(headers.find("Transfer-Encoding: chunked\r\n") != std::string::npos);
+
+        // The connection is kept in sync
+        REQUIRE(get("/big", "") == text);
+    }
+    SECTION("it should write files and ranges in windows of parts") {
+        REQUIRE(get("/window.txt", "") == text);
+        REQUIRE(get("/window.txt", "Range: bytes=100-9999\r\n") == text.substr(100, 9900));
+        std::string content = get("/window.txt", "Range: bytes=0-4999,6000-15999\r\n");
+        REQUIRE(content.find(text.substr(0, 5000)) != std::string::npos);
+        REQUIRE(content.find(text.substr(6000, 10000)) != std::string::npos);
+        REQUIRE(get("/window.txt", "") == text);
+    }
+
+    ioc.stop();
+    t.join();
+    std::remove("window.txt");
+}
+
+TEST_CASE("server with chunked request bodies", "[server]") {
+    asio::io_context ioc;
+    MockFileIO mockFileIO;
+    Settings settings(5s, 100, 0);
+    settings.maxChunkSize_ = 2048;
+    Server dut(ioc, "127.0.0.1", "0", settings);
+    dut.setFileIO(&mockFileIO);
+    dut.addRequestHandler([](const Request& req, Reply& rep) {
+        if (req.requestPath_ == "/echo") {
+            rep.content_.assign(req.body_.begin(), req.body_.end());
+            rep.send(Reply::status_type::ok, "text/plain");
+        }
+    });
+    auto t = std::thread(&asio::io_context::run, &ioc);
+
+    asio::io_context clientIoc;
+    asio::ip::tcp::socket socket(clientIoc);
+    socket.connect(
+        asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), dut.getBindedPort()));
+    std::string data;
+    std::string headers;
+    // The content of the next reply, its headers in headers
+    auto readReply = [&socket, &data, &headers]() {
+        size_t n = asio::read_until(socket, asio::dynamic_buffer(data), "\r\n\r\n");
+        headers = data.substr(0, n);
+        data.erase(0, n);
+        size_t contentLength = 0;
+        size_t pos = headers.find("Content-Length: ");
+        if (pos != std::string::npos) {
+            contentLength = std::stoul(headers.substr(pos + 16));
+        }
+        if (data.size() < contentLength) {
+            asio::read(socket,
+                       asio::dynamic_buffer(data),
+                       asio::transfer_exactly(contentLength - data.size()));
+        }
+        std::string content = data.substr(0, contentLength);
+        data.erase(0, contentLength);
+        return content;
+    };
+    auto toChunks = [](const std::string& body, size_t chunkSize) {
+        std::ostringstream os;
+        for (size_t pos = 0; pos < body.size(); pos += chunkSize) {
+            std::string chunk = body.substr(pos, chunkSize);
+            os << std::hex << chunk.size() << "\r\n" << chunk << "\r\n";
+        }
+        os << "0\r\n\r\n";
+        return os.str();
+    };
+    std::string body;
+    for (int i = 0; body.size() < 700; ++i) {
+        body += std::to_string(i) + ',';
+    }
+    const std::string echoHeaders =
+        "POST /echo HTTP/1.1\r\nHost: 127.0.0.1\r\nTransfer-Encoding: chunked\r\n";
+
+    SECTION("it should hand the de-chunked body to the request handler") {
+        const std::string chunks = toChunks(body, 100);
+        asio::write(socket, asio::buffer(echoHeaders + "\r\n" + chunks.substr(0, 250)));
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        asio::write(socket, asio::buffer(chunks.substr(250)));
+        REQUIRE(readReply() == body);
+        REQUIRE(headers.find("HTTP/1.1 200 OK") == 0);
+
+        // A request pipelined after the last chunk is answered as well
+        asio::write(socket,
+                    asio::buffer(echoHeaders + "\r\n" + toChunks("first", 2) + echoHeaders +
+                                 "\r\n" + toChunks("second", 4)));
+        REQUIRE(readReply() == "first");
+        REQUIRE(readReply() == "second");
+    }
+    SECTION("it should read the chunked body after 100 Continue") {
+        asio::write(socket, asio::buffer(echoHeaders + "Expect: 100-continue\r\n\r\n"));
+        asio::read_until(socket, asio::dynamic_buffer(data), "\r\n\r\n");
+        REQUIRE(data.find("HTTP/1.1 100 Continue\r\n\r\n") == 0);
+        data.clear();
+
+        const std::string chunks = toChunks(body, 300);
+        asio::write(socket, asio::buffer(chunks.substr(0, 100)));
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        asio::write(socket, asio::buffer(chunks.substr(100)));
+        REQUIRE(readReply() == body);
+        REQUIRE(headers.find("HTTP/1.1 200 OK") == 0);
+    }
+    SECTION("it should stream a chunked multipart upload to the FileIO") {
+        const std::string boundary = "boundary123456789";
+        const std::string fileContent = body + body + body + body;
+        const std::string multipart =
+            "--" + boundary +
+            "\r\nContent-Disposition: form-data; name=\"file\"; filename=\"upload.txt\"\r\n"
+            "Content-Type: text/plain\r\n\r\n" +
+            fileContent + "\r\n--" + boundary + "--\r\n";
+        asio::write(socket,
+                    asio::buffer("POST / HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+                                 "Transfer-Encoding: chunked\r\n"
+                                 "Content-Type: multipart/form-data; boundary=" +
+                                 boundary + "\r\n\r\n" + toChunks(multipart, 500)));
+        readReply();
+        REQUIRE(headers.find("HTTP/1.1 201 Created") == 0);
+        REQUIRE(mockFileIO.getLastData("/upload.txt0") == true);
+        std::vector<char> result = mockFileIO.getMockWriteFile("/upload.txt0");
+        REQUIRE(std::string(result.begin(), result.end()) == fileContent);
+    }
+    SECTION("it should answer 413 to chunks larger than the max chunk size") {
+        asio::write(socket, asio::buffer(echoHeaders + "\r\n801\r\n"));
+        readReply();
+        REQUIRE(headers.find("HTTP/1.1 413 Payload Too Large") == 0);
+    }
+    SECTION("it should answer 413 to a chunked body larger than the buffer") {
+        asio::write(socket, asio::buffer(echoHeaders + "\r\n" + toChunks(body + body, 200)));
+        readReply();
+        REQUIRE(headers.find("HTTP/1.1 413 Payload Too Large") == 0);
+    }
+    SECTION("it should answer 400 to invalid chunks") {
+        asio::write(socket, asio::buffer(echoHeaders + "\r\n5\r\nfirst!\r\n0\r\n\r\n"));
+        readReply();
+        REQUIRE(headers.find("HTTP/1.1 400 Bad Request") == 0);
+    }
+
+    ioc.stop();
+    t.join();
+}
+
+TEST_CASE("server with raw uploads", "[server]") {
+    asio::io_context ioc;
+    MockFileIO mockFileIO;
+    Settings settings(5s, 100, 0);
+    settings.rawUploads_ = true;
+    Server dut(ioc, "127.0.0.1", "0", settings);
+    dut.setFileIO(&mockFileIO);
+    dut.addRequestHandler([](const Request& req, Reply& rep) {
+        if (req.requestPath_ == "/api") {
+            const std::string text = "got " + std::to_string(req.body_.size());
+            rep.content_.assign(text.begin(), text.end());
+            rep.send(Reply::status_type::ok, "text/plain");
+        }
+    });
+    auto t = std::thread(&asio::io_context::run, &ioc);
+
+    asio::io_context clientIoc;
+    asio::ip::tcp::socket socket(clientIoc);
+    socket.connect(
+        asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), dut.getBindedPort()));
+    std::string data;
+    // Much larger than maxContentSize (1024)
+    std::string body;
+    for (int i = 0; body.size() < 50000; ++i) {
+        body += std::to_string(i) + ',';
+    }
+
+    SECTION("it should stream an octet-stream body to the FileIO") {
+        const std::string request =
+            "PUT /blob.bin HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+            "Content-Type: application/octet-stream\r\n"
+            "Content-Length: " +
+            std::to_string(body.size()) + "\r\n\r\n" + body;
+        asio::write(socket, asio::buffer(request.substr(0, 3000)));
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        asio::write(socket, asio::buffer(request.substr(3000)));
+        asio::read_until(socket, asio::dynamic_buffer(data), "\r\n\r\n");
+        REQUIRE(data.find("HTTP/1.1 201 Created\r\n") == 0);
+        REQUIRE(mockFileIO.getOpenFileForWriteCalls() == 1);
+        REQUIRE(mockFileIO.getLastData("/blob.bin0") == true);
+        std::vector<char> result = mockFileIO.getMockWriteFile("/blob.bin0");
+        REQUIRE(std::string(result.begin(), result.end()) == body);
+    }
+    SECTION("it should stream a chunked octet-stream body to the FileIO") {
+        std::ostringstream chunks;
+        for (size_t pos = 0; pos < body.size(); pos += 700) {
+            std::string chunk = body.substr(pos, 700);
+            chunks << std::hex << chunk.size() << "\r\n" << chunk << "\r\n";
+        }
+        chunks << "0\r\n\r\n";
+        asio::write(socket,
+                    asio::buffer("POST /blob.bin HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+                                 "Content-Type: application/octet-stream\r\n"
+                                 "Transfer-Encoding: chunked\r\n\r\n" +
+                                 chunks.str()));
+        asio::read_until(socket, asio::dynamic_buffer(data), "\r\n\r\n");
+        REQUIRE(data.find("HTTP/1.1 201 Created\r\n") == 0);
+        REQUIRE(mockFileIO.getLastData("/blob.bin0") == true);
+        std::vector<char> result = mockFileIO.getMockWriteFile("/blob.bin0");
+        REQUIRE(std::string(result.begin(), result.end()) == body);
+    }
+    SECTION("it should stream an octet-stream body after 100 Continue") {
+        asio::write(socket,
+                    asio::buffer("PUT /blob.bin HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+                                 "Content-Type: application/octet-stream\r\n"
+                                 "Expect: 100-continue\r\n"
+                                 "Content-Length: " +
+                                 std::to_string(body.size()) + "\r\n\r\n"));
+        size_t n = asio::read_until(socket, asio::dynamic_buffer(data), "\r\n\r\n");
+        REQUIRE(data.find("HTTP/1.1 100 Continue\r\n\r\n") == 0);
+        data.erase(0, n);
+
+        asio::write(socket, asio::buffer(body));
+        asio::read_until(socket, asio::dynamic_buffer(data), "\r\n\r\n");
+        REQUIRE(data.find("HTTP/1.1 201 Created\r\n") == 0);
+        std::vector<char> result = mockFileIO.getMockWriteFile("/blob.bin0");
+        REQUIRE(std::string(result.begin(), result.end()) == body);
+    }
+    SECTION("it should give request handlers whole octet-stream bodies that fit") {
+        const std::string request =
+            "POST /api HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+            "Content-Type: application/octet-stream\r\n"
+            "Content-Length: 100\r\n\r\n" +
+            body.substr(0, 100);
+        // the body in two segments
+        asio::write(socket, asio::buffer(request.substr(0, request.size() - 90)));
+        std::this_thread::sleep_for(20ms);
+        asio::write(socket, asio::buffer(request.substr(request.size() - 90)));
+        size_t n = asio::read_until(socket, asio::dynamic_buffer(data), "\r\n\r\n");
+        REQUIRE(data.find("HTTP/1.1 200 OK\r\n") == 0);
+        if (data.size() < n + 7) {
+            asio::read(socket,
+                       asio::dynamic_buffer(data),
+                       asio::transfer_exactly(n + 7 - data.size()));
+        }
+        REQUIRE(data.substr(n, 7) == "got 100");
+        REQUIRE(mockFileIO.getOpenFileForWriteCalls() == 0);
+    }
+    SECTION("it should still answer 413 to other large bodies") {
+        asio::write(socket,
+                    asio::buffer("PUT /blob.bin HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+                                 "Content-Type: text/plain\r\n"
+                                 "Content-Length: " +
+                                 std::to_string(body.size()) + "\r\n\r\n" +
+                                 body.substr(0, 500)));
+        asio::read_until(socket, asio::dynamic_buffer(data), "\r\n\r\n");
+        REQUIRE(data.find("HTTP/1.1 413 Payload Too Large\r\n") == 0);
+        REQUIRE(mockFileIO.getOpenFileForWriteCalls() == 0);
+    }
+
+    ioc.stop();
+    t.join();
+}
+
+TEST_CASE("server with raw uploads to native files", "[server]") {
+    // FileIO provides native files, written with splice() where supported
+    asio::io_context ioc;
+    CountingFileIO fileIO("./");
+    Settings settings(5s, 100, 0);
+    settings.rawUploads_ = true;
+    Server dut(ioc, "127.0.0.1", "0", settings);
+    dut.setFileIO(&fileIO);
+    auto t = std::thread(&asio::io_context::run, &ioc);
+
+    asio::io_context clientIoc;
+    asio::ip::tcp::socket socket(clientIoc);
+    socket.connect(
+        asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), dut.getBindedPort()));
+
+    SECTION("it should write the whole body to the file") {
+        std::string body(700000, '\0');
+        for (size_t i = 0; i < body.size(); ++i) {
+            body[i] = static_cast<char>(i % 251);
+        }
+        std::string data;
+        for (int i = 0; i < 2; ++i) {
+            // twice on the same connection
+            asio::write(socket,
+                        asio::buffer("PUT /raw_upload_test.bin HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+                                     "Content-Type: application/octet-stream\r\n"
+                                     "Content-Length: " +
+                                     std::to_string(body.size()) + "\r\n\r\n"));
+            asio::write(socket, asio::buffer(body));
+            size_t n = asio::read_until(socket, asio::dynamic_buffer(data), "\r\n\r\n");
+            REQUIRE(data.find("HTTP/1.1 201 Created\r\n") == 0);
+            data.erase(0, n);
+
+            std::ifstream is("raw_upload_test.bin", std::ios::in | std::ios::binary);
+            std::string written((std::istreambuf_iterator<char>(is)),
+                                std::istreambuf_iterator<char>());
+            REQUIRE(written.size() == body.size());
+            REQUIRE(written == body);
+            body.resize(body.size() / 2);
+        }
+    }
+
+    SECTION("it should close the file when the client disconnects") {
+        asio::write(socket,
+                    asio::buffer("PUT /raw_upload_test.bin HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+                                 "Content-Type: application/octet-stream\r\n"
+                                 "Content-Length: 700000\r\n\r\n"));
+        asio::write(socket, asio::buffer(std::string(1000, 'x')));
+        std::this_thread::sleep_for(20ms);
+        socket.close();
+        for (int i = 0; i < 100 && fileIO.nrOfLastWrites_ == 0; ++i) {
+            std::this_thread::sleep_for(10ms);
+        }
+        REQUIRE(fileIO.nrOfLastWrites_ == 1);
+    }
+
+    ioc.stop();
+    t.join();
+    std::remove("raw_upload_test.bin");
+}
+
+TEST_CASE("server with upload blocks", "[server]") {
+    asio::io_context ioc;
+    MockFileIO mockFileIO;
+    Settings settings(0s, 0, 0);
+    settings.uploadBlockSize_ = 4096;
+    settings.preallocateUploads_ = true;
+    Server dut(ioc, "127.0.0.1", "0", settings);
+    dut.setFileIO(&mockFileIO);
+    auto t = std::thread(&asio::io_context::run, &ioc);
+
+    asio::io_context clientIoc;
+    asio::ip::tcp::socket socket(clientIoc);
+    socket.connect(
+        asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), dut.getBindedPort()));
+
+    std::string content(10000, '\0');
+    for (size_t i = 0; i < content.size(); ++i) {
+        content[i] = static_cast<char>(i % 251);
+    }
+    auto partHeaders = [](const std::string& filename) {
+        return "--boundary42\r\nContent-Disposition: form-data; name=\"file\"; filename=\"" +
+               filename + "\"\r\n\r\n";
+    };
+    auto post = [&socket](const std::string& body) {
+        asio::write(socket,
+                    asio::buffer("POST / HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+                                 "Content-Type: multipart/form-data; boundary=boundary42\r\n"
+                                 "Content-Length: " +
+                                 std::to_string(body.size()) + "\r\n\r\n"));
+        asio::write(socket, asio::buffer(body));
+        std::string data;
+        asio::read_until(socket, asio::dynamic_buffer(data), "\r\n\r\n");
+        return data;
+    };
+
+    SECTION("it should write multipart uploads in whole blocks") {
+        std::string body = partHeaders("first.bin") + content + "\r\n" +
+                           partHeaders("second.bin") + content.substr(0, 100) +
+                           "\r\n--boundary42--\r\n";
+        REQUIRE(post(body).find("HTTP/1.1 201 Created\r\n") == 0);
+
+        std::vector<char> written = mockFileIO.getMockWriteFile("/first.bin0");
+        REQUIRE(std::string(written.begin(), written.end()) == content);
+        REQUIRE(mockFileIO.getLastData("/first.bin0") == true);
+        std::vector<size_t> sizes = mockFileIO.getWriteSizes("/first.bin0");
+        REQUIRE(sizes.size() == 3);
+        REQUIRE(sizes[0] == 4096);
+        REQUIRE(sizes[1] == 4096);
+        REQUIRE(sizes[2] == content.size() - 8192);
+
+        written = mockFileIO.getMockWriteFile("/second.bin0");
+        REQUIRE(std::string(written.begin(), written.end()) == content.substr(0, 100));
+        REQUIRE(mockFileIO.getWriteSizes("/second.bin0").size() == 1);
+
+        // bounded by the rest of the body from the read each part starts in
+        size_t firstBound = mockFileIO.getPreallocatedSize("/first.bin0");
+        size_t secondBound = mockFileIO.getPreallocatedSize("/second.bin0");
+        REQUIRE(firstBound >= content.size() + 100);
+        REQUIRE(firstBound <= body.size());
+        REQUIRE(secondBound >= 100);
+        REQUIRE(secondBound < firstBound);
+    }
+    SECTION("it should write the parts before a bad one") {
+        std::string body = partHeaders("first.bin") + content + "\r\n--boundary42\r\n@";
+        REQUIRE(post(body).find("HTTP/1.1 400 Bad Request\r\n") == 0);
+
+        std::vector<char> written = mockFileIO.getMockWriteFile("/first.bin0");
+        REQUIRE(std::string(written.begin(), written.end()) == content);
+        REQUIRE(mockFileIO.getLastData("/first.bin0") == true);
+    }
+    SECTION("it should write the data held back when the client goes away") {
+        std::string body = partHeaders("first.bin") + content;
+        asio::write(socket,
+                    asio::buffer("POST / HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+                                 "Content-Type: multipart/form-data; boundary=boundary42\r\n"
+                                 "Content-Length: " +
+                                 std::to_string(body.size() + 100) + "\r\n\r\n"));
+        asio::write(socket, asio::buffer(body));
+        socket.shutdown(asio::ip::tcp::socket::shutdown_send);
+
+        // The mock is inspected on the server thread, until all has been read
+        size_t writtenSize = 0;
+        for (int i = 0; i < 100 && writtenSize < content.size(); ++i) {
+            std::promise<size_t> size;
+            asio::post(ioc, [&]() {
+                size.set_value(mockFileIO.getMockWriteFile("/first.bin0").size());
+            });
+            writtenSize = size.get_future().get();
+            std::this_thread::sleep_for(10ms);
+        }
+        std::vector<char> written = mockFileIO.getMockWriteFile("/first.bin0");
+        REQUIRE(std::string(written.begin(), written.end()) == content);
+        REQUIRE(mockFileIO.getLastData("/first.bin0") == false);
+    }
+
+    ioc.stop();
+    t.join();
+}
+
+namespace {
+// Average round trip of keep-alive requests for a small JSON reply (single
+// write) or a streamed reply written in several parts.
+double measureRoundTripUs(const Settings& settings, bool partial, size_t nrOfRequests) {
+    asio::io_context ioc;
+    Server dut(ioc, "127.0.0.1", "0", settings);
+    dut.addRequestHandler([partial](const Request&, Reply& rep) {
+        if (!partial) {
+            static const std::string body = "{\"status\":\"ok\"}";
+            rep.content_.assign(body.begin(), body.end());
+            rep.send(Reply::status_type::ok, "application/json");
+            return;
+        }
+        auto remaining = std::make_shared<size_t>(2500);
+        rep.sendBig(Reply::status_type::ok,
+                    "application/octet-stream",
+                    *remaining,
+                    [remaining](const std::string&, char* buf, size_t maxSize) {
+                        size_t n = std::min(*remaining, maxSize);
+                        if (buf != nullptr) {
+                            std::memset(buf, 'x', n);
+                        }
+                        *remaining -= n;
+                        return static_cast<int>(n);
+                    });
+    });
+    auto t = std::thread(&asio::io_context::run, &ioc);
+
+    asio::io_context clientIoc;
+    asio::ip::tcp::socket socket(clientIoc);
+    socket.connect(
+        asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), dut.getBindedPort()));
+    socket.set_option(asio::ip::tcp::no_delay(true));
+    const std::string request = "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    std::string data;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < nrOfRequests; ++i) {
+        asio::write(socket, asio::buffer(request));
+        size_t headerEnd = asio::read_until(socket, asio::dynamic_buffer(data), "\r\n\r\n");
+        size_t pos = data.find("Content-Length: ");
+        size_t contentLength = std::stoul(data.substr(pos + 16));
+        if (data.size() < headerEnd + contentLength) {
+            asio::read(socket,
+                       asio::dynamic_buffer(data),
+                       asio::transfer_exactly(headerEnd + contentLength - data.size()));
+        }
+        data.erase(0, headerEnd + contentLength);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    ioc.stop();
+    t.join();
+    return std::chrono::duration<double, std::micro>(elapsed).count() / nrOfRequests;
+}
+}  // namespace
+
+// Not run by default, use: beauty_test "[.benchmark][server]"
+TEST_CASE("server reply round trip on loopback", "[.benchmark][server]") {
+    Settings settings(5s, 1000000, 0);
+    Settings noDelay = settings;
+    noDelay.tcpNoDelay_ = true;
+    Settings cork = settings;
+    cork.tcpCork_ = true;
+
+    std::cout << "single write, default: " << measureRoundTripUs(settings, false, 5000)
+              << " us, TCP_NODELAY: " << measureRoundTripUs(noDelay, false, 5000) << " us"
+              << std::endl;
+    std::cout << "partial writes, default: " << measureRoundTripUs(settings, true, 100)
+              << " us, TCP_NODELAY: " << measureRoundTripUs(noDelay, true, 100)
+              << " us, TCP_CORK: " << measureRoundTripUs(cork, true, 100) << " us" << std::endl;
+}
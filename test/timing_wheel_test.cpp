@@ -0,0 +1,140 @@
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "beauty/timing_wheel.hpp"
+
+using namespace std::literals::chrono_literals;
+using namespace beauty;
+
+namespace {
+struct Timer {
+    Timer(int id) : id_(id), entry_(this) {}
+    int id_;
+    TimingWheel<Timer>::Entry entry_;
+};
+using clock_type = std::chrono::steady_clock;
+}  // namespace
+
+TEST_CASE("timing wheel", "[timing_wheel]") {
+    const auto start = clock_type::now();
+    TimingWheel<Timer> wheel(10ms, start);
+    std::vector<int> expired;
+    auto onExpired = [&expired](Timer& t) { expired.push_back(t.id_); };
+
+    SECTION("it should expire entry at its deadline") {
+        Timer t(1);
+        wheel.schedule(t.entry_, start + 50ms);
+        REQUIRE(t.entry_.isScheduled());
+
+        wheel.advance(start + 40ms, onExpired);
+        REQUIRE(expired.empty());
+        wheel.advance(start + 50ms, onExpired);
+        REQUIRE(expired == std::vector<int>{1});
+        REQUIRE_FALSE(t.entry_.isScheduled());
+    }
+    SECTION("it should round deadlines up to the resolution") {
+        Timer t(1);
+        wheel.schedule(t.entry_, start + 41ms);
+        wheel.advance(start + 41ms, onExpired);
+        REQUIRE(expired.empty());
+        wheel.advance(start + 50ms, onExpired);
+        REQUIRE(expired == std::vector<int>{1});
+    }
+    SECTION("it should expire entry with deadline in the past on next tick") {
+        wheel.advance(start + 100ms, onExpired);
+        Timer t(1);
+        wheel.schedule(t.entry_, start);
+        wheel.advance(start + 100ms, onExpired);
+        REQUIRE(expired.empty());
+        wheel.advance(start + 110ms, onExpired);
+        REQUIRE(expired == std::vector<int>{1});
+    }
+    SECTION("it should expire entries on coarser levels") {
+        // 10ms * 64 = 640ms per level 1 slot, 10ms * 64^2 = 40.96s per level 2 slot
+        Timer t1(1), t2(2), t3(3);
+        wheel.schedule(t1.entry_, start + 700ms);
+        wheel.schedule(t2.entry_, start + 50s);
+        wheel.schedule(t3.entry_, start + 2h);
+
+        wheel.advance(start + 690ms, onExpired);
+        REQUIRE(expired.empty());
+        wheel.advance(start + 700ms, onExpired);
+        REQUIRE(expired == std::vector<int>{1});
+        wheel.advance(start + 49990ms, onExpired);
+        REQUIRE(expired == std::vector<int>{1});
+        wheel.advance(start + 50s, onExpired);
+        REQUIRE(expired == std::vector<int>{1, 2});
+        wheel.advance(start + 2h - 10ms, onExpired);
+        REQUIRE(expired == std::vector<int>{1, 2});
+        wheel.advance(start + 2h, onExpired);
+        REQUIRE(expired == std::vector<int>{1, 2, 3});
+    }
+    SECTION("it should clamp deadlines beyond the range of the wheel") {
+        // Range is 10ms * 64^4 ~ 46.6h
+        Timer t(1);
+        wheel.schedule(t.entry_, start + 100h);
+        wheel.advance(start + 99h, onExpired);
+        REQUIRE(expired.empty());
+        wheel.advance(start + 100h, onExpired);
+        REQUIRE(expired == std::vector<int>{1});
+    }
+    SECTION("it should not expire cancelled entries") {
+        Timer t1(1), t2(2);
+        wheel.schedule(t1.entry_, start + 50ms);
+        wheel.schedule(t2.entry_, start + 50ms);
+        wheel.cancel(t1.entry_);
+        REQUIRE_FALSE(t1.entry_.isScheduled());
+        wheel.advance(start + 1s, onExpired);
+        REQUIRE(expired == std::vector<int>{2});
+    }
+    SECTION("it should unlink entries when destroyed") {
+        Timer t1(1);
+        {
+            Timer t2(2);
+            wheel.schedule(t2.entry_, start + 50ms);
+        }
+        wheel.schedule(t1.entry_, start + 50ms);
+        wheel.advance(start + 1s, onExpired);
+        REQUIRE(expired == std::vector<int>{1});
+    }
+    SECTION("it should reschedule entries") {
+        Timer t(1);
+        wheel.schedule(t.entry_, start + 50ms);
+        wheel.schedule(t.entry_, start + 5s);
+        wheel.advance(start + 4s, onExpired);
+        REQUIRE(expired.empty());
+        wheel.advance(start + 5s, onExpired);
+        REQUIRE(expired == std::vector<int>{1});
+    }
+    SECTION("it should allow rescheduling and cancelling from the callback") {
+        Timer t1(1), t2(2);
+        wheel.schedule(t1.entry_, start + 50ms);
+        wheel.schedule(t2.entry_, start + 50ms);
+        int calls = 0;
+        wheel.advance(start + 50ms, [&](Timer& t) {
+            calls++;
+            // Reschedule the expired entry and cancel the other one
+            wheel.schedule(t.entry_, start + 100ms);
+            wheel.cancel(t.id_ == 1 ? t2.entry_ : t1.entry_);
+        });
+        REQUIRE(calls == 1);
+        wheel.advance(start + 100ms, onExpired);
+        REQUIRE(expired.size() == 1);
+    }
+    SECTION("it should only touch expiring entries") {
+        std::vector<std::unique_ptr<Timer>> timers;
+        for (int i = 0; i < 10000; ++i) {
+            timers.emplace_back(new Timer(i));
+            wheel.schedule(timers.back()->entry_, start + std::chrono::milliseconds(10 * i));
+        }
+        wheel.advance(start + 1s, onExpired);
+        REQUIRE(expired.size() == 101);
+        for (int i = 0; i <= 100; ++i) {
+            REQUIRE(expired[i] == i);
+        }
+        wheel.advance(start + 100s, onExpired);
+        REQUIRE(expired.size() == 10000);
+    }
+}
@@ -84,12 +84,18 @@ void MockFileIO::writeFile(const std::string& id,
         throw std::runtime_error("MockFileIO test error: writeFile() called on closed file");
     }
     openFile.file_.insert(openFile.file_.end(), buf, buf + size);
+    openFile.writeSizes_.push_back(size);
     openFile.lastData_ = lastData;
     if (lastData) {
         reply.send(beauty::Reply::status_type::created);
     }
 }
 
+bool MockFileIO::preallocateWriteFile(const std::string& id, size_t size) {
+    openWriteFiles_[id].preallocatedSize_ = size;
+    return true;
+}
+
 int MockFileIO::getOpenFileForWriteCalls() {
     return countOpenFileForWriteCalls_;
 }
@@ -143,3 +149,11 @@ int MockFileIO::getCloseReadFileCalls() {
 bool MockFileIO::getLastData(const std::string& id) {
     return openWriteFiles_[id].lastData_;
 }
+
+std::vector<size_t> MockFileIO::getWriteSizes(const std::string& id) {
+    return openWriteFiles_[id].writeSizes_;
+}
+
+size_t MockFileIO::getPreallocatedSize(const std::string& id) {
+    return openWriteFiles_[id].preallocatedSize_;
+}
@@ -31,6 +31,7 @@ class MockFileIO : public beauty::IFileIO {
                    const char* buf,
                    size_t size,
                    bool lastData) override;
+    bool preallocateWriteFile(const std::string& id, size_t size) override;
 
     void createMockFile(uint32_t size);
     void setMockFailToOpenReadFile();
@@ -43,6 +44,9 @@ class MockFileIO : public beauty::IFileIO {
     int getReadFileCalls();
     int getCloseReadFileCalls();
     bool getLastData(const std::string& id);
+    // The sizes of the writeFile calls, and the size preallocated (0 = none).
+    std::vector<size_t> getWriteSizes(const std::string& id);
+    size_t getPreallocatedSize(const std::string& id);
 
    private:
     struct OpenReadFile {
@@ -53,6 +57,8 @@ class MockFileIO : public beauty::IFileIO {
         std::vector<char> file_;
         bool isOpen_ = false;
         bool lastData_ = false;
+        std::vector<size_t> writeSizes_;
+        size_t preallocatedSize_ = 0;
     };
     std::unordered_map<std::string, OpenReadFile> openReadFiles_;
     std::unordered_map<std::string, OpenWriteFile> openWriteFiles_;
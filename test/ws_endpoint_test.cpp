@@ -0,0 +1,133 @@
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "beauty/server.hpp"
+#include "beauty/ws_endpoint.hpp"
+
+using namespace std::literals::chrono_literals;
+using namespace beauty;
+
+namespace {
+
+class TestEndpoint : public WsEndpoint {
+   public:
+    TestEndpoint() : WsEndpoint("/ws") {}
+    void onWsOpen(const std::string& connectionId) override {
+        opened_.set_value(connectionId);
+    }
+    void onWsMessage(const std::string&, const WsMessage&) override {}
+    void onWsClose(const std::string&) override {}
+    void onWsError(const std::string&, const std::string&) override {}
+
+    std::promise<std::string> opened_;
+};
+
+// Blocking WebSocket client, only handles small unmasked server frames.
+class WsClient {
+   public:
+    explicit WsClient(uint16_t port) : socket_(ioc_) {
+        socket_.connect(asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), port));
+        const std::string upgrade =
+            "GET /ws HTTP/1.1\r\n"
+            "Host: 127.0.0.1\r\n"
+            "Upgrade: websocket\r\n"
+            "Connection: Upgrade\r\n"
+            "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+            "Sec-WebSocket-Version: 13\r\n\r\n";
+        asio::write(socket_, asio::buffer(upgrade));
+        size_t n = asio::read_until(socket_, asio::dynamic_buffer(data_), "\r\n\r\n");
+        statusLine_ = data_.substr(0, data_.find("\r\n"));
+        data_.erase(0, n);
+    }
+
+    std::string readTextFrame() {
+        if (data_.size() < 2) {
+            asio::read(socket_, asio::dynamic_buffer(data_), asio::transfer_exactly(2));
+        }
+        size_t len = static_cast<unsigned char>(data_[1]) & 0x7f;
+        if (data_.size() < 2 + len) {
+            asio::read(socket_,
+                       asio::dynamic_buffer(data_),
+                       asio::transfer_exactly(2 + len - data_.size()));
+        }
+        std::string payload = data_.substr(2, len);
+        data_.erase(0, 2 + len);
+        return payload;
+    }
+
+    std::string statusLine_;
+
+   private:
+    asio::io_context ioc_;
+    asio::ip::tcp::socket socket_;
+    std::string data_;
+};
+
+template <typename F>
+auto runOn(asio::io_context& ioc, F f) -> decltype(f()) {
+    std::packaged_task<decltype(f())()> task(f);
+    auto fut = task.get_future();
+    asio::post(ioc, [&task]() { task(); });
+    return fut.get();
+}
+
+}  // namespace
+
+TEST_CASE("WebSocket endpoint sending", "[ws_endpoint]") {
+    asio::io_context ioc;
+    Settings settings(5s, 100, 0);
+    Server dut(ioc, "127.0.0.1", "0", settings);
+    auto endpoint = std::make_shared<TestEndpoint>();
+    dut.setWsEndpoints({endpoint});
+    auto t = std::thread([&ioc]() { ioc.run(); });
+
+    WsClient client(dut.getBindedPort());
+    REQUIRE(client.statusLine_ == "HTTP/1.1 101 Switching Protocols");
+    std::string connectionId = endpoint->opened_.get_future().get();
+
+    SECTION("it should send using string connection id") {
+        auto res = runOn(ioc, [&]() { return endpoint->sendText(connectionId, "by id"); });
+        REQUIRE(res == WriteResult::SUCCESS);
+        REQUIRE(client.readTextFrame() == "by id");
+    }
+    SECTION("it should send using numeric connection handle") {
+        WsConnectionHandle handle;
+        REQUIRE(WsConnectionHandle::fromString(connectionId, handle));
+        REQUIRE(handle.toString() == connectionId);
+        auto res = runOn(ioc, [&]() { return endpoint->sendText(handle, "by handle"); });
+        REQUIRE(res == WriteResult::SUCCESS);
+        REQUIRE(client.readTextFrame() == "by handle");
+    }
+    SECTION("it should list active connections") {
+        auto ids = runOn(ioc, [&]() { return endpoint->getActiveConnections(); });
+        auto handles = runOn(ioc, [&]() { return endpoint->getActiveHandles(); });
+        REQUIRE(ids == std::vector<std::string>{connectionId});
+        WsConnectionHandle handle;
+        REQUIRE(WsConnectionHandle::fromString(connectionId, handle));
+        REQUIRE(handles == std::vector<WsConnectionHandle>{handle});
+    }
+    SECTION("it should report unknown connections as closed") {
+        WsConnectionHandle unknown;
+        REQUIRE(WsConnectionHandle::fromString(connectionId, unknown));
+        unknown.id_++;
+        auto res = runOn(ioc, [&]() { return endpoint->sendText(unknown, "nobody"); });
+        REQUIRE(res == WriteResult::CONNECTION_CLOSED);
+        REQUIRE(runOn(ioc, [&]() { return endpoint->canSendTo(connectionId); }) == true);
+    }
+    SECTION("it should not send to invalid string connection ids") {
+        for (const std::string id : {"", "bogus", "0abc", "+0", " 0", "99999999999999999999"}) {
+            auto res = runOn(ioc, [&]() { return endpoint->sendText(id, "nobody"); });
+            REQUIRE(res == WriteResult::CONNECTION_CLOSED);
+        }
+        REQUIRE(runOn(ioc, [&]() { return endpoint->sendText(connectionId, "somebody"); }) ==
+                WriteResult::SUCCESS);
+        REQUIRE(client.readTextFrame() == "somebody");
+    }
+
+    ioc.stop();
+    t.join();
+}